@@ -0,0 +1,76 @@
+#include "kfs.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+typedef struct AllocShard {
+  _Atomic int64_t objects[KFS_ALLOC_COUNT];
+  _Atomic int64_t bytes[KFS_ALLOC_COUNT];
+  struct AllocShard *next;
+} AllocShard;
+
+// shards are plain malloc, so counting never recurses into itself
+static pthread_mutex_t shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static AllocShard *shards;
+static _Thread_local AllocShard *my_shard;
+
+#define KFS_ALLOC_NAME_OF(name) #name,
+static const char *const kind_names[] = {KFS_ALLOC_KINDS(KFS_ALLOC_NAME_OF)};
+#undef KFS_ALLOC_NAME_OF
+
+const char *kfs_alloc_kind_name(int kind) { return kind_names[kind]; }
+
+// only the owning thread writes a shard
+static inline void bump(_Atomic int64_t *counter, int64_t n) {
+  atomic_store_explicit(
+      counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+      memory_order_relaxed);
+}
+
+static AllocShard *shard(void) {
+  if (my_shard == NULL) {
+    AllocShard *s = xmalloc(sizeof(AllocShard));
+    memset(s, 0, sizeof(AllocShard));
+
+    pthread_mutex_lock(&shards_lock);
+    s->next = shards;
+    shards = s;
+    pthread_mutex_unlock(&shards_lock);
+    my_shard = s;
+  }
+  return my_shard;
+}
+
+void kfs_alloc_count(int kind, int64_t objects, int64_t bytes) {
+  AllocShard *s = shard();
+  bump(&s->objects[kind], objects);
+  bump(&s->bytes[kind], bytes);
+}
+
+void kfs_alloc_get(int kind, KFS_AllocStats *out) {
+  memset(out, 0, sizeof(*out));
+
+  pthread_mutex_lock(&shards_lock);
+  for (AllocShard *s = shards; s != NULL; s = s->next) {
+    out->objects +=
+        atomic_load_explicit(&s->objects[kind], memory_order_relaxed);
+    out->bytes += atomic_load_explicit(&s->bytes[kind], memory_order_relaxed);
+  }
+  pthread_mutex_unlock(&shards_lock);
+}
+
+sds kfs_alloc_render(void) {
+  sds out = sdsnew("subsystem objects bytes\n");
+  KFS_AllocStats total = {0, 0};
+
+  for (int kind = 0; kind < KFS_ALLOC_COUNT; kind++) {
+    KFS_AllocStats stats;
+    kfs_alloc_get(kind, &stats);
+    total.objects += stats.objects;
+    total.bytes += stats.bytes;
+    out = sdscatprintf(out, "%s %lld %lld\n", kind_names[kind],
+                       (long long)stats.objects, (long long)stats.bytes);
+  }
+  return sdscatprintf(out, "total %lld %lld\n", (long long)total.objects,
+                      (long long)total.bytes);
+}
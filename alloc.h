@@ -0,0 +1,51 @@
+#ifndef __ALLOC_HEADER_INCLUDED__
+#define __ALLOC_HEADER_INCLUDED__
+#include "sds/sds.h"
+#include <stdint.h>
+
+/*
+  Live heap accounting per subsystem, so that growth can be pinned on
+  whoever owns it and a leak shows up as a counter that never comes back
+  down.  Sizes are the bytes asked for, without malloc's own overhead.
+  Memory carved out of a scratch directory's region is counted once, as
+  the region's blocks; entries, names, indexes and chunks inside a region
+  are not counted again.  Shared views (shm.h) are memfd pages rather than
+  heap, but are counted here too, as shm.
+
+  Like the latency stats, each thread counts into a shard of its own and
+  readers sum the shards; a free on another thread than the allocation
+  simply leaves a negative count in that thread's shard.
+
+  Served at /.kfs/alloc inside the mount and by the shell's alloc command,
+  one line per subsystem:
+    subsystem objects bytes
+*/
+
+#define KFS_ALLOC_KINDS(X)                                                     \
+  X(entries)                                                                   \
+  X(names)                                                                     \
+  X(avl)                                                                       \
+  X(vectors)                                                                   \
+  X(file_data)                                                                 \
+  X(regions)                                                                   \
+  X(shm)
+
+#define KFS_ALLOC_ENUM(name) KFS_ALLOC_##name,
+enum { KFS_ALLOC_KINDS(KFS_ALLOC_ENUM) KFS_ALLOC_COUNT };
+#undef KFS_ALLOC_ENUM
+
+#define KFS_ALLOC_FILE KFS_STATS_DIR "/alloc"
+
+typedef struct {
+  int64_t objects;
+  int64_t bytes;
+} KFS_AllocStats;
+
+// objects and bytes are deltas: positive on allocation, negative on free
+void kfs_alloc_count(int kind, int64_t objects, int64_t bytes);
+const char *kfs_alloc_kind_name(int kind);
+// what is live right now
+void kfs_alloc_get(int kind, KFS_AllocStats *out);
+sds kfs_alloc_render(void);
+
+#endif
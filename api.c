@@ -0,0 +1,265 @@
+#include "kfs.h"
+#include "kfs_api.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+
+struct KFS_FS {
+  KFS_Entry *root;
+  // shared for lookups, reads and writes to existing files, exclusive for
+  // everything that links or unlinks entries, as kfs_ns_lock in interface.c
+  pthread_rwlock_t lock;
+  // bumped under the exclusive lock whenever an entry may have been
+  // detached; a handle whose generation differs looks its path up again
+  _Atomic uint64_t generation;
+};
+
+struct KFS_Handle {
+  KFS_FS *fs;
+  sds path;
+  int flags;
+  // both only change under the shared lock, when every thread that
+  // re-resolves finds the same entry for the same generation
+  _Atomic(KFS_Entry *) entry;
+  _Atomic uint64_t generation;
+};
+
+// instances share the reclaimer, which runs while any of them exists
+static pthread_mutex_t instances_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t instances;
+
+KFS_FS *kfs_fs_new(void) {
+  KFS_FS *fs = xmalloc(sizeof(KFS_FS));
+  fs->root = new_KFS_Dir("/");
+  pthread_rwlock_init(&fs->lock, NULL);
+  atomic_init(&fs->generation, 0);
+
+  pthread_mutex_lock(&instances_lock);
+  if (instances++ == 0) {
+    kfs_reclaim_start();
+  }
+  pthread_mutex_unlock(&instances_lock);
+  return fs;
+}
+
+void kfs_fs_free(KFS_FS *fs) {
+  kfs_reclaim_enqueue(fs->root);
+  pthread_rwlock_destroy(&fs->lock);
+  xfree(&fs);
+
+  pthread_mutex_lock(&instances_lock);
+  if (--instances == 0) {
+    kfs_reclaim_stop();
+  }
+  pthread_mutex_unlock(&instances_lock);
+}
+
+int kfs_fs_stat(KFS_FS *fs, const char *path, struct stat *st) {
+  pthread_rwlock_rdlock(&fs->lock);
+  int res = kfs_path_stat(fs->root, path, st);
+  pthread_rwlock_unlock(&fs->lock);
+  return res;
+}
+
+int kfs_fs_readdir(KFS_FS *fs, const char *path, KFS_DirFiller filler,
+                   void *arg) {
+  pthread_rwlock_rdlock(&fs->lock);
+  int res = kfs_path_readdir(fs->root, path, filler, arg);
+  pthread_rwlock_unlock(&fs->lock);
+  return res;
+}
+
+int kfs_fs_mkdir(KFS_FS *fs, const char *path, mode_t mode) {
+  pthread_rwlock_wrlock(&fs->lock);
+  int res = kfs_path_mkdir(fs->root, path, mode);
+  pthread_rwlock_unlock(&fs->lock);
+  return res;
+}
+
+// the operations that detach entries
+#define DETACHING(fs, call)                                                    \
+  do {                                                                         \
+    pthread_rwlock_wrlock(&(fs)->lock);                                        \
+    res = (call);                                                              \
+    if (res == 0) {                                                            \
+      atomic_fetch_add(&(fs)->generation, 1);                                  \
+    }                                                                          \
+    pthread_rwlock_unlock(&(fs)->lock);                                        \
+  } while (0)
+
+int kfs_fs_rmdir(KFS_FS *fs, const char *path) {
+  int res;
+  DETACHING(fs, kfs_path_rmdir(fs->root, path));
+  return res;
+}
+
+int kfs_fs_unlink(KFS_FS *fs, const char *path) {
+  int res;
+  DETACHING(fs, kfs_path_unlink(fs->root, path));
+  return res;
+}
+
+int kfs_fs_rename(KFS_FS *fs, const char *from, const char *to) {
+  int res;
+  DETACHING(fs, kfs_path_rename(fs->root, from, to));
+  return res;
+}
+
+// what pread and pwrite reject: a negative offset or a range past the
+// largest offset
+static bool bad_range(size_t size, off_t offset) {
+  return offset < 0 || size > (size_t)(INT64_MAX - offset);
+}
+
+ssize_t kfs_fs_read(KFS_FS *fs, const char *path, void *buf, size_t size,
+                    off_t offset) {
+  if (bad_range(size, offset)) {
+    return -EINVAL;
+  }
+
+  pthread_rwlock_rdlock(&fs->lock);
+  ssize_t res = kfs_path_read(fs->root, path, buf, size, offset);
+  pthread_rwlock_unlock(&fs->lock);
+  return res;
+}
+
+// only creating the file needs the exclusive lock
+ssize_t kfs_fs_write(KFS_FS *fs, const char *path, const void *buf,
+                     size_t size, off_t offset) {
+  if (bad_range(size, offset)) {
+    return -EINVAL;
+  }
+
+  pthread_rwlock_rdlock(&fs->lock);
+  if (kfs_path_lookup(fs->root, path) == NULL) {
+    pthread_rwlock_unlock(&fs->lock);
+    pthread_rwlock_wrlock(&fs->lock);
+  }
+  ssize_t res = kfs_path_write(fs->root, path, buf, size, offset);
+  pthread_rwlock_unlock(&fs->lock);
+  return res;
+}
+
+static int access_mode(int flags) {
+  switch (flags & O_ACCMODE) {
+  case O_WRONLY:
+    return W_OK;
+  case O_RDWR:
+    return R_OK | W_OK;
+  default:
+    return R_OK;
+  }
+}
+
+int kfs_fs_open(KFS_FS *fs, const char *path, int flags, mode_t mode,
+                KFS_Handle **handle) {
+  bool writing = (flags & O_ACCMODE) != O_RDONLY;
+  if (flags & O_CREAT) {
+    pthread_rwlock_wrlock(&fs->lock);
+  } else {
+    pthread_rwlock_rdlock(&fs->lock);
+  }
+
+  int res = 0;
+  KFS_Entry *entry = kfs_path_lookup(fs->root, path);
+  if (entry == NULL) {
+    // a new file may be opened for writing whatever its mode
+    res = (flags & O_CREAT) ? kfs_path_create(fs->root, path, mode, &entry)
+                            : -ENOENT;
+  } else if ((flags & O_CREAT) && (flags & O_EXCL)) {
+    res = -EEXIST;
+  } else if (EntryIsDir(entry) && writing) {
+    res = -EISDIR;
+  } else {
+    res = kfs_path_access(fs->root, path, access_mode(flags));
+  }
+  if (res == 0 && (flags & O_TRUNC) && writing) {
+    res = kfs_path_truncate(fs->root, path, 0);
+  }
+
+  if (res == 0) {
+    KFS_Handle *h = xmalloc(sizeof(KFS_Handle));
+    h->fs = fs;
+    h->path = sdsnew(path);
+    h->flags = flags;
+    atomic_init(&h->entry, entry);
+    atomic_init(&h->generation, atomic_load(&fs->generation));
+    *handle = h;
+  }
+
+  pthread_rwlock_unlock(&fs->lock);
+  return res;
+}
+
+// the handle's entry, or NULL if its path is gone; callers hold the
+// shared lock, so the generation cannot move while they use the entry.
+// A missing path is looked up every time, since creating files does not
+// bump the generation
+static KFS_Entry *handle_entry(KFS_Handle *h) {
+  uint64_t generation = atomic_load(&h->fs->generation);
+  if (atomic_load(&h->generation) != generation ||
+      atomic_load(&h->entry) == NULL) {
+    atomic_store(&h->entry, kfs_path_lookup(h->fs->root, h->path));
+    atomic_store(&h->generation, generation);
+  }
+  return atomic_load(&h->entry);
+}
+
+ssize_t kfs_fs_pread(KFS_Handle *handle, void *buf, size_t size,
+                     off_t offset) {
+  if ((handle->flags & O_ACCMODE) == O_WRONLY) {
+    return -EBADF;
+  }
+  if (bad_range(size, offset)) {
+    return -EINVAL;
+  }
+
+  pthread_rwlock_rdlock(&handle->fs->lock);
+  KFS_Entry *entry = handle_entry(handle);
+  ssize_t res;
+  if (entry == NULL) {
+    res = -ENOENT;
+  } else if (EntryIsDir(entry)) {
+    res = -EISDIR;
+  } else {
+    res = kfs_read(entry, buf, size, offset);
+  }
+  pthread_rwlock_unlock(&handle->fs->lock);
+  return res;
+}
+
+ssize_t kfs_fs_pwrite(KFS_Handle *handle, const void *buf, size_t size,
+                      off_t offset) {
+  if ((handle->flags & O_ACCMODE) == O_RDONLY) {
+    return -EBADF;
+  }
+  if (bad_range(size, offset)) {
+    return -EINVAL;
+  }
+
+  pthread_rwlock_rdlock(&handle->fs->lock);
+  KFS_Entry *entry = handle_entry(handle);
+  ssize_t res =
+      entry == NULL ? -ENOENT : kfs_entry_write(entry, buf, size, offset);
+  pthread_rwlock_unlock(&handle->fs->lock);
+  return res;
+}
+
+int kfs_fs_fstat(KFS_Handle *handle, struct stat *st) {
+  pthread_rwlock_rdlock(&handle->fs->lock);
+  KFS_Entry *entry = handle_entry(handle);
+  if (entry != NULL) {
+    kfs_entry_stat(entry, st);
+  }
+  pthread_rwlock_unlock(&handle->fs->lock);
+  return entry == NULL ? -ENOENT : 0;
+}
+
+int kfs_fs_close(KFS_Handle *handle) {
+  sdsfree(handle->path);
+  xfree(&handle);
+  return 0;
+}
@@ -52,19 +52,16 @@ void free_AVLTree(AVLTree **t_ptr, ELEM_FREE free_key, ELEM_FREE free_val) {
 }
 
 static void *find_impl(AVLNode *t, void *key, ELEM_COMPARE compare) {
-  if (t == NULL) {
-    return NULL;
-  }
+  while (t != NULL) {
+    int comp_result = compare(key, t->key);
 
-  int comp_result = compare(key, t->key);
-
-  if (comp_result == 0) {
-    return t->value;
-  } else if (comp_result == -1) {
-    return find_impl(t->left, key, compare);
-  } else {
-    return find_impl(t->right, key, compare);
+    if (comp_result == 0) {
+      return t->value;
+    }
+    t = comp_result < 0 ? t->left : t->right;
   }
+
+  return NULL;
 }
 
 bool avl_exists(AVLTree *tree, void *key, ELEM_COMPARE compare) {
@@ -77,27 +74,25 @@ void *avl_find(AVLTree *tree, void *key, ELEM_COMPARE compare) {
 
 static int int_max(int a, int b) { return a > b ? a : b; }
 
-static AVLNode *rotate(AVLNode *t, int l, int r, ELEM_COMPARE compare);
+static AVLNode *rotate(AVLNode *t, int l, int r);
 
-static AVLNode *balance(AVLNode *t, ELEM_COMPARE compare) {
+static AVLNode *balance(AVLNode *t) {
   if (ht(t->right) - ht(t->left) < -1) {
     if (ht(t->left->right) - ht(t->left->left) > 0) {
-      t->left = rotate(t->left, L, R, compare);
+      t->left = rotate(t->left, L, R);
     }
-    return rotate(t, R, L, compare);
+    return rotate(t, R, L);
   }
 
   if (ht(t->left) - ht(t->right) < -1) {
     if (ht(t->right->left) - ht(t->right->right) > 0) {
-      t->right = rotate(t->right, R, L, compare);
+      t->right = rotate(t->right, R, L);
     }
-    return rotate(t, L, R, compare);
+    return rotate(t, L, R);
   }
 
-  if (t != NULL) {
-    t->height = int_max(ht(t->left), ht(t->right)) + 1;
-    t->size = sz(t->left) + sz(t->right) + 1;
-  }
+  t->height = int_max(ht(t->left), ht(t->right)) + 1;
+  t->size = sz(t->left) + sz(t->right) + 1;
   return t;
 }
 
@@ -124,42 +119,40 @@ static void set_child_by_LR(AVLNode *dst, int lr, AVLNode *src) {
   }
 }
 
-static AVLNode *rotate(AVLNode *t, int l, int r, ELEM_COMPARE compare) {
+static AVLNode *rotate(AVLNode *t, int l, int r) {
   AVLNode *s = get_child_by_LR(t, r);
   set_child_by_LR(t, r, get_child_by_LR(s, l));
-  set_child_by_LR(s, l, balance(t, compare));
-
-  if (t != NULL) {
-    t->size = sz(t->left) + sz(t->right) + 1;
-  }
-  if (s != NULL) {
-    s->size = sz(s->left) + sz(s->right) + 1;
-  }
+  set_child_by_LR(s, l, balance(t));
 
-  return balance(s, compare);
+  return balance(s);
 }
 
-static AVLNode *insert_impl(AVLNode *t, AVLNode *x, ELEM_COMPARE compare) {
-  if (t == NULL) {
-    return x;
+// rebalance every link on the path, deepest first
+static void rebalance_path(AVLNode ***path, size_t depth) {
+  while (depth > 0) {
+    AVLNode **link = path[--depth];
+    *link = balance(*link);
   }
+}
 
-  int comp_result = compare(x->key, t->key);
+void avl_insert(AVLTree *tree, void *key, void *value, ELEM_COMPARE compare) {
+  AVLNode **path[AVL_MAX_HEIGHT];
+  size_t depth = 0;
+  AVLNode **link = &tree->root;
 
-  if (comp_result == 0) {
-    t->value = x->value;
-  } else if (comp_result == -1) {
-    t->left = insert_impl(t->left, x, compare);
-  } else {
-    t->right = insert_impl(t->right, x, compare);
-  }
-  t->size += 1;
+  while (*link != NULL) {
+    int comp_result = compare(key, (*link)->key);
 
-  return balance(t, compare);
-}
+    if (comp_result == 0) {
+      (*link)->value = value;
+      return;
+    }
+    path[depth++] = link;
+    link = comp_result < 0 ? &(*link)->left : &(*link)->right;
+  }
 
-void avl_insert(AVLTree *tree, void *key, void *value, ELEM_COMPARE compare) {
-  tree->root = insert_impl(tree->root, new_AVLNode(key, value), compare);
+  *link = new_AVLNode(key, value);
+  rebalance_path(path, depth);
 }
 
 static sds string_rep(sds s, size_t n) {
@@ -172,37 +165,75 @@ static sds string_rep(sds s, size_t n) {
   return ret;
 }
 
-static AVLNode *move_down(AVLNode *t, AVLNode *rhs, ELEM_COMPARE compare) {
-  if (t == NULL) {
-    return rhs;
+void avl_delete(AVLTree *tree, void *key, ELEM_COMPARE compare) {
+  AVLNode **path[AVL_MAX_HEIGHT];
+  size_t depth = 0;
+  AVLNode **link = &tree->root;
+
+  while (*link != NULL) {
+    int comp_result = compare(key, (*link)->key);
+
+    if (comp_result == 0) {
+      break;
+    }
+    path[depth++] = link;
+    link = comp_result < 0 ? &(*link)->left : &(*link)->right;
   }
-  t->right = move_down(t->right, rhs, compare);
-  return balance(t, compare);
-}
 
-static AVLNode *delete_impl(AVLNode *t, void *key, ELEM_COMPARE compare) {
+  AVLNode *t = *link;
   if (t == NULL) {
-    return NULL;
+    return;
   }
 
-  int comp_result = compare(key, t->key);
-
-  if (comp_result == 0) {
-    return move_down(t->left, t->right, compare);
+  if (t->right == NULL) {
+    *link = t->left;
   } else {
-    if (comp_result == -1) {
-      t->left = delete_impl(t->left, key, compare);
-    } else {
-      t->right = delete_impl(t->right, key, compare);
+    // replace t with the leftmost node of its right subtree
+    size_t t_depth = depth;
+    path[depth++] = link;
+
+    AVLNode **min_link = &t->right;
+    while ((*min_link)->left != NULL) {
+      path[depth++] = min_link;
+      min_link = &(*min_link)->left;
     }
 
-    t->size -= 1;
-    return balance(t, compare);
+    AVLNode *min = *min_link;
+    *min_link = min->right;
+    min->left = t->left;
+    min->right = t->right;
+    *link = min;
+
+    // the slot below t now lives in min
+    if (depth > t_depth + 1) {
+      path[t_depth + 1] = &min->right;
+    }
   }
+
+  free(t);
+  rebalance_path(path, depth);
 }
 
-void avl_delete(AVLTree *tree, void *key, ELEM_COMPARE compare) {
-  tree->root = delete_impl(tree->root, key, compare);
+static AVLNode *build_sorted_impl(void **keys, void **values, size_t lo,
+                                  size_t hi) {
+  if (lo >= hi) {
+    return NULL;
+  }
+
+  size_t mid = lo + (hi - lo) / 2;
+  AVLNode *t = new_AVLNode(keys[mid], values[mid]);
+  t->left = build_sorted_impl(keys, values, lo, mid);
+  t->right = build_sorted_impl(keys, values, mid + 1, hi);
+  t->height = int_max(ht(t->left), ht(t->right)) + 1;
+  t->size = hi - lo;
+
+  return t;
+}
+
+AVLTree *avl_build_sorted(void **keys, void **values, size_t n) {
+  AVLTree *tree = new_AVLTree();
+  tree->root = build_sorted_impl(keys, values, 0, n);
+  return tree;
 }
 
 void print_node(AVLNode *node, size_t depth, ELEM_PRINTER key_printer,
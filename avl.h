@@ -35,6 +35,12 @@ void *avl_find(AVLTree *tree, void *key, ELEM_COMPARE compare);
 void avl_insert(AVLTree *tree, void *key, void *value, ELEM_COMPARE compare);
 void avl_delete(AVLTree *tree, void *key, ELEM_COMPARE compare);
 
+// keys must be strictly ascending by the tree's compare function
+AVLTree *avl_build_sorted(void **keys, void **values, size_t n);
+
+// enough for any AVL tree that fits in memory (height <= 1.44 log2(n + 2))
+#define AVL_MAX_HEIGHT 64
+
 #define sz(t) (t ? t->size : 0)
 #define ht(t) (t ? t->height : 0)
 
@@ -52,6 +58,7 @@ sds show_node(AVLNode *node, size_t depth, ELEM_PRINTER key_printer,
 sds show_tree(AVLTree *tree, ELEM_PRINTER key_printer,
               ELEM_PRINTER value_printer);
 
+// new vectors of the tree's own values and keys; free with free_vec
 Vector *avl_values(AVLTree *tree);
 Vector *avl_keys(AVLTree *tree);
 
@@ -0,0 +1,371 @@
+#ifndef __AVL_GEN_HEADER_INCLUDED__
+#define __AVL_GEN_HEADER_INCLUDED__
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+  GenAVLTree(Name, KeyT, ValT, hash_fn, cmp) generates an AVL tree
+  specialized for the given key and value types.  Unlike the generic tree in
+  avl.c, `hash_fn` and `cmp` are resolved at compile time and inlined into
+  the descent.
+    uint32_t hash_fn(KeyT key);
+    int cmp(KeyT lhs, KeyT rhs);  // <0, 0 or >0
+
+  Nodes live in a per-tree pool and refer to each other by 32-bit index
+  (0 is the nil sentinel), so a node is key + value + cached hash + links in
+  32 bytes for pointer-sized KeyT/ValT, with no per-node malloc header.
+  The tree is ordered by (hash, cmp): the descent compares cached hashes and
+  only calls `cmp` on a hash tie.  In-order traversal is therefore hash
+  order, not `cmp` order.
+
+  insert/delete/find are iterative; build makes a balanced tree in one pass.
+
+  GenAVLTreeWithAlloc takes the pool allocator as two more functions, which
+  receive the tree so they can find the memory it should come from:
+    void *realloc_fn(void *tree, void *ptr, size_t old_size, size_t size);
+    void free_fn(void *tree, void *ptr);
+
+  Generated API:
+    Name##Node, Name
+    void  Name##_init(Name *tree);
+    void  Name##_destroy(Name *tree);        // frees the pool, not keys/values
+    ValT *Name##_find(Name *tree, KeyT key); // NULL if not found
+    bool  Name##_exists(Name *tree, KeyT key);
+    void  Name##_insert(Name *tree, KeyT key, ValT value);
+    bool  Name##_delete(Name *tree, KeyT key); // false if not found
+    void  Name##_build(Name *tree, KeyT *keys, ValT *values, size_t n);
+    void  Name##_foreach(Name *tree, void (*f)(KeyT, ValT, void *), void *ctx);
+  build requires an empty tree and distinct keys.
+*/
+
+#define AVL_POOL_MIN_CAPACITY 8
+
+static inline void *avl_heap_realloc(void *tree, void *ptr, size_t old_size,
+                                     size_t size) {
+  (void)tree;
+  (void)old_size;
+  return xrealloc(ptr, size);
+}
+
+static inline void avl_heap_free(void *tree, void *ptr) {
+  (void)tree;
+  free(ptr);
+}
+
+#define GenAVLTree(Name, KeyT, ValT, hash_fn, cmp)                             \
+  GenAVLTreeWithAlloc(Name, KeyT, ValT, hash_fn, cmp, avl_heap_realloc,        \
+                      avl_heap_free)
+
+#define GenAVLTreeWithAlloc(Name, KeyT, ValT, hash_fn, cmp, realloc_fn,        \
+                            free_fn)                                           \
+  typedef struct {                                                             \
+    KeyT key;                                                                  \
+    ValT value;                                                                \
+    uint32_t hash;                                                             \
+    uint32_t left;                                                             \
+    uint32_t right;                                                            \
+    uint32_t height;                                                           \
+  } Name##Node;                                                                \
+                                                                               \
+  typedef struct {                                                             \
+    Name##Node *nodes; /* nodes[0] is the nil sentinel */                      \
+    uint32_t root;                                                             \
+    uint32_t len; /* pool slots handed out, including the sentinel */          \
+    uint32_t cap;                                                              \
+    uint32_t free_head; /* released slots, chained through left */             \
+    size_t size;                                                               \
+  } Name;                                                                      \
+                                                                               \
+  static inline void Name##_init(Name *tree) {                                 \
+    tree->nodes = NULL;                                                        \
+    tree->root = 0;                                                            \
+    tree->len = 0;                                                             \
+    tree->cap = 0;                                                             \
+    tree->free_head = 0;                                                       \
+    tree->size = 0;                                                            \
+  }                                                                            \
+                                                                               \
+  static inline void Name##_destroy(Name *tree) {                              \
+    if (tree->nodes != NULL) {                                                 \
+      free_fn(tree, tree->nodes);                                              \
+    }                                                                          \
+    Name##_init(tree);                                                         \
+  }                                                                            \
+                                                                               \
+  static inline void Name##_reserve(Name *tree, size_t n) {                    \
+    if (n <= tree->cap) {                                                      \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    size_t cap = tree->cap ? tree->cap : AVL_POOL_MIN_CAPACITY;                \
+    while (cap < n) {                                                          \
+      cap *= 2;                                                                \
+    }                                                                          \
+    if (cap > UINT32_MAX) {                                                    \
+      fprintf(stderr, "[" #Name "] too many nodes\n");                         \
+      exit(EXIT_FAILURE);                                                      \
+    }                                                                          \
+                                                                               \
+    tree->nodes = realloc_fn(tree, tree->nodes,                                \
+                             sizeof(Name##Node) * tree->cap,                   \
+                             sizeof(Name##Node) * cap);                        \
+    tree->cap = (uint32_t)cap;                                                 \
+                                                                               \
+    if (tree->len == 0) {                                                      \
+      Name##Node *nil = &tree->nodes[0];                                       \
+      nil->hash = 0;                                                           \
+      nil->left = 0;                                                           \
+      nil->right = 0;                                                          \
+      nil->height = 0;                                                         \
+      tree->len = 1;                                                           \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline uint32_t Name##_alloc_node(Name *tree) {                       \
+    uint32_t i = tree->free_head;                                              \
+                                                                               \
+    if (i != 0) {                                                              \
+      tree->free_head = tree->nodes[i].left;                                   \
+    } else {                                                                   \
+      i = tree->len++;                                                         \
+    }                                                                          \
+                                                                               \
+    return i;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline int Name##_order(uint32_t h, KeyT key, Name##Node *t) {        \
+    if (h != t->hash) {                                                        \
+      return h < t->hash ? -1 : 1;                                             \
+    }                                                                          \
+    return cmp(key, t->key);                                                   \
+  }                                                                            \
+                                                                               \
+  static inline uint32_t Name##_update(Name##Node *nodes, uint32_t t) {        \
+    uint32_t lh = nodes[nodes[t].left].height;                                 \
+    uint32_t rh = nodes[nodes[t].right].height;                                \
+    nodes[t].height = (lh > rh ? lh : rh) + 1;                                 \
+    return t;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline uint32_t Name##_rotate_left(Name##Node *nodes, uint32_t t) {   \
+    uint32_t s = nodes[t].right;                                               \
+    nodes[t].right = nodes[s].left;                                            \
+    nodes[s].left = Name##_update(nodes, t);                                   \
+    return Name##_update(nodes, s);                                            \
+  }                                                                            \
+                                                                               \
+  static inline uint32_t Name##_rotate_right(Name##Node *nodes, uint32_t t) {  \
+    uint32_t s = nodes[t].left;                                                \
+    nodes[t].left = nodes[s].right;                                            \
+    nodes[s].right = Name##_update(nodes, t);                                  \
+    return Name##_update(nodes, s);                                            \
+  }                                                                            \
+                                                                               \
+  static inline uint32_t Name##_balance(Name##Node *nodes, uint32_t t) {       \
+    Name##Node *n = &nodes[t];                                                 \
+    int diff = (int)nodes[n->right].height - (int)nodes[n->left].height;       \
+                                                                               \
+    if (diff < -1) {                                                           \
+      Name##Node *l = &nodes[n->left];                                         \
+      if (nodes[l->right].height > nodes[l->left].height) {                    \
+        n->left = Name##_rotate_left(nodes, n->left);                          \
+      }                                                                        \
+      return Name##_rotate_right(nodes, t);                                    \
+    }                                                                          \
+                                                                               \
+    if (diff > 1) {                                                            \
+      Name##Node *r = &nodes[n->right];                                        \
+      if (nodes[r->left].height > nodes[r->right].height) {                    \
+        n->right = Name##_rotate_right(nodes, n->right);                       \
+      }                                                                        \
+      return Name##_rotate_left(nodes, t);                                     \
+    }                                                                          \
+                                                                               \
+    return Name##_update(nodes, t);                                            \
+  }                                                                            \
+                                                                               \
+  static inline void Name##_rebalance_path(Name##Node *nodes, uint32_t **path, \
+                                           size_t depth) {                     \
+    while (depth > 0) {                                                        \
+      uint32_t *link = path[--depth];                                          \
+      *link = Name##_balance(nodes, *link);                                    \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline ValT *Name##_find(Name *tree, KeyT key) {                      \
+    uint32_t h = hash_fn(key);                                                 \
+    uint32_t t = tree->root;                                                   \
+                                                                               \
+    while (t != 0) {                                                           \
+      Name##Node *n = &tree->nodes[t];                                         \
+      int comp_result = Name##_order(h, key, n);                               \
+      if (comp_result == 0) {                                                  \
+        return &n->value;                                                      \
+      }                                                                        \
+      t = comp_result < 0 ? n->left : n->right;                                \
+    }                                                                          \
+                                                                               \
+    return NULL;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline bool Name##_exists(Name *tree, KeyT key) {                     \
+    return Name##_find(tree, key) != NULL;                                     \
+  }                                                                            \
+                                                                               \
+  static inline void Name##_insert(Name *tree, KeyT key, ValT value) {         \
+    /* grow before descending so the recorded links stay valid */              \
+    if (tree->free_head == 0) {                                                \
+      Name##_reserve(tree, (size_t)tree->len + 1);                             \
+    }                                                                          \
+                                                                               \
+    Name##Node *nodes = tree->nodes;                                           \
+    uint32_t h = hash_fn(key);                                                 \
+    uint32_t *path[AVL_MAX_HEIGHT];                                            \
+    size_t depth = 0;                                                          \
+    uint32_t *link = &tree->root;                                              \
+                                                                               \
+    while (*link != 0) {                                                       \
+      Name##Node *n = &nodes[*link];                                           \
+      int comp_result = Name##_order(h, key, n);                               \
+      if (comp_result == 0) {                                                  \
+        n->value = value;                                                      \
+        return;                                                                \
+      }                                                                        \
+      path[depth++] = link;                                                    \
+      link = comp_result < 0 ? &n->left : &n->right;                           \
+    }                                                                          \
+                                                                               \
+    uint32_t i = Name##_alloc_node(tree);                                      \
+    nodes[i].key = key;                                                        \
+    nodes[i].value = value;                                                    \
+    nodes[i].hash = h;                                                         \
+    nodes[i].left = 0;                                                         \
+    nodes[i].right = 0;                                                        \
+    nodes[i].height = 1;                                                       \
+    *link = i;                                                                 \
+    tree->size++;                                                              \
+                                                                               \
+    Name##_rebalance_path(nodes, path, depth);                                 \
+  }                                                                            \
+                                                                               \
+  static inline bool Name##_delete(Name *tree, KeyT key) {                     \
+    Name##Node *nodes = tree->nodes;                                           \
+    uint32_t h = hash_fn(key);                                                 \
+    uint32_t *path[AVL_MAX_HEIGHT];                                            \
+    size_t depth = 0;                                                          \
+    uint32_t *link = &tree->root;                                              \
+                                                                               \
+    while (*link != 0) {                                                       \
+      Name##Node *n = &nodes[*link];                                           \
+      int comp_result = Name##_order(h, key, n);                               \
+      if (comp_result == 0) {                                                  \
+        break;                                                                 \
+      }                                                                        \
+      path[depth++] = link;                                                    \
+      link = comp_result < 0 ? &n->left : &n->right;                           \
+    }                                                                          \
+                                                                               \
+    uint32_t t = *link;                                                        \
+    if (t == 0) {                                                              \
+      return false;                                                            \
+    }                                                                          \
+                                                                               \
+    if (nodes[t].right == 0) {                                                 \
+      *link = nodes[t].left;                                                   \
+    } else {                                                                   \
+      /* replace t with the leftmost node of its right subtree */              \
+      size_t t_depth = depth;                                                  \
+      path[depth++] = link;                                                    \
+                                                                               \
+      uint32_t *min_link = &nodes[t].right;                                    \
+      while (nodes[*min_link].left != 0) {                                     \
+        path[depth++] = min_link;                                              \
+        min_link = &nodes[*min_link].left;                                     \
+      }                                                                        \
+                                                                               \
+      uint32_t min = *min_link;                                                \
+      *min_link = nodes[min].right;                                            \
+      nodes[min].left = nodes[t].left;                                         \
+      nodes[min].right = nodes[t].right;                                       \
+      *link = min;                                                             \
+                                                                               \
+      /* the slot below t now lives in min */                                  \
+      if (depth > t_depth + 1) {                                               \
+        path[t_depth + 1] = &nodes[min].right;                                 \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    nodes[t].left = tree->free_head;                                           \
+    tree->free_head = t;                                                       \
+    tree->size--;                                                              \
+                                                                               \
+    Name##_rebalance_path(nodes, path, depth);                                 \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline int Name##_node_cmp(const void *lhs, const void *rhs) {        \
+    const Name##Node *l = lhs;                                                 \
+    const Name##Node *r = rhs;                                                 \
+    if (l->hash != r->hash) {                                                  \
+      return l->hash < r->hash ? -1 : 1;                                       \
+    }                                                                          \
+    return cmp(l->key, r->key);                                                \
+  }                                                                            \
+                                                                               \
+  static inline uint32_t Name##_link_sorted(Name##Node *nodes, uint32_t lo,    \
+                                            uint32_t hi) {                     \
+    if (lo >= hi) {                                                            \
+      return 0;                                                                \
+    }                                                                          \
+                                                                               \
+    uint32_t mid = lo + (hi - lo) / 2;                                         \
+    nodes[mid].left = Name##_link_sorted(nodes, lo, mid);                      \
+    nodes[mid].right = Name##_link_sorted(nodes, mid + 1, hi);                 \
+    return Name##_update(nodes, mid);                                          \
+  }                                                                            \
+                                                                               \
+  static inline void Name##_build(Name *tree, KeyT *keys, ValT *values,        \
+                                  size_t n) {                                  \
+    assert(tree->size == 0);                                                   \
+    if (n == 0) {                                                              \
+      return;                                                                  \
+    }                                                                          \
+                                                                               \
+    /* lay the nodes out contiguously, sort them, then link them up */         \
+    Name##_destroy(tree);                                                      \
+    Name##_reserve(tree, n + 1);                                               \
+    for (size_t i = 0; i < n; i++) {                                           \
+      Name##Node *node = &tree->nodes[i + 1];                                  \
+      node->key = keys[i];                                                     \
+      node->value = values[i];                                                 \
+      node->hash = hash_fn(keys[i]);                                           \
+    }                                                                          \
+    qsort(tree->nodes + 1, n, sizeof(Name##Node), Name##_node_cmp);            \
+                                                                               \
+    tree->len = (uint32_t)(n + 1);                                             \
+    tree->root = Name##_link_sorted(tree->nodes, 1, tree->len);                \
+    tree->size = n;                                                            \
+  }                                                                            \
+                                                                               \
+  static inline void Name##_foreach_node(Name *tree, uint32_t t,               \
+                                         void (*f)(KeyT, ValT, void *),        \
+                                         void *ctx) {                          \
+    if (t != 0) {                                                              \
+      Name##Node *n = &tree->nodes[t];                                         \
+      Name##_foreach_node(tree, n->left, f, ctx);                              \
+      f(n->key, n->value, ctx);                                                \
+      Name##_foreach_node(tree, tree->nodes[t].right, f, ctx);                 \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline void Name##_foreach(Name *tree, void (*f)(KeyT, ValT, void *), \
+                                    void *ctx) {                               \
+    Name##_foreach_node(tree, tree->root, f, ctx);                             \
+  }
+
+#endif
@@ -0,0 +1,74 @@
+#include "bench.h"
+#include "kfs.h"
+#include "kfs_api.h"
+#include <fcntl.h>
+#include <stdio.h>
+
+#define CALLS 2000000
+#define READ_BYTES 4096
+
+static double stat_ns(KFS_FS *fs) {
+  struct stat st;
+  double start = now_ns();
+  for (int i = 0; i < CALLS; i++) {
+    kfs_fs_stat(fs, "/d/f", &st);
+  }
+  return (now_ns() - start) / CALLS;
+}
+
+static double pread_ns(KFS_Handle *h) {
+  char buf[READ_BYTES];
+  double start = now_ns();
+  for (int i = 0; i < CALLS; i++) {
+    kfs_fs_pread(h, buf, sizeof(buf), 0);
+  }
+  return (now_ns() - start) / CALLS;
+}
+
+// the same calls through the daemon's FUSE callbacks, without the kernel
+static double getattr_ns(void) {
+  struct stat st;
+  double start = now_ns();
+  for (int i = 0; i < CALLS; i++) {
+    kfs_ops.getattr("/d/f", &st);
+  }
+  return (now_ns() - start) / CALLS;
+}
+
+static double read_ns(void) {
+  struct fuse_file_info fi;
+  memset(&fi, 0, sizeof(fi));
+  fi.flags = O_RDONLY;
+  char buf[READ_BYTES];
+
+  kfs_ops.open("/d/f", &fi);
+  double start = now_ns();
+  for (int i = 0; i < CALLS; i++) {
+    kfs_ops.read("/d/f", buf, sizeof(buf), 0, &fi);
+  }
+  double ns = (now_ns() - start) / CALLS;
+  kfs_ops.release("/d/f", &fi);
+  return ns;
+}
+
+void api_bench(void) {
+  char data[READ_BYTES];
+  memset(data, 'a', sizeof(data));
+
+  KFS_FS *fs = kfs_fs_new();
+  KFS_Handle *h;
+  kfs_fs_mkdir(fs, "/d", 0755);
+  kfs_fs_open(fs, "/d/f", O_RDWR | O_CREAT, 0644, &h);
+  kfs_fs_pwrite(h, data, sizeof(data), 0);
+  bench_result(stat_ns(fs), "ns/op", "api/stat");
+  bench_result(pread_ns(h), "ns/op", "api/pread/4k");
+  kfs_fs_close(h);
+  kfs_fs_free(fs);
+
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  itf_fuse_kfs_mkdir("/d", 0755);
+  itf_fuse_kfs_create("/d/f", 0644, NULL);
+  itf_fuse_kfs_write("/d/f", data, sizeof(data), 0, NULL);
+  bench_result(getattr_ns(), "ns/op", "api/fuse_callbacks/getattr");
+  bench_result(read_ns(), "ns/op", "api/fuse_callbacks/read/4k");
+}
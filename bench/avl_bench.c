@@ -0,0 +1,128 @@
+#include "bench.h"
+#include "kfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// key distributions: the order keys arrive in and how alike they are
+static const char *dists[] = {"random", "sequential", "prefixed"};
+
+static sds *make_keys(size_t n, const char *dist) {
+  sds *keys = xmalloc(sizeof(sds) * n);
+  bool prefixed = strcmp(dist, "prefixed") == 0;
+
+  for (size_t i = 0; i < n; i++) {
+    // prefixed keys share a long head, as generated names often do
+    keys[i] = sdscatprintf(sdsempty(), "%sfile%08zu",
+                           prefixed ? "checkpoint-2024-01-01T00-00-" : "", i);
+  }
+  if (strcmp(dist, "sequential") == 0) {
+    return keys;
+  }
+
+  // shuffle so that inserts do not arrive in order
+  srand(42);
+  for (size_t i = n - 1; i > 0; i--) {
+    size_t j = (size_t)rand() % (i + 1);
+    sds t = keys[i];
+    keys[i] = keys[j];
+    keys[j] = t;
+  }
+
+  return keys;
+}
+
+static const char *dist;
+
+static void report(const char *impl, const char *op, size_t n, double ns) {
+  bench_result(ns / n, "ns/op", "avl/%s/%s/%s/n=%zu", impl, op, dist, n);
+}
+
+static void bench_generic(sds *keys, size_t n) {
+  AVLTree *tree = new_AVLTree();
+  double t;
+
+  t = now_ns();
+  for (size_t i = 0; i < n; i++) {
+    avl_insert(tree, keys[i], keys[i], path_cmp);
+  }
+  report("generic", "insert", n, now_ns() - t);
+
+  t = now_ns();
+  for (size_t i = 0; i < n; i++) {
+    if (avl_find(tree, keys[i], path_cmp) == NULL) {
+      abort();
+    }
+  }
+  report("generic", "find", n, now_ns() - t);
+
+  t = now_ns();
+  for (size_t i = 0; i < n; i++) {
+    avl_delete(tree, keys[i], path_cmp);
+  }
+  report("generic", "delete", n, now_ns() - t);
+}
+
+// the index allocates through the directory that embeds it
+static void bench_gen(sds *keys, size_t n) {
+  KFS_Entry *dir = new_KFS_Dir(sdsnew("d"));
+  KFS_DirIndex *tree = GetAVLTree(dir);
+  double t;
+
+  t = now_ns();
+  for (size_t i = 0; i < n; i++) {
+    KFS_DirIndex_insert(tree, keys[i], NULL);
+  }
+  report("gen", "insert", n, now_ns() - t);
+
+  t = now_ns();
+  for (size_t i = 0; i < n; i++) {
+    if (KFS_DirIndex_find(tree, keys[i]) == NULL) {
+      abort();
+    }
+  }
+  report("gen", "find", n, now_ns() - t);
+
+  t = now_ns();
+  for (size_t i = 0; i < n; i++) {
+    KFS_DirIndex_delete(tree, keys[i]);
+  }
+  report("gen", "delete", n, now_ns() - t);
+
+  free_KFS_Entry(dir);
+}
+
+static void bench_build(sds *keys, size_t n) {
+  KFS_Entry **values = xmalloc(sizeof(KFS_Entry *) * n);
+  memset(values, 0, sizeof(KFS_Entry *) * n);
+
+  KFS_Entry *dir = new_KFS_Dir(sdsnew("d"));
+
+  double t = now_ns();
+  KFS_DirIndex_build(GetAVLTree(dir), keys, values, n);
+  report("gen", "build", n, now_ns() - t);
+
+  free_KFS_Entry(dir);
+  free(values);
+}
+
+void avl_bench(void) {
+  size_t sizes[] = {1000, 10000, 100000, 1000000};
+
+  printf("[bench] node size: generic %zu bytes, gen %zu bytes\n",
+         sizeof(AVLNode), sizeof(KFS_DirIndexNode));
+
+  for (size_t d = 0; d < sizeof(dists) / sizeof(dists[0]); d++) {
+    dist = dists[d];
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+      sds *keys = make_keys(sizes[i], dist);
+      bench_generic(keys, sizes[i]);
+      bench_gen(keys, sizes[i]);
+      bench_build(keys, sizes[i]);
+      for (size_t j = 0; j < sizes[i]; j++) {
+        sdsfree(keys[j]);
+      }
+      free(keys);
+    }
+  }
+}
@@ -0,0 +1,220 @@
+#include "bench.h"
+#include "kfs.h"
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef void (*BENCH_FUNC)(void);
+
+typedef struct {
+  char *bench_name;
+  BENCH_FUNC bench_func;
+} BENCH;
+
+#define BENCH_ENTRY(BENCH_NAME)                                                \
+  { .bench_name = #BENCH_NAME, .bench_func = BENCH_NAME##_bench }
+
+BENCH benches[] = {BENCH_ENTRY(avl),  BENCH_ENTRY(entry), BENCH_ENTRY(dir),
+                   BENCH_ENTRY(file), BENCH_ENTRY(util),  BENCH_ENTRY(trace),
+                   BENCH_ENTRY(api),  BENCH_ENTRY(shm)};
+
+#define ARRAY_LEN(arr) (sizeof(arr) / sizeof(arr[0]))
+
+#define RESULT_NAME_MAX 128
+#define RESULT_UNIT_MAX 16
+
+typedef struct {
+  char name[RESULT_NAME_MAX];
+  char unit[RESULT_UNIT_MAX];
+  double value;
+} Result;
+
+typedef struct {
+  Result *data;
+  size_t len;
+  size_t cap;
+} Results;
+
+static Results results;
+
+static Result *add_result(Results *rs) {
+  if (rs->len == rs->cap) {
+    rs->cap = rs->cap == 0 ? 64 : rs->cap * 2;
+    rs->data = xrealloc(rs->data, sizeof(Result) * rs->cap);
+  }
+  Result *r = &rs->data[rs->len++];
+  memset(r, 0, sizeof(*r));
+  return r;
+}
+
+static bool higher_is_better(const char *unit) {
+  size_t len = strlen(unit);
+  return len >= 2 && strcmp(unit + len - 2, "/s") == 0;
+}
+
+void bench_result(double value, const char *unit, const char *name, ...) {
+  char buf[RESULT_NAME_MAX];
+  va_list ap;
+  va_start(ap, name);
+  vsnprintf(buf, sizeof(buf), name, ap);
+  va_end(ap);
+  printf("[bench] %-48s %12.2f %s\n", buf, value, unit);
+
+  // with --repeat, a name keeps its best value
+  for (size_t i = 0; i < results.len; i++) {
+    Result *r = &results.data[i];
+    if (strcmp(r->name, buf) == 0) {
+      if (higher_is_better(unit) ? value > r->value : value < r->value) {
+        r->value = value;
+      }
+      return;
+    }
+  }
+
+  Result *r = add_result(&results);
+  memcpy(r->name, buf, sizeof(buf));
+  snprintf(r->unit, sizeof(r->unit), "%s", unit);
+  r->value = value;
+}
+
+// one result per line, so a baseline can be read back with sscanf
+static int write_json(const char *file) {
+  FILE *fp = fopen(file, "w");
+  if (fp == NULL) {
+    perror(file);
+    return -1;
+  }
+  fprintf(fp, "[\n");
+  for (size_t i = 0; i < results.len; i++) {
+    Result *r = &results.data[i];
+    fprintf(fp, "  {\"name\": \"%s\", \"value\": %.4f, \"unit\": \"%s\"}%s\n",
+            r->name, r->value, r->unit, i + 1 < results.len ? "," : "");
+  }
+  fprintf(fp, "]\n");
+  return fclose(fp);
+}
+
+static int read_json(const char *file, Results *rs) {
+  FILE *fp = fopen(file, "r");
+  if (fp == NULL) {
+    perror(file);
+    return -1;
+  }
+  char line[512];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    Result r;
+    if (sscanf(line, " {\"name\": \"%127[^\"]\", \"value\": %lf, "
+                     "\"unit\": \"%15[^\"]\"}",
+               r.name, &r.value, r.unit) == 3) {
+      *add_result(rs) = r;
+    }
+  }
+  fclose(fp);
+  return 0;
+}
+
+// prints each result against its baseline; the number of regressions
+static int compare(Results *base, double threshold) {
+  int regressions = 0;
+  printf("[compare] %-48s %12s %12s %8s\n", "name", "baseline", "now",
+         "change");
+
+  for (size_t i = 0; i < results.len; i++) {
+    Result *now = &results.data[i];
+    Result *old = NULL;
+    for (size_t j = 0; j < base->len && old == NULL; j++) {
+      if (strcmp(base->data[j].name, now->name) == 0 &&
+          strcmp(base->data[j].unit, now->unit) == 0) {
+        old = &base->data[j];
+      }
+    }
+    if (old == NULL || old->value == 0) {
+      printf("[compare] %-48s %12s %12.2f %8s\n", now->name, "-", now->value,
+             "new");
+      continue;
+    }
+
+    double change = (now->value - old->value) / old->value * 100;
+    double gain = higher_is_better(now->unit) ? change : -change;
+    const char *verdict = gain < -threshold  ? " worse"
+                          : gain > threshold ? " better"
+                                             : "";
+    regressions += gain < -threshold;
+    printf("[compare] %-48s %12.2f %12.2f %+7.1f%%%s\n", now->name,
+           old->value, now->value, change, verdict);
+  }
+
+  printf("[compare] %d of %zu results regressed by more than %.1f%%\n",
+         regressions, results.len, threshold);
+  return regressions;
+}
+
+// no names selects every bench
+static bool selected(const char *bench, const char *names[], int n) {
+  for (int i = 0; i < n; i++) {
+    if (strcmp(names[i], bench) == 0) {
+      return true;
+    }
+  }
+  return n == 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--json FILE] [--compare BASELINE] [--threshold PCT] "
+          "[--repeat N] [BENCH...]\n",
+          prog);
+}
+
+int main(int argc, const char *argv[]) {
+  const char *json = NULL;
+  const char *baseline = NULL;
+  double threshold = 5;
+  int repeat = 1;
+  int first = 1;
+
+  for (; first < argc && strncmp(argv[first], "--", 2) == 0; first += 2) {
+    if (first + 1 >= argc) {
+      usage(argv[0]);
+      return 2;
+    }
+    if (strcmp(argv[first], "--json") == 0) {
+      json = argv[first + 1];
+    } else if (strcmp(argv[first], "--compare") == 0) {
+      baseline = argv[first + 1];
+    } else if (strcmp(argv[first], "--threshold") == 0) {
+      threshold = atof(argv[first + 1]);
+    } else if (strcmp(argv[first], "--repeat") == 0) {
+      repeat = atoi(argv[first + 1]);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  // read first, so --json can overwrite the baseline it is compared to
+  Results base = {0};
+  if (baseline != NULL && read_json(baseline, &base) == -1) {
+    return 2;
+  }
+
+  for (int r = 0; r < repeat; r++) {
+    for (size_t j = 0; j < ARRAY_LEN(benches); j++) {
+      if (!selected(benches[j].bench_name, argv + first, argc - first)) {
+        continue;
+      }
+      printf("[bench] <RUN - %s>\n", benches[j].bench_name);
+      benches[j].bench_func();
+    }
+  }
+
+  if (json != NULL && write_json(json) != 0) {
+    return 2;
+  }
+  if (baseline != NULL && compare(&base, threshold) > 0) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef __BENCH_HEADER_INCLUDED__
+#define __BENCH_HEADER_INCLUDED__
+#include <time.h>
+
+static inline double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+  Records one measurement under a unique, stable name (printf-style, e.g.
+  "avl/gen/find/random/n=%zu") and prints it.  Results are what --json
+  saves and --compare checks against a baseline; units ending in "/s" are
+  throughputs (higher is better), anything else is a cost like "ns/op".
+*/
+void bench_result(double value, const char *unit, const char *name, ...)
+    __attribute__((format(printf, 3, 4)));
+
+void avl_bench(void);
+void entry_bench(void);
+void dir_bench(void);
+void file_bench(void);
+void util_bench(void);
+void trace_bench(void);
+void api_bench(void);
+void shm_bench(void);
+
+#endif
@@ -0,0 +1,34 @@
+#include "bench.h"
+#include "kfs.h"
+#include <stdio.h>
+
+#define LIST_ENTRIES 1000000 // listed per size, across repetitions
+
+// what readdir pays per entry of a large directory
+static void bench_list(size_t n) {
+  KFS_Entry *dir = new_KFS_Dir(sdsnew("d"));
+  for (size_t i = 0; i < n; i++) {
+    sds name = sdscatprintf(sdsempty(), "file%08zu", i);
+    kfs_append_child(dir, new_KFS_File(name));
+    sdsfree(name);
+  }
+
+  size_t reps = LIST_ENTRIES / n;
+  double t = now_ns();
+  for (size_t i = 0; i < reps; i++) {
+    kfs_freeCurrentList(kfs_getCurrentList(dir));
+  }
+  bench_result((now_ns() - t) / (reps * n), "ns/entry",
+               "kfs_getCurrentList/n=%zu", n);
+
+  kfs_reclaim_enqueue(dir);
+  kfs_reclaim_drain();
+}
+
+void dir_bench(void) {
+  size_t sizes[] = {1000, 10000, 100000};
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    bench_list(sizes[i]);
+  }
+}
@@ -0,0 +1,137 @@
+#include "bench.h"
+#include "kfs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOOKUPS 200000
+
+// tree shapes for kfs_find, from wide and shallow to narrow and deep; the
+// walks use the 6 x 10 one
+static const struct {
+  int depth;
+  int fanout;
+} shapes[] = {{2, 300}, {4, 16}, {6, 10}, {12, 3}};
+
+#define WALK_SHAPE 2
+
+static size_t build(KFS_Entry *dir, int depth, int max_depth, int fanout,
+                    Vector *leaves, sds prefix) {
+  size_t n = 0;
+
+  for (int i = 0; i < fanout; i++) {
+    sds name = sdscatprintf(sdsempty(), "e%d", i);
+    sds path = sdscatprintf(sdsempty(), "%s/%s", prefix, name);
+    KFS_Entry *child =
+        depth + 1 < max_depth ? new_KFS_Dir(name) : new_KFS_File(name);
+    kfs_append_child(dir, child);
+    n++;
+
+    if (EntryIsDir(child)) {
+      n += build(child, depth + 1, max_depth, fanout, leaves, path);
+      sdsfree(path);
+    } else {
+      vec_push(leaves, path);
+    }
+    sdsfree(name);
+  }
+
+  return n;
+}
+
+typedef struct {
+  Vector *stack;
+  size_t visited;
+  long long checksum;
+} WalkState;
+
+static void visit(sds name __attribute__((unused)), KFS_Entry *entry,
+                  void *ctx) {
+  WalkState *st = ctx;
+  // what getattr reads
+  st->checksum += entry->mode + entry->size + entry->nlink + entry->uid;
+  st->visited++;
+  if (EntryIsDir(entry)) {
+    vec_push(st->stack, entry);
+  }
+}
+
+static bool count_visit(KFS_WalkEntry *we, void *ctx) {
+  ((size_t *)ctx)[we->worker * 8]++;
+  return true;
+}
+
+static void bench_parallel_walk(KFS_Entry *root, int threads) {
+  size_t *counts = xmalloc(sizeof(size_t) * 8 * threads);
+  memset(counts, 0, sizeof(size_t) * 8 * threads);
+
+  double t = now_ns();
+  kfs_walk(root, "/", threads, 0, count_visit, counts);
+  double elapsed = now_ns() - t;
+
+  size_t visited = 0;
+  for (int i = 0; i < threads; i++) {
+    visited += counts[i * 8];
+  }
+  bench_result(visited / elapsed * 1e3, "M entries/s", "kfs_walk/threads=%d",
+               threads);
+  free(counts);
+}
+
+static void bench_walks(KFS_Entry *root) {
+  WalkState st = {.stack = new_vec(), .visited = 0, .checksum = 0};
+  double t = now_ns();
+  vec_push(st.stack, root);
+  while (st.stack->len > 0) {
+    KFS_Entry *dir = vec_pop(st.stack);
+    KFS_DirIndex_foreach(GetAVLTree(dir), visit, &st);
+  }
+  double elapsed = now_ns() - t;
+  printf("[bench] walk checksum %lld\n", st.checksum);
+  bench_result(st.visited / elapsed * 1e3, "M entries/s", "walk/n=%zu",
+               st.visited);
+
+  for (int threads = 1; threads <= kfs_walk_default_threads(); threads *= 2) {
+    bench_parallel_walk(root, threads);
+  }
+}
+
+static void bench_find(KFS_Entry *root, Vector *leaves, int depth,
+                       int fanout) {
+  srand(42);
+  double t = now_ns();
+  for (size_t i = 0; i < LOOKUPS; i++) {
+    sds path = leaves->data[(size_t)rand() % leaves->len];
+    if (kfs_find(root, path) == NULL) {
+      abort();
+    }
+  }
+  bench_result((now_ns() - t) / LOOKUPS, "ns/op",
+               "kfs_find/depth=%d/fanout=%d", depth, fanout);
+}
+
+void entry_bench(void) {
+  printf("[bench] entry size %zu bytes (hot part %zu bytes)\n",
+         sizeof(KFS_Entry), offsetof(KFS_Entry, name));
+
+  for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+    KFS_Entry *root = new_KFS_Dir(sdsnew("/"));
+    Vector *leaves = new_vec();
+    sds prefix = sdsempty();
+    size_t n =
+        build(root, 0, shapes[i].depth, shapes[i].fanout, leaves, prefix);
+    sdsfree(prefix);
+    printf("[bench] tree depth=%d fanout=%d: %zu entries\n", shapes[i].depth,
+           shapes[i].fanout, n);
+
+    if (i == WALK_SHAPE) {
+      bench_walks(root);
+    }
+    bench_find(root, leaves, shapes[i].depth, shapes[i].fanout);
+
+    VecForeach(leaves, path, { sdsfree(path); });
+    free_vec(leaves);
+    kfs_reclaim_enqueue(root);
+    kfs_reclaim_drain();
+  }
+}
@@ -0,0 +1,118 @@
+#include "bench.h"
+#include "kfs.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILE_BYTES (256L * 1024 * 1024)
+#define WRITE_BYTES (128 * 1024)
+#define PATTERN_BYTES (64L * 1024 * 1024)
+
+typedef struct {
+  KFS_Entry *file;
+  off_t start;
+  off_t end;
+} Part;
+
+// a downloader: one contiguous part of the file, written front to back
+static void *write_part(void *arg) {
+  Part *part = arg;
+  char *buf = xmalloc(WRITE_BYTES);
+  memset(buf, 0x5a, WRITE_BYTES);
+
+  for (off_t off = part->start; off < part->end; off += WRITE_BYTES) {
+    kfs_write(part->file, buf, WRITE_BYTES, off);
+  }
+
+  free(buf);
+  return NULL;
+}
+
+static double bench_writers(int writers) {
+  KFS_Entry *dir = new_KFS_Dir(sdsnew("d"));
+  KFS_Entry *file = new_KFS_File(sdsnew("f"));
+  kfs_append_child(dir, file);
+
+  pthread_t *threads = xmalloc(sizeof(pthread_t) * writers);
+  Part *parts = xmalloc(sizeof(Part) * writers);
+  off_t per = FILE_BYTES / writers;
+
+  double t = now_ns();
+  for (int i = 0; i < writers; i++) {
+    parts[i] = (Part){file, per * i, per * (i + 1)};
+    pthread_create(&threads[i], NULL, write_part, &parts[i]);
+  }
+  for (int i = 0; i < writers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  t = now_ns() - t;
+
+  kfs_remove_child(dir, file->name);
+  free_KFS_Entry(file);
+  free_KFS_Entry(dir);
+  free(threads);
+  free(parts);
+
+  return FILE_BYTES / (t / 1e9) / (1024 * 1024);
+}
+
+static const char *patterns[] = {"append", "random", "overwrite"};
+
+// one writer, PATTERN_BYTES in io-sized writes; overwrite rewrites a file
+// that already has its data, random fills a new one in shuffled order
+static void bench_pattern(const char *pattern, size_t io) {
+  KFS_Entry *file = new_KFS_File(sdsnew("f"));
+  size_t writes = PATTERN_BYTES / io;
+  off_t *offsets = xmalloc(sizeof(off_t) * writes);
+  char *buf = xmalloc(io);
+  memset(buf, 0x5a, io);
+
+  for (size_t i = 0; i < writes; i++) {
+    offsets[i] = i * io;
+  }
+  if (strcmp(pattern, "random") == 0) {
+    srand(42);
+    for (size_t i = writes - 1; i > 0; i--) {
+      size_t j = (size_t)rand() % (i + 1);
+      off_t t = offsets[i];
+      offsets[i] = offsets[j];
+      offsets[j] = t;
+    }
+  } else if (strcmp(pattern, "overwrite") == 0) {
+    for (size_t i = 0; i < writes; i++) {
+      kfs_write(file, buf, io, offsets[i]);
+    }
+  }
+
+  double t = now_ns();
+  for (size_t i = 0; i < writes; i++) {
+    kfs_write(file, buf, io, offsets[i]);
+  }
+  t = now_ns() - t;
+  bench_result(PATTERN_BYTES / (t / 1e9) / (1024 * 1024), "MiB/s",
+               "kfs_write/%s/io=%zu", pattern, io);
+
+  free_KFS_Entry(file);
+  free(offsets);
+  free(buf);
+}
+
+void file_bench(void) {
+  size_t ios[] = {4096, WRITE_BYTES};
+  for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+    for (size_t i = 0; i < sizeof(ios) / sizeof(ios[0]); i++) {
+      bench_pattern(patterns[p], ios[i]);
+    }
+  }
+
+  int max = kfs_walk_default_threads();
+  if (max < 8) {
+    max = 8;
+  }
+
+  for (int writers = 1; writers <= max; writers *= 2) {
+    bench_result(bench_writers(writers), "MiB/s",
+                 "kfs_write/parallel/writers=%d", writers);
+  }
+}
@@ -0,0 +1,54 @@
+#include "bench.h"
+#include "kfs.h"
+#include "kfs_shm.h"
+#include <stdio.h>
+#include <unistd.h>
+
+#define CALLS 2000000
+#define READ_BYTES 4096
+
+static double pread_ns(KFS_ShmFile *file) {
+  char buf[READ_BYTES];
+  double start = now_ns();
+  for (int i = 0; i < CALLS; i++) {
+    kfs_shm_pread(file, buf, sizeof(buf), 0);
+  }
+  return (now_ns() - start) / CALLS;
+}
+
+// a read through a shared view against the daemon's read callback; a
+// mounted read adds the kernel round trip on top of the latter
+void shm_bench(void) {
+  char data[READ_BYTES];
+  memset(data, 'a', sizeof(data));
+  KFS_ROOT = new_KFS_Dir("/");
+  itf_fuse_kfs_create("/f", 0644, NULL);
+  itf_fuse_kfs_write("/f", data, sizeof(data), 0, NULL);
+
+  char socket_path[64];
+  snprintf(socket_path, sizeof(socket_path), "/tmp/kfs_shm_bench.%d",
+           (int)getpid());
+  KFS_ShmClient *client;
+  KFS_ShmFile *file;
+  if (!kfs_share_listen(socket_path) ||
+      kfs_shm_connect(socket_path, &client) != 0) {
+    perror(socket_path);
+    return;
+  }
+  if (kfs_shm_open(client, "/f", &file) == 0) {
+    bench_result(pread_ns(file), "ns/op", "shm/pread/4k");
+    kfs_shm_close(file);
+  }
+  kfs_shm_disconnect(client);
+  kfs_share_stop();
+
+  struct fuse_file_info fi;
+  memset(&fi, 0, sizeof(fi));
+  kfs_ops.open("/f", &fi);
+  double start = now_ns();
+  for (int i = 0; i < CALLS; i++) {
+    kfs_ops.read("/f", data, sizeof(data), 0, &fi);
+  }
+  bench_result((now_ns() - start) / CALLS, "ns/op", "shm/fuse_read/4k");
+  kfs_ops.release("/f", &fi);
+}
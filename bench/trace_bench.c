@@ -0,0 +1,39 @@
+#include "bench.h"
+#include "kfs.h"
+#include <stdio.h>
+
+#define SPANS 50000000
+#define GETATTRS 2000000
+
+// what an operation pays for tracing while it is off
+static double span_ns(void) {
+  volatile int sink = 0;
+  double start = now_ns();
+  for (int i = 0; i < SPANS; i++) {
+    KFS_TraceSpan span;
+    kfs_trace_begin(&span);
+    kfs_trace_end(&span, KFS_OP_getattr, "/f", 0, 0, sink);
+  }
+  return (now_ns() - start) / SPANS;
+}
+
+static double getattr_ns(void) {
+  struct stat st;
+  double start = now_ns();
+  for (int i = 0; i < GETATTRS; i++) {
+    kfs_ops.getattr("/f", &st);
+  }
+  return (now_ns() - start) / GETATTRS;
+}
+
+void trace_bench(void) {
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  itf_fuse_kfs_create("/f", 0644, NULL);
+
+  kfs_trace_enable(false);
+  bench_result(span_ns(), "ns/op", "trace/disabled_span");
+  bench_result(getattr_ns(), "ns/op", "trace/getattr/off");
+  kfs_trace_enable(true);
+  bench_result(getattr_ns(), "ns/op", "trace/getattr/on");
+  kfs_trace_enable(false);
+}
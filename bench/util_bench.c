@@ -0,0 +1,31 @@
+#include "bench.h"
+#include "kfs.h"
+#include <stdio.h>
+
+#define SPLITS 1000000
+
+// every lookup splits its path into components first
+static void bench_split(int components) {
+  sds path = sdsempty();
+  for (int i = 0; i < components; i++) {
+    path = sdscatprintf(path, "/component%d", i);
+  }
+
+  double t = now_ns();
+  for (int i = 0; i < SPLITS; i++) {
+    Vector *parts = sdssplitvec(path, '/');
+    VecForeach(parts, part, { sdsfree(part); });
+    free_vec(parts);
+  }
+  bench_result((now_ns() - t) / SPLITS, "ns/op",
+               "sdssplitvec/components=%d", components);
+  sdsfree(path);
+}
+
+void util_bench(void) {
+  int components[] = {1, 4, 16, 64};
+
+  for (size_t i = 0; i < sizeof(components) / sizeof(components[0]); i++) {
+    bench_split(components[i]);
+  }
+}
@@ -0,0 +1,83 @@
+#include "kfs.h"
+#include <stdio.h>
+#include <string.h>
+
+KFS_CacheOpts kfs_cache_opts = {.policy = KFS_CACHE_AUTO,
+                                .direct_min = 1 << 20};
+
+#define KFS_CACHE_OPT(t, field)                                                \
+  { t, offsetof(KFS_CacheOpts, field), 1 }
+
+static const struct fuse_opt cache_opts[] = {
+    KFS_CACHE_OPT("kfs_cache=%s", mode),
+    KFS_CACHE_OPT("kfs_direct_min=%ld", direct_min), FUSE_OPT_END};
+
+static const char *const policy_names[] = {
+    [KFS_CACHE_INHERIT] = "inherit",
+    [KFS_CACHE_AUTO] = "auto",
+    [KFS_CACHE_DIRECT] = "direct_io",
+    [KFS_CACHE_KEEP] = "keep_cache",
+};
+
+int kfs_cache_parse(struct fuse_args *args) {
+  KFS_CacheOpts *opts = &kfs_cache_opts;
+  if (fuse_opt_parse(args, opts, cache_opts, NULL) == -1) {
+    return -1;
+  }
+
+  if (opts->mode != NULL) {
+    int policy = kfs_cache_policy_of(opts->mode, strlen(opts->mode));
+    if (policy == -1 || policy == KFS_CACHE_INHERIT) {
+      fprintf(stderr, "kfs: unknown kfs_cache policy '%s'\n", opts->mode);
+      return -1;
+    }
+    opts->policy = policy;
+  }
+
+  return 0;
+}
+
+int kfs_cache_policy_of(const char *name, size_t len) {
+  for (size_t i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); i++) {
+    if (strlen(policy_names[i]) == len &&
+        memcmp(policy_names[i], name, len) == 0) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+const char *kfs_cache_policy_name(int policy) { return policy_names[policy]; }
+
+int kfs_cache_effective(KFS_Entry *entry) {
+  for (; entry != NULL; entry = entry->prev) {
+    if (entry->cache_policy != KFS_CACHE_INHERIT) {
+      return entry->cache_policy;
+    }
+  }
+  return kfs_cache_opts.policy;
+}
+
+void kfs_cache_open(KFS_Entry *entry, struct fuse_file_info *fi) {
+  uint64_t version = atomic_load(&entry->version);
+  // what the kernel may have cached is what it saw at the previous open
+  uint64_t seen = atomic_exchange(&entry->cached_version, version);
+
+  fi->direct_io = 0;
+  fi->keep_cache = 0;
+
+  switch (kfs_cache_effective(entry)) {
+  case KFS_CACHE_DIRECT:
+    fi->direct_io = 1;
+    break;
+  case KFS_CACHE_KEEP:
+    fi->keep_cache = 1;
+    break;
+  default:
+    if (entry->size >= kfs_cache_opts.direct_min) {
+      fi->direct_io = 1;
+    } else {
+      fi->keep_cache = seen == version;
+    }
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef __CACHE_HEADER_INCLUDED__
+#define __CACHE_HEADER_INCLUDED__
+#include "kfs.h"
+
+/*
+  Page cache policy, per file or per subtree.  Data read through the kernel
+  stays in its page cache on top of KFS's own copy, so large files would
+  cost twice their size.  A file uses its own policy, else the nearest
+  ancestor's, else the mount's:
+    direct_io   bypass the page cache (no shared mmap on older kernels)
+    keep_cache  keep cached pages across opens
+    auto        direct_io from kfs_direct_min bytes on; smaller files keep
+                their pages as long as they were not changed since the
+                previous open, so hot read-mostly files are served from
+                the page cache
+  Set with the user.kfs.cache xattr ("inherit" clears it) or mount options:
+    -o kfs_cache=POLICY      mount default (default: auto)
+    -o kfs_direct_min=BYTES  auto's direct_io threshold (default 1 MiB)
+*/
+
+// the KFS_CACHE_* policies are in entry.h
+
+typedef struct {
+  char *mode;
+  int policy;
+  long direct_min;
+} KFS_CacheOpts;
+
+extern KFS_CacheOpts kfs_cache_opts;
+
+// consumes the kfs_cache options from args
+int kfs_cache_parse(struct fuse_args *args);
+// -1 for an unknown name
+int kfs_cache_policy_of(const char *name, size_t len);
+const char *kfs_cache_policy_name(int policy);
+// the policy in effect for entry, never KFS_CACHE_INHERIT
+int kfs_cache_effective(KFS_Entry *entry);
+// sets direct_io/keep_cache for an open of entry
+void kfs_cache_open(KFS_Entry *entry, struct fuse_file_info *fi);
+
+#endif
@@ -0,0 +1,214 @@
+#include "kfs.h"
+#include "kfs_ioctl.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+atomic_bool kfs_capture_on;
+
+// anonymized names and paths seen so far, mapped to their ids
+GenAVLTree(KFS_CaptureIds, sds, uint64_t, entry_name_hash, entry_name_cmp);
+
+static pthread_mutex_t capture_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *capture_fp;
+static KFS_CaptureIds components;
+static KFS_CaptureIds paths;
+static Vector *capture_keys; // the sds keys of both, freed on stop
+static uint64_t next_path;
+static uint64_t last_ns;
+
+static struct {
+  char *file;
+} capture_opts;
+
+static const struct fuse_opt capture_fuse_opts[] = {
+    {"kfs_capture=%s", 0, 0}, FUSE_OPT_END};
+
+int kfs_capture_parse(struct fuse_args *args) {
+  if (fuse_opt_parse(args, &capture_opts, capture_fuse_opts, NULL) == -1) {
+    return -1;
+  }
+
+  // the daemon changes to / before the file is opened
+  if (capture_opts.file != NULL && capture_opts.file[0] != '/') {
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+      return -1;
+    }
+    sds abs = sdscatprintf(sdsempty(), "%s/%s", cwd, capture_opts.file);
+    free(capture_opts.file);
+    capture_opts.file = strdup(abs);
+    sdsfree(abs);
+  }
+  return 0;
+}
+
+void kfs_capture_service_start(void) {
+  if (capture_opts.file != NULL && !kfs_capture_start(capture_opts.file)) {
+    perror(capture_opts.file);
+  }
+}
+
+bool kfs_capture_start(const char *file) {
+  kfs_capture_stop();
+
+  FILE *fp = fopen(file, "wb");
+  if (fp == NULL) {
+    return false;
+  }
+  fwrite(KFS_CAPTURE_MAGIC, 1, strlen(KFS_CAPTURE_MAGIC), fp);
+
+  pthread_mutex_lock(&capture_lock);
+  capture_fp = fp;
+  KFS_CaptureIds_init(&components);
+  KFS_CaptureIds_init(&paths);
+  capture_keys = new_vec();
+  next_path = 1;
+  last_ns = kfs_stats_now();
+  atomic_store(&kfs_capture_on, true);
+  pthread_mutex_unlock(&capture_lock);
+  return true;
+}
+
+void kfs_capture_stop(void) {
+  pthread_mutex_lock(&capture_lock);
+  atomic_store(&kfs_capture_on, false);
+  if (capture_fp != NULL) {
+    fclose(capture_fp);
+    capture_fp = NULL;
+
+    KFS_CaptureIds_destroy(&components);
+    KFS_CaptureIds_destroy(&paths);
+    VecForeach(capture_keys, key, { sdsfree(key); });
+    free_vec(capture_keys);
+  }
+  pthread_mutex_unlock(&capture_lock);
+}
+
+const char *kfs_capture_clone_src(int cmd, void *data) {
+  if ((unsigned int)cmd != KFS_IOC_CLONE || data == NULL) {
+    return NULL;
+  }
+  return ((struct kfs_ioc_clone *)data)->src;
+}
+
+static void put_varint(uint64_t v) {
+  do {
+    unsigned char b = v & 0x7f;
+    v >>= 7;
+    fputc(v != 0 ? b | 0x80 : b, capture_fp);
+  } while (v != 0);
+}
+
+static void put_signed(int64_t v) {
+  put_varint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static uint64_t intern(KFS_CaptureIds *ids, sds key, uint64_t id) {
+  uint64_t *found = KFS_CaptureIds_find(ids, key);
+  if (found != NULL) {
+    sdsfree(key);
+    return *found;
+  }
+  KFS_CaptureIds_insert(ids, key, id);
+  vec_push(capture_keys, key);
+  return id;
+}
+
+static uint64_t component_id(const char *name, size_t len) {
+  return intern(&components, sdsnewlen(name, len), components.size);
+}
+
+// the id of path, defining it and its ancestors first if they are new
+static uint64_t path_id(const char *path) {
+  while (*path == '/') {
+    path++;
+  }
+  size_t len = strlen(path);
+  while (len > 0 && path[len - 1] == '/') {
+    len--;
+  }
+  if (len == 0) {
+    return 0;
+  }
+
+  sds key = sdsnewlen(path, len);
+  uint64_t *found = KFS_CaptureIds_find(&paths, key);
+  if (found != NULL) {
+    sdsfree(key);
+    return *found;
+  }
+
+  size_t parent_len = len;
+  while (parent_len > 0 && path[parent_len - 1] != '/') {
+    parent_len--;
+  }
+  uint64_t parent = 0;
+  if (parent_len > 0) {
+    sds parent_path = sdsnewlen(path, parent_len - 1);
+    parent = path_id(parent_path);
+    sdsfree(parent_path);
+  }
+  uint64_t component = component_id(path + parent_len, len - parent_len);
+
+  uint64_t id = intern(&paths, key, next_path++);
+  fputc(KFS_CAPTURE_PATH, capture_fp);
+  put_varint(parent);
+  put_varint(component);
+  return id;
+}
+
+static void put_string(const char *s, size_t len, bool varint_len) {
+  if (varint_len) {
+    put_varint(len);
+  } else {
+    fputc((unsigned char)len, capture_fp);
+  }
+  fwrite(s, 1, len, capture_fp);
+}
+
+void kfs_capture(int op, const char *path, const KFS_CaptureArgs *args,
+                 uint64_t start_ns, int res) {
+  pthread_mutex_lock(&capture_lock);
+  if (capture_fp == NULL) {
+    pthread_mutex_unlock(&capture_lock);
+    return;
+  }
+
+  uint64_t id = path_id(path);
+  uint64_t id2 = 0;
+  if (args->path2 != NULL) {
+    id2 = path_id(args->path2) + 1;
+  }
+
+  const char *name = args->name;
+  sds value = NULL;
+  if (name != NULL && strncmp(name, "user.kfs.", 9) != 0) {
+    name = "?";
+  } else if (name != NULL && args->value != NULL) {
+    value = strcmp(name, "user.kfs.rmtree") == 0
+                ? sdscatprintf(sdsempty(), "n%llu",
+                               (unsigned long long)component_id(
+                                   args->value, args->value_len))
+                : sdsnewlen(args->value, args->value_len);
+  }
+
+  uint64_t dt = start_ns > last_ns ? (start_ns - last_ns) / 1000 : 0;
+  last_ns = start_ns > last_ns ? last_ns + dt * 1000 : last_ns;
+
+  fputc(op, capture_fp);
+  put_varint(dt);
+  put_varint(id);
+  put_varint(id2);
+  put_signed(res);
+  put_signed(args->a);
+  put_signed(args->b);
+  put_string(name != NULL ? name : "", name != NULL ? strlen(name) : 0,
+             false);
+  put_string(value != NULL ? value : "", value != NULL ? sdslen(value) : 0,
+             true);
+
+  sdsfree(value);
+  pthread_mutex_unlock(&capture_lock);
+}
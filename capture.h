@@ -0,0 +1,84 @@
+#ifndef __CAPTURE_HEADER_INCLUDED__
+#define __CAPTURE_HEADER_INCLUDED__
+#include "kfs.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+  Capture of the operation stream for offline replay (see replay.h).  While
+  on, every operation outside the virtual tree is appended to a file with
+  its start time, result and arguments, but no data: writes keep their
+  offset and size only.  Path components are anonymized into n<ID>, the
+  same component getting the same ID throughout a capture, so the shape
+  of the tree and name reuse survive.  Values of the user.kfs.* control
+  xattrs are kept (rmtree's is anonymized like a component); other xattrs
+  become "?" without a value.
+
+  Turned on with -o kfs_capture=FILE.
+
+  File layout, varints are LEB128 and signed ones zigzag encoded:
+    "KFSREC01"
+    path:      0xf0, varint parent path id, varint component id
+               (path ids count up from 1 in order of definition; 0 is /)
+    operation: u8 op (KFS_OP_*), varint microseconds since the previous
+               operation, varint path id, varint second path id + 1 (0 for
+               none), signed res, signed a, signed b,
+               u8 name length, name, varint value length, value
+  a and b by operation: read, write: offset, size;  truncate: size;
+  open: flags;  mkdir, create, chmod, access: mode;  chown: uid, gid;
+  getxattr: size;  ioctl: cmd.
+*/
+
+#define KFS_CAPTURE_MAGIC "KFSREC01"
+#define KFS_CAPTURE_PATH 0xf0
+
+typedef struct {
+  const char *path2;
+  int64_t a;
+  int64_t b;
+  const char *name;
+  const char *value;
+  size_t value_len;
+} KFS_CaptureArgs;
+
+// what each operation records, from its own arguments
+#define KFS_CAPTURE_getattr(path, stbuf) ((KFS_CaptureArgs){0})
+#define KFS_CAPTURE_readdir(path, buf, filler, offset, fi)                     \
+  ((KFS_CaptureArgs){0})
+#define KFS_CAPTURE_open(path, fi) ((KFS_CaptureArgs){.a = (fi)->flags})
+#define KFS_CAPTURE_read(path, buf, size, offset, fi)                          \
+  ((KFS_CaptureArgs){.a = (offset), .b = (int64_t)(size)})
+#define KFS_CAPTURE_write KFS_CAPTURE_read
+#define KFS_CAPTURE_release(path, fi) ((KFS_CaptureArgs){0})
+#define KFS_CAPTURE_mkdir(path, mode) ((KFS_CaptureArgs){.a = (mode)})
+#define KFS_CAPTURE_access KFS_CAPTURE_mkdir
+#define KFS_CAPTURE_create(path, mode, fi) ((KFS_CaptureArgs){.a = (mode)})
+#define KFS_CAPTURE_utimens(path, tv) ((KFS_CaptureArgs){0})
+#define KFS_CAPTURE_unlink(path) ((KFS_CaptureArgs){0})
+#define KFS_CAPTURE_rmdir(path) ((KFS_CaptureArgs){0})
+#define KFS_CAPTURE_rename(from, to) ((KFS_CaptureArgs){.path2 = (to)})
+#define KFS_CAPTURE_chmod KFS_CAPTURE_mkdir
+#define KFS_CAPTURE_chown(path, uid, gid)                                      \
+  ((KFS_CaptureArgs){.a = (uid), .b = (gid)})
+#define KFS_CAPTURE_truncate(path, size) ((KFS_CaptureArgs){.a = (size)})
+#define KFS_CAPTURE_setxattr(path, xname, xvalue, size, flags)                 \
+  ((KFS_CaptureArgs){.name = (xname), .value = (xvalue), .value_len = (size)})
+#define KFS_CAPTURE_getxattr(path, xname, xvalue, size)                        \
+  ((KFS_CaptureArgs){.name = (xname), .b = (int64_t)(size)})
+#define KFS_CAPTURE_ioctl(path, cmd, arg, fi, flags, data)                     \
+  ((KFS_CaptureArgs){.path2 = kfs_capture_clone_src(cmd, data), .a = (cmd)})
+
+extern atomic_bool kfs_capture_on;
+
+// consumes the kfs_capture option from args
+int kfs_capture_parse(struct fuse_args *args);
+// the service started by init: opens the file given with kfs_capture=
+void kfs_capture_service_start(void);
+bool kfs_capture_start(const char *file);
+void kfs_capture_stop(void); // flushes and closes the file
+void kfs_capture(int op, const char *path, const KFS_CaptureArgs *args,
+                 uint64_t start_ns, int res);
+// the source path of a KFS_IOC_CLONE request, NULL for anything else
+const char *kfs_capture_clone_src(int cmd, void *data);
+
+#endif
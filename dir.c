@@ -1,27 +1,112 @@
 #include "kfs.h"
 
+// fold a detached directory's pending usage into itself, so that what it
+// contributes to a new parent is complete
+static void settle_usage(KFS_Entry *child) {
+  if (EntryIsDir(child)) {
+    kfs_usage_flush(child);
+  }
+}
+
 void kfs_append_child(KFS_Entry *this, KFS_Entry *child) {
   assert_is_dir(this);
-  avl_insert(GetAVLTree(this), child->name, child, path_cmp);
+  settle_usage(child);
+  KFS_DirIndex_insert(GetAVLTree(this), child->name, child);
   child->prev = this;
+
+  KFS_UsageStat st = kfs_usage_of(child);
+  kfs_usage_charge(this, st.bytes, st.inodes);
+  kfs_entry_modified(this);
+}
+
+KFS_Entry *kfs_remove_child(KFS_Entry *this, sds name) {
+  assert_is_dir(this);
+  KFS_Entry *child = kfs_find_on(this, name);
+  if (child == NULL) {
+    return NULL;
+  }
+
+  settle_usage(child);
+  KFS_UsageStat st = kfs_usage_of(child);
+  KFS_DirIndex_delete(GetAVLTree(this), name);
+  child->prev = NULL;
+  kfs_usage_charge(this, -st.bytes, -st.inodes);
+  kfs_entry_modified(this);
+
+  return child;
+}
+
+bool kfs_remove_tree(KFS_Entry *this, sds name) {
+  KFS_Entry *child = kfs_remove_child(this, name);
+  if (child == NULL) {
+    return false;
+  }
+
+  kfs_reclaim_enqueue(child);
+  return true;
+}
+
+KFS_Entry *kfs_move_child(KFS_Entry *this, sds name, KFS_Entry *dst,
+                          sds new_name) {
+  assert_is_dir(dst);
+  KFS_Entry *child = kfs_find_on(this, name);
+  if (child == NULL || kfs_entry_home(child) != dst->region) {
+    return NULL;
+  }
+  kfs_remove_child(this, name);
+
+  if (sdscmp(child->name, new_name) != 0) {
+    kfs_entry_set_name(child, new_name);
+  } else {
+    kfs_entry_changed(child);
+  }
+  kfs_append_child(dst, child);
+
+  return child;
+}
+
+void kfs_import_children(KFS_Entry *this, KFS_Entry **childs, size_t n) {
+  assert_is_dir(this);
+  KFS_DirIndex *index = GetAVLTree(this);
+
+  // a non-empty directory has to merge, so fall back to inserting one by one
+  if (index->size > 0) {
+    for (size_t i = 0; i < n; i++) {
+      kfs_append_child(this, childs[i]);
+    }
+    return;
+  }
+
+  KFS_UsageStat total = {0, 0};
+  sds *names = xmalloc(sizeof(sds) * n);
+  for (size_t i = 0; i < n; i++) {
+    settle_usage(childs[i]);
+    KFS_UsageStat st = kfs_usage_of(childs[i]);
+    total.bytes += st.bytes;
+    total.inodes += st.inodes;
+
+    names[i] = childs[i]->name;
+    childs[i]->prev = this;
+  }
+
+  KFS_DirIndex_build(index, names, childs, n);
+  kfs_usage_charge(this, total.bytes, total.inodes);
+  kfs_entry_modified(this);
+  xfree(&names);
 }
 
 KFS_Entry *kfs_find_on(KFS_Entry *this, sds name) {
   assert_is_dir(this);
-  return avl_find(GetAVLTree(this), name, path_cmp);
+  KFS_Entry **found = KFS_DirIndex_find(GetAVLTree(this), name);
+  return found != NULL ? *found : NULL;
 }
 
 KFS_Entry *kfs_find(KFS_Entry *this, sds path) {
   assert_is_dir(this);
-  sds slash = sdsnew("/");
 
   // check root; return this(it-self)
-  if (sdscmp(path, slash) == 0) {
-    if (sdscmp(this->name, slash) == 0) {
-      return this;
-    } else {
-      return NULL;
-    }
+  if (strcmp(path, "/") == 0) {
+    return strcmp(this->name, "/") == 0 ? this : NULL;
   }
 
   // 先頭の '/' をとる．
@@ -31,36 +116,36 @@ KFS_Entry *kfs_find(KFS_Entry *this, sds path) {
 
   Vector *paths = sdssplitvec(path, '/');
   KFS_Entry *tentry = this;
+  KFS_Entry *found = NULL;
 
-  for (size_t i = 0; i < paths->len; i++) {
+  for (size_t i = 0; i < paths->len && tentry != NULL; i++) {
     sds tpath = paths->data[i];
-    if (tentry == NULL) {
-      return NULL;
-    }
 
     // pathの終端の場合，探すのをここでうちきる．
     if (i + 1 == paths->len) {
       if (tentry->entry_type == tKFS_File) {
-        if (sdscmp(tpath, tentry->name) == 0) {
-          return tentry;
-        } else {
-          return NULL;
-        }
+        found = sdscmp(tpath, tentry->name) == 0 ? tentry : NULL;
       } else {
-        return kfs_find_on(tentry, tpath);
+        found = kfs_find_on(tentry, tpath);
       }
     } else {
       // 途中にあったのがファイルの場合，目的のものはない(それ以上ほれないため)
       if (tentry->entry_type == tKFS_File) {
-        return NULL;
+        tentry = NULL;
       } else {
         tentry = kfs_find_on(tentry, tpath);
       }
     }
   }
 
-  sdsfree(slash);
-  return NULL;
+  VecForeach(paths, tpath, { sdsfree(tpath); });
+  free_vec(paths);
+  return found;
+}
+
+static void push_name(sds name, KFS_Entry *entry __attribute__((unused)),
+                      void *ret) {
+  vec_push((Vector *)ret, name);
 }
 
 Vector *kfs_getCurrentList(KFS_Entry *this) {
@@ -68,40 +153,26 @@ Vector *kfs_getCurrentList(KFS_Entry *this) {
 
   vec_push(ret, sdsnew("."));
   vec_push(ret, sdsnew(".."));
-  vec_append(ret, avl_keys(GetAVLTree(this)));
+  KFS_DirIndex_foreach(GetAVLTree(this), push_name, ret);
 
   return ret;
 }
 
-static void trav_f(AVLNode *node, sds prefix, Vector *ret) {
-  if (node == NULL) {
-    return;
-  }
-
-  sds new_prefix = sdscatprintf(sdsempty(), "%s%s", prefix, (sds)node->key);
-  vec_push(ret, new_prefix);
-
-  sds slash = sdsnew("/");
-  sds empty = sdsempty();
-
-  KFS_Entry *entry = GetNodeValueAs(node, KFS_Entry *);
-  if (entry->entry_type == tKFS_Dir) {
-    trav_f(GetAVLTree(entry)->root, sdscat(new_prefix, slash), ret);
-  }
+void kfs_freeCurrentList(Vector *list) {
+  sdsfree(list->data[0]);
+  sdsfree(list->data[1]);
+  free_vec(list);
+}
 
-  trav_f(node->left, sdscat(prefix, sdscmp(prefix, slash) == 0 ? empty : slash),
-         ret);
-  trav_f(node->right,
-         sdscat(prefix, sdscmp(prefix, slash) == 0 ? empty : slash), ret);
+static bool collect_path(KFS_WalkEntry *we, void *ret) {
+  vec_push((Vector *)ret, sdsnew(we->path));
+  return true;
 }
 
 Vector *kfs_getTree(KFS_Entry *this) {
   Vector *ret = new_vec();
 
-  vec_push(ret, this->name);
-  trav_f(GetAVLTree(this)->root, this->name, ret);
-
-  // Todo sort: ret
+  kfs_walk(this, this->name, 1, KFS_WALK_SORTED, collect_path, ret);
 
   return ret;
-}
\ No newline at end of file
+}
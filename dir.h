@@ -3,9 +3,26 @@
 #include "kfs.h"
 
 void kfs_append_child(KFS_Entry *this, KFS_Entry *child);
+// bulk-insert n children with distinct names; builds the index in one pass
+// when the directory is empty
+void kfs_import_children(KFS_Entry *this, KFS_Entry **childs, size_t n);
+// unlink a child from the index and return it, or NULL if there is none
+KFS_Entry *kfs_remove_child(KFS_Entry *this, sds name);
+// unlink a child together with everything below it; the memory is freed by
+// the reclaimer.  O(log n) in the caller's thread regardless of subtree size
+bool kfs_remove_tree(KFS_Entry *this, sds name);
+// re-link a child under dst as new_name; nothing is copied, so this is
+// O(log n) for files and whole subtrees alike.  new_name must be free in dst.
+// Returns NULL if there is no such child or the move would cross a scratch
+// region boundary
+KFS_Entry *kfs_move_child(KFS_Entry *this, sds name, KFS_Entry *dst,
+                          sds new_name);
 KFS_Entry *kfs_find_on(KFS_Entry *this, sds name);
 KFS_Entry *kfs_find(KFS_Entry *this, sds path);
+// "." and "..", then the children's own names; free with kfs_freeCurrentList
 Vector *kfs_getCurrentList(KFS_Entry *this);
+void kfs_freeCurrentList(Vector *list);
+// full paths, each a new sds owned by the caller
 Vector *kfs_getTree(KFS_Entry *this);
 
 #endif
\ No newline at end of file
@@ -1,81 +1,191 @@
 #include "kfs.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
-static KFS_File *new_KFS_File_impl(void) {
-  KFS_File *file = xmalloc(sizeof(KFS_File));
-  file->data = NULL;
-  return file;
+// cache line aligned, so that the hot half of the entry is a single line
+static KFS_Entry *alloc_entry(KFS_Region *region) {
+  return kfs_region_alloc(region, sizeof(KFS_Entry), KFS_CACHE_LINE);
 }
 
-static KFS_Dir *new_KFS_Dir_impl(void) {
-  KFS_Dir *dir = xmalloc(sizeof(KFS_Dir));
-  dir->childs = new_AVLTree();
-  return dir;
+// names in a region get a hand-built sds header, so sds functions that only
+// read the string work on them; they must never be passed to sdsfree
+static sds new_name(KFS_Region *region, const char *name) {
+  if (region == NULL) {
+    sds heap_name = sdsnew(name);
+    kfs_alloc_count(KFS_ALLOC_names, 1, sdsAllocSize(heap_name));
+    return heap_name;
+  }
+
+  size_t len = strlen(name);
+  if (len < UINT8_MAX) {
+    struct sdshdr8 *sh = kfs_region_alloc(region, sizeof(*sh) + len + 1, 1);
+    sh->len = sh->alloc = len;
+    sh->flags = SDS_TYPE_8;
+    memcpy(sh->buf, name, len + 1);
+    return sh->buf;
+  }
+
+  struct sdshdr32 *sh = kfs_region_alloc(region, sizeof(*sh) + len + 1, 1);
+  sh->len = sh->alloc = len;
+  sh->flags = SDS_TYPE_32;
+  memcpy(sh->buf, name, len + 1);
+  return sh->buf;
+}
+
+// for names from new_name(NULL, ...)
+static void free_name(sds name) {
+  kfs_alloc_count(KFS_ALLOC_names, -1, -(int64_t)sdsAllocSize(name));
+  sdsfree(name);
+}
+
+#define EntryOfIndex(tree)                                                     \
+  ((KFS_Entry *)((char *)(tree)-offsetof(KFS_Entry, dir.childs)))
+
+void *entry_index_realloc(void *tree, void *ptr, size_t old_size,
+                          size_t size) {
+  KFS_Region *home = kfs_entry_home(EntryOfIndex(tree));
+  if (home == NULL) {
+    kfs_alloc_count(KFS_ALLOC_avl, ptr == NULL,
+                    (int64_t)size - (int64_t)old_size);
+  }
+  return kfs_region_realloc(home, ptr, old_size, size);
+}
+
+void entry_index_free(void *tree, void *ptr) {
+  KFS_Region *home = kfs_entry_home(EntryOfIndex(tree));
+  if (home == NULL) {
+    KFS_DirIndex *index = tree;
+    kfs_alloc_count(KFS_ALLOC_avl, -1,
+                    -(int64_t)(sizeof(KFS_DirIndexNode) * index->cap));
+  }
+  kfs_region_free(home, ptr);
 }
 
 KFS_Entry *make_entry(sds name, int entry_type) {
-  KFS_Entry *entry = xmalloc(sizeof(KFS_Entry));
+  return make_entry_in(NULL, name, entry_type);
+}
+
+KFS_Entry *make_child_entry(KFS_Entry *parent, sds name, int entry_type) {
+  return make_entry_in(parent->region, name, entry_type);
+}
+
+KFS_Entry *make_entry_in(KFS_Region *region, sds name, int entry_type) {
+  KFS_Entry *entry = alloc_entry(region);
+  entry->region = region;
 
   switch (entry_type) {
   case tKFS_Dir: {
-    entry->dentry = new_KFS_Dir_impl();
+    KFS_DirIndex_init(&entry->dir.childs);
+    kfs_usage_init(&entry->usage);
     entry->mode = S_IFDIR | 0755;
     entry->size = 4096;
     break;
   }
   case tKFS_File: {
-    entry->fentry = new_KFS_File_impl();
+    entry->file.chunks = NULL;
+    atomic_init(&entry->file.sync, NULL);
     entry->mode = S_IFREG | 0444;
     entry->size = 0;
     break;
   }
   default:
     fprintf(stderr, "Unkown entry_type\n");
-    xfree(&entry);
+    kfs_region_free(region, entry);
     return NULL;
   }
 
-  entry->name = sdsempty();
-  sdscpy(entry->name, name);
+  if (region == NULL) {
+    kfs_alloc_count(KFS_ALLOC_entries, 1, sizeof(KFS_Entry));
+  }
+  entry->name = new_name(region, name);
   entry->entry_type = entry_type;
   entry->nlink = 1;
   entry->prev = NULL;
   entry->uid = getuid();
   entry->gid = getgid();
 
-  clock_getres(CLOCK_REALTIME, &entry->atime);
-  clock_getres(CLOCK_REALTIME, &entry->mtime);
+  clock_gettime(CLOCK_REALTIME, &entry->atime);
+  entry->mtime = entry->ctime = entry->atime;
+  atomic_init(&entry->version, 0);
+  atomic_init(&entry->cached_version, 0);
+  entry->cache_policy = KFS_CACHE_INHERIT;
 
   return entry;
 }
 
 sds kfs_getPwd(KFS_Entry *entry) {
-  Vector *ret = new_vec();
-  sds res = sdsempty();
-  size_t i = 0;
-
-  while (entry != NULL) {
-    if (i == 0) {
-      sdscpy(res, entry->name);
-    } else {
-      vec_push(ret, entry->name);
-    }
+  Vector *names = new_vec();
 
+  // everything but the root contributes a "/name" component
+  while (entry->prev != NULL) {
+    vec_push(names, entry->name);
     entry = entry->prev;
-    i++;
   }
 
-  if (ret->len > 0) {
-    res = sdscat(res, vecstrjoin(ret, sdsnew("/")));
+  sds res = names->len == 0 ? sdsdup(entry->name) : sdsempty();
+  for (size_t i = names->len; i > 0; i--) {
+    res = sdscatprintf(res, "/%s", (sds)names->data[i - 1]);
   }
 
+  free_vec(names);
   return res;
 }
 
+void kfs_entry_modified(KFS_Entry *entry) {
+  clock_gettime(CLOCK_REALTIME, &entry->mtime);
+  entry->ctime = entry->mtime;
+  atomic_fetch_add(&entry->version, 1);
+}
+
+void kfs_entry_changed(KFS_Entry *entry) {
+  clock_gettime(CLOCK_REALTIME, &entry->ctime);
+  atomic_fetch_add(&entry->version, 1);
+}
+
+void kfs_entry_set_name(KFS_Entry *entry, sds name) {
+  KFS_Region *home = kfs_entry_home(entry);
+  sds old = entry->name;
+
+  entry->name = new_name(home, name);
+  if (home == NULL) {
+    free_name(old);
+  }
+  kfs_entry_changed(entry);
+}
+
+void free_KFS_Entry(KFS_Entry *entry) {
+  // the entry's memory goes away with its region, but neither a file's
+  // locks and shared view nor a directory's quota do
+  if (kfs_entry_home(entry) != NULL) {
+    if (EntryIsFile(entry)) {
+      kfs_file_release(entry);
+    } else {
+      kfs_usage_release(entry);
+    }
+    return;
+  }
+
+  if (EntryIsDir(entry)) {
+    KFS_DirIndex_destroy(GetAVLTree(entry));
+    kfs_usage_release(entry);
+  } else {
+    kfs_file_release(entry);
+  }
+
+  if (kfs_is_scratch(entry)) {
+    kfs_file_release_region(entry->region);
+    kfs_usage_release_region(entry->region);
+    kfs_region_destroy(entry->region);
+  }
+  free_name(entry->name);
+  kfs_alloc_count(KFS_ALLOC_entries, -1, -(int64_t)sizeof(KFS_Entry));
+  free(entry);
+}
+
 KFS_Entry *new_KFS_File(sds name) {
   KFS_Entry *entry = make_entry(name, tKFS_File);
   return entry;
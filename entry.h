@@ -1,52 +1,127 @@
 #ifndef __ENTRY_HEADER_INCLUDED__
 #define __ENTRY_HEADER_INCLUDED__
 #include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include <time.h>
 
 enum { tKFS_Dir, tKFS_File };
 
+struct KFS_ChunkTable;
+struct KFS_FileSync;
+
 typedef struct {
-  char *data;
+  struct KFS_ChunkTable *chunks; // see file.h
+  struct KFS_FileSync *_Atomic sync;
 } KFS_File;
 
+struct KFS_Entry;
+
+static inline int entry_name_cmp(sds lhs, sds rhs) { return strcmp(lhs, rhs); }
+
+// FNV-1a
+static inline uint32_t entry_name_hash(sds name) {
+  uint32_t h = 2166136261u;
+  for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+    h = (h ^ *p) * 16777619u;
+  }
+  return h;
+}
+
+// index pools come from the directory's region, if it has one
+void *entry_index_realloc(void *tree, void *ptr, size_t old_size, size_t size);
+void entry_index_free(void *tree, void *ptr);
+
+// children of a directory, indexed by name
+GenAVLTreeWithAlloc(KFS_DirIndex, sds, struct KFS_Entry *, entry_name_hash,
+                    entry_name_cmp, entry_index_realloc, entry_index_free);
+
 typedef struct {
-  AVLTree *childs;
+  KFS_DirIndex childs;
 } KFS_Dir;
 
-#define GetAVLTree(entry) (entry->dentry->childs)
+#define GetAVLTree(entry) (&(entry)->dir.childs)
 #define assert_is_file(entry) (assert(entry->entry_type == tKFS_File))
 #define assert_is_dir(entry) (assert(entry->entry_type == tKFS_Dir))
 #define GetNodeValueAs(node, as_type) ((as_type)node->value)
 #define EntryIsFile(entry) (entry->entry_type == tKFS_File ? true : false)
 #define EntryIsDir(entry) (entry->entry_type == tKFS_Dir ? true : false)
-#define GetKFSDir(entry) entry->dentry
-#define GetKFSFile(entry) entry->fentry
+#define GetKFSDir(entry) (&(entry)->dir)
+#define GetKFSFile(entry) (&(entry)->file)
 
-typedef struct KFS_Entry {
-  sds name;
-  int entry_type; // KFS_Dir or KFS_File
+#define KFS_CACHE_LINE 64
+
+// page cache policies, see cache.h
+enum { KFS_CACHE_INHERIT, KFS_CACHE_AUTO, KFS_CACHE_DIRECT, KFS_CACHE_KEEP };
+
+/*
+  The first cache line holds everything kfs_find reads: the embedded
+  directory index (or file payload) and the stat fields other than the
+  timestamps.  Names, parent links and timestamps start on the second
+  line, so lookups along a path never pull them in.
 
+  getattr reads both lines.  The index and the other stat fields take 60
+  of the 64 bytes, and the three timestamps need 24 more even as packed
+  32-bit seconds and nanoseconds, so they sit right after name and prev
+  and a stat touches exactly two lines.
+*/
+typedef struct KFS_Entry {
+  // hot
   union {
-    KFS_Dir *dentry;
-    KFS_File *fentry;
+    KFS_Dir dir;
+    KFS_File file;
   };
 
-  mode_t mode;
   off_t size;
-  nlink_t nlink;
+  mode_t mode;
+  uint32_t nlink;
+  uid_t uid;
+  gid_t gid;
+  int entry_type; // KFS_Dir or KFS_File
+
+  // cold
+  sds name __attribute__((aligned(KFS_CACHE_LINE)));
   struct KFS_Entry *prev;
   struct timespec atime;
   struct timespec mtime;
-  uid_t uid;
-  gid_t gid;
+  struct timespec ctime;
+  _Atomic uint64_t version; // bumped on every change to data or metadata
+  _Atomic uint64_t cached_version; // version at the last open, see cache.h
+  KFS_Usage usage; // directories only
+  // scratch region this entry belongs to; a scratch directory points at the
+  // region it owns, but is itself on the heap
+  KFS_Region *region;
+  uint8_t cache_policy; // KFS_CACHE_*
 } KFS_Entry;
 
+_Static_assert(offsetof(KFS_Entry, name) == KFS_CACHE_LINE,
+               "hot KFS_Entry fields must fit in one cache line");
+_Static_assert(offsetof(KFS_Entry, ctime) + sizeof(struct timespec) <=
+                   2 * KFS_CACHE_LINE,
+               "getattr must not read past the second cache line");
+
+// the region the entry's own memory comes from, NULL for the heap
+static inline KFS_Region *kfs_entry_home(KFS_Entry *entry) {
+  return entry->region != NULL && entry->region->owner != entry ? entry->region
+                                                                : NULL;
+}
+
 KFS_Entry *make_entry(sds name, int entry_type);
+KFS_Entry *make_entry_in(KFS_Region *region, sds name, int entry_type);
+// a new entry allocated where children of parent live; not linked yet
+KFS_Entry *make_child_entry(KFS_Entry *parent, sds name, int entry_type);
+void kfs_entry_set_name(KFS_Entry *entry, sds name);
+// contents changed (file data, directory children): mtime, ctime, version
+void kfs_entry_modified(KFS_Entry *entry);
+// metadata only (mode, owner, times, name): ctime, version
+void kfs_entry_changed(KFS_Entry *entry);
+// frees one entry and what it owns, but not its children
+void free_KFS_Entry(KFS_Entry *entry);
 sds kfs_getPwd(KFS_Entry *entry);
 KFS_Entry *new_KFS_File(sds name);
 KFS_Entry *new_KFS_Dir(sds name);
 
-#include <string.h>
 static inline int path_cmp(void *lhs, void *rhs) {
   char *lname = (char *)lhs;
   char *rname = (char *)rhs;
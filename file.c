@@ -1,37 +1,523 @@
 #include "kfs.h"
+#include <errno.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+// heap memory only; a region is accounted for as a whole
+static void count_data(KFS_Region *region, int64_t objects, int64_t bytes) {
+  if (region == NULL) {
+    kfs_alloc_count(KFS_ALLOC_file_data, objects, bytes);
+  }
+}
+
+static size_t chunk_fit(size_t need) {
+  size_t cap = KFS_CHUNK_MIN_CAPACITY;
+  while (cap < need) {
+    cap <<= 1;
+  }
+  return cap < KFS_CHUNK_SIZE ? cap : KFS_CHUNK_SIZE;
+}
+
+static KFS_Chunk *chunk_new(KFS_Region *region, size_t cap) {
+  KFS_Chunk *chunk =
+      kfs_region_alloc(region, sizeof(KFS_Chunk) + cap, sizeof(void *));
+  atomic_init(&chunk->refs, 1);
+  chunk->cap = cap;
+  memset(chunk->data, 0, cap);
+  count_data(region, 1, sizeof(KFS_Chunk) + cap);
+  return chunk;
+}
+
+static void chunk_put(KFS_Region *region, KFS_Chunk *chunk) {
+  if (chunk != NULL && atomic_fetch_sub(&chunk->refs, 1) == 1) {
+    count_data(region, -1, -(int64_t)(sizeof(KFS_Chunk) + chunk->cap));
+    kfs_region_free(region, chunk);
+  }
+}
+
+static void table_put(KFS_Region *region, KFS_ChunkTable *table) {
+  if (table == NULL || atomic_fetch_sub(&table->refs, 1) != 1) {
+    return;
+  }
+
+  for (size_t i = 0; i < table->len; i++) {
+    chunk_put(region, table->chunks[i]);
+  }
+  if (table->chunks != NULL) {
+    kfs_region_free(region, table->chunks);
+  }
+  count_data(region, -1,
+             -(int64_t)(sizeof(KFS_ChunkTable) +
+                        sizeof(KFS_Chunk *) * table->cap));
+  kfs_region_free(region, table);
+}
+
+static void table_reserve(KFS_Region *region, KFS_ChunkTable *table,
+                          size_t len) {
+  if (table->cap >= len) {
+    return;
+  }
+
+  size_t cap = table->cap ? table->cap : 4;
+  while (cap < len) {
+    cap <<= 1;
+  }
+  table->chunks = kfs_region_realloc(region, table->chunks,
+                                     sizeof(KFS_Chunk *) * table->cap,
+                                     sizeof(KFS_Chunk *) * cap);
+  count_data(region, 0, sizeof(KFS_Chunk *) * (cap - table->cap));
+  table->cap = cap;
+}
+
+static KFS_ChunkTable *table_new(KFS_Region *region, size_t len) {
+  KFS_ChunkTable *table =
+      kfs_region_alloc(region, sizeof(KFS_ChunkTable), sizeof(void *));
+  atomic_init(&table->refs, 1);
+  count_data(region, 1, sizeof(KFS_ChunkTable));
+  table->len = 0;
+  table->cap = 0;
+  table->chunks = NULL;
+  table_reserve(region, table, len);
+  return table;
+}
+
+// the file's table, made private first if it is shared with a clone
+static KFS_ChunkTable *own_table(KFS_Region *region, KFS_File *file) {
+  KFS_ChunkTable *table = file->chunks;
+
+  if (table == NULL) {
+    table = file->chunks = table_new(region, 0);
+  } else if (atomic_load(&table->refs) > 1) {
+    KFS_ChunkTable *copy = table_new(region, table->len);
+    for (size_t i = 0; i < table->len; i++) {
+      if ((copy->chunks[i] = table->chunks[i]) != NULL) {
+        atomic_fetch_add(&copy->chunks[i]->refs, 1);
+      }
+    }
+    copy->len = table->len;
+    table_put(region, table);
+    table = file->chunks = copy;
+  }
+
+  return table;
+}
+
+static void table_resize(KFS_Region *region, KFS_ChunkTable *table,
+                         size_t len) {
+  if (len > table->len) {
+    table_reserve(region, table, len);
+    memset(table->chunks + table->len, 0,
+           sizeof(KFS_Chunk *) * (len - table->len));
+  } else {
+    for (size_t i = len; i < table->len; i++) {
+      chunk_put(region, table->chunks[i]);
+    }
+  }
+  table->len = len;
+}
+
+// a private chunk at idx with at least need bytes of capacity
+static KFS_Chunk *own_chunk(KFS_Region *region, KFS_ChunkTable *table,
+                            size_t idx, size_t need) {
+  KFS_Chunk *chunk = table->chunks[idx];
+
+  if (chunk == NULL) {
+    chunk = chunk_new(region, chunk_fit(need));
+  } else if (atomic_load(&chunk->refs) > 1) {
+    size_t cap = chunk_fit(need > chunk->cap ? need : chunk->cap);
+    KFS_Chunk *copy = chunk_new(region, cap);
+    memcpy(copy->data, chunk->data, chunk->cap);
+    chunk_put(region, chunk);
+    chunk = copy;
+  } else if (chunk->cap < need) {
+    size_t cap = chunk_fit(need);
+    chunk = kfs_region_realloc(region, chunk, sizeof(KFS_Chunk) + chunk->cap,
+                               sizeof(KFS_Chunk) + cap);
+    memset(chunk->data + chunk->cap, 0, cap - chunk->cap);
+    count_data(region, 0, cap - chunk->cap);
+    chunk->cap = cap;
+  }
+
+  table->chunks[idx] = chunk;
+  return chunk;
+}
+
+#define ChunkCount(size)                                                       \
+  (((size_t)(size) + KFS_CHUNK_SIZE - 1) >> KFS_CHUNK_SHIFT)
+#define ChunkFloor(off) ((off_t)(off) & ~(off_t)(KFS_CHUNK_SIZE - 1))
+#define ChunkCeil(off) ChunkFloor((off_t)(off) + KFS_CHUNK_SIZE - 1)
+
+static void sync_destroy(KFS_Region *region, KFS_FileSync *sync) {
+  kfs_range_destroy(&sync->ranges);
+  pthread_rwlock_destroy(&sync->table_lock);
+  pthread_mutex_destroy(&sync->size_lock);
+  kfs_shm_view_free(atomic_load(&sync->shm));
+  count_data(region, -1, -(int64_t)sizeof(KFS_FileSync));
+  kfs_region_free(region, sync);
+}
+
+// allocated on first use, so files that are never opened stay small
+static KFS_FileSync *file_sync(KFS_Entry *this) {
+  KFS_File *file = GetKFSFile(this);
+  KFS_FileSync *sync = atomic_load(&file->sync);
+  if (sync != NULL) {
+    return sync;
+  }
+
+  KFS_Region *region = kfs_entry_home(this);
+  sync = kfs_region_alloc(region, sizeof(KFS_FileSync), sizeof(void *));
+  count_data(region, 1, sizeof(KFS_FileSync));
+  kfs_range_init(&sync->ranges);
+  pthread_rwlock_init(&sync->table_lock, NULL);
+  pthread_mutex_init(&sync->size_lock, NULL);
+  atomic_init(&sync->shm, NULL);
+
+  sync->prev = NULL;
+  sync->next = NULL;
+
+  KFS_FileSync *expected = NULL;
+  if (!atomic_compare_exchange_strong(&file->sync, &expected, sync)) {
+    sync_destroy(region, sync);
+    return expected;
+  }
+
+  // the region's memory is dropped without visiting its files, so it
+  // keeps the syncs to tear down first
+  if (region != NULL) {
+    pthread_mutex_lock(&region->lock);
+    sync->next = region->syncs;
+    if (region->syncs != NULL) {
+      region->syncs->prev = sync;
+    }
+    region->syncs = sync;
+    pthread_mutex_unlock(&region->lock);
+  }
+  return sync;
+}
+
+// ranges are widened to whole chunks: a chunk may be copied or reallocated
+// by whoever writes into it
+static void lock_chunks(KFS_FileSync *sync, KFS_RangeHold *hold, off_t start,
+                        off_t end, bool write) {
+  kfs_range_lock(&sync->ranges, hold, ChunkFloor(start), ChunkCeil(end),
+                 write);
+}
+
+// the table is replaced or reallocated only with table_lock held
+// exclusively; the caller holds it shared and gets it back shared
+static KFS_ChunkTable *prepare_table(KFS_Entry *this, KFS_FileSync *sync,
+                                     off_t end) {
+  KFS_File *file = GetKFSFile(this);
+  KFS_Region *region = kfs_entry_home(this);
+  size_t need = ChunkCount(end);
+
+  for (;;) {
+    KFS_ChunkTable *table = file->chunks;
+    if (table != NULL && atomic_load(&table->refs) == 1 &&
+        table->cap >= need) {
+      break;
+    }
+
+    pthread_rwlock_unlock(&sync->table_lock);
+    pthread_rwlock_wrlock(&sync->table_lock);
+    table = own_table(region, file);
+    table_reserve(region, table, need);
+    pthread_rwlock_unlock(&sync->table_lock);
+    pthread_rwlock_rdlock(&sync->table_lock);
+  }
+
+  // growing within capacity only touches slots nobody else can be using
+  KFS_ChunkTable *table = file->chunks;
+  pthread_mutex_lock(&sync->size_lock);
+  if (need > table->len) {
+    table_resize(region, table, need);
+  }
+  pthread_mutex_unlock(&sync->size_lock);
+
+  return table;
+}
 
 void kfs_write(KFS_Entry *this, const char *buf, long int size,
                long int offset) {
   assert_is_file(this);
 
-  KFS_File *file = GetKFSFile(this);
+  KFS_FileSync *sync = file_sync(this);
+  KFS_Region *region = kfs_entry_home(this);
+  const char *data = buf;
+  off_t start = offset;
+  off_t end = offset + size;
+  KFS_RangeHold hold;
 
-  if(offset) {
-    if(this->size < offset + size) {
-      size_t append_size = (offset + size) - this->size;
-      file->data = realloc(file->data, this->size + append_size);
-      this->size += append_size;
+  lock_chunks(sync, &hold, offset, end, true);
+  pthread_rwlock_rdlock(&sync->table_lock);
+  KFS_ChunkTable *table = prepare_table(this, sync, end);
+
+  while (offset < end) {
+    size_t idx = offset >> KFS_CHUNK_SHIFT;
+    size_t at = offset & (KFS_CHUNK_SIZE - 1);
+    size_t n = KFS_CHUNK_SIZE - at;
+    if ((off_t)n > end - offset) {
+      n = end - offset;
     }
-  } else {
-    if(this->size == 0) {
-      file->data = xmalloc(size);
-      this->size = size;
-    } else if(this->size < size) {
-      file->data = realloc(file->data, size);
-      this->size = size;
+
+    KFS_Chunk *chunk = own_chunk(region, table, idx, at + n);
+    memcpy(chunk->data + at, buf, n);
+    buf += n;
+    offset += n;
+  }
+
+  pthread_rwlock_unlock(&sync->table_lock);
+
+  off_t growth = 0;
+  pthread_mutex_lock(&sync->size_lock);
+  if (end > this->size) {
+    growth = end - this->size;
+    this->size = end;
+  }
+  kfs_entry_modified(this);
+  pthread_mutex_unlock(&sync->size_lock);
+
+  KFS_ShmView *view = atomic_load(&sync->shm);
+  if (view != NULL) {
+    kfs_shm_view_write(view, data, size, start);
+  }
+  kfs_range_unlock(&sync->ranges, &hold);
+
+  if (growth != 0) {
+    kfs_usage_charge(this->prev, growth, 0);
+  }
+}
+
+// size bytes at offset, within the file; the caller holds the range
+// and table_lock
+static void copy_out(KFS_ChunkTable *table, char *buf, size_t size,
+                     off_t offset) {
+  size_t done = 0;
+  while (done < size) {
+    size_t idx = offset >> KFS_CHUNK_SHIFT;
+    size_t at = offset & (KFS_CHUNK_SIZE - 1);
+    size_t n = KFS_CHUNK_SIZE - at;
+    if (n > size - done) {
+      n = size - done;
+    }
+
+    KFS_Chunk *chunk = table->chunks[idx];
+    size_t have = chunk == NULL || at >= chunk->cap ? 0 : chunk->cap - at;
+    if (have > n) {
+      have = n;
+    }
+    if (have > 0) {
+      memcpy(buf + done, chunk->data + at, have);
+    }
+    memset(buf + done + have, 0, n - have);
+
+    done += n;
+    offset += n;
+  }
+}
+
+size_t kfs_read(KFS_Entry *this, char *buf, size_t size, off_t offset) {
+  assert_is_file(this);
+  KFS_FileSync *sync = file_sync(this);
+  KFS_RangeHold hold;
+
+  lock_chunks(sync, &hold, offset, offset + size, false);
+  pthread_rwlock_rdlock(&sync->table_lock);
+
+  pthread_mutex_lock(&sync->size_lock);
+  off_t file_size = this->size;
+  pthread_mutex_unlock(&sync->size_lock);
+
+  if (offset >= file_size) {
+    size = 0;
+  } else if ((off_t)size > file_size - offset) {
+    size = file_size - offset;
+  }
+
+  copy_out(GetKFSFile(this)->chunks, buf, size, offset);
+
+  pthread_rwlock_unlock(&sync->table_lock);
+  kfs_range_unlock(&sync->ranges, &hold);
+  return size;
+}
+
+void kfs_truncate(KFS_Entry *this, off_t size) {
+  assert_is_file(this);
+  KFS_FileSync *sync = file_sync(this);
+  KFS_RangeHold hold;
+
+  kfs_range_lock(&sync->ranges, &hold, 0, KFS_RANGE_EOF, true);
+  pthread_rwlock_wrlock(&sync->table_lock);
+
+  off_t old_size = this->size;
+  if (size != old_size) {
+    KFS_Region *region = kfs_entry_home(this);
+    KFS_ChunkTable *table = own_table(region, GetKFSFile(this));
+    table_resize(region, table, ChunkCount(size));
+
+    // bytes past the end must read as zero if the file grows again
+    size_t at = size & (KFS_CHUNK_SIZE - 1);
+    size_t last = size >> KFS_CHUNK_SHIFT;
+    if (size < old_size && at != 0 && table->chunks[last] != NULL &&
+        at < table->chunks[last]->cap) {
+      KFS_Chunk *chunk = own_chunk(region, table, last, at);
+      memset(chunk->data + at, 0, chunk->cap - at);
+    }
+
+    pthread_mutex_lock(&sync->size_lock);
+    this->size = size;
+    kfs_entry_modified(this);
+    pthread_mutex_unlock(&sync->size_lock);
+
+    KFS_ShmView *view = atomic_load(&sync->shm);
+    if (view != NULL) {
+      kfs_shm_view_truncate(view, size);
+    }
+  }
+
+  pthread_rwlock_unlock(&sync->table_lock);
+  kfs_range_unlock(&sync->ranges, &hold);
+
+  if (size != old_size) {
+    kfs_usage_charge(this->prev, size - old_size, 0);
+  }
+}
+
+void kfs_clone(KFS_Entry *dst, KFS_Entry *src) {
+  assert_is_file(dst);
+  assert_is_file(src);
+  if (dst == src) {
+    return;
+  }
+
+  // chunks cannot be shared across regions: the region may go away first
+  if (kfs_entry_home(dst) != kfs_entry_home(src)) {
+    char *buf = xmalloc(KFS_CHUNK_SIZE);
+    kfs_truncate(dst, 0);
+    for (off_t off = 0; off < src->size; off += KFS_CHUNK_SIZE) {
+      size_t n = kfs_read(src, buf, KFS_CHUNK_SIZE, off);
+      kfs_write(dst, buf, n, off);
     }
+    free(buf);
+    return;
+  }
+
+  KFS_FileSync *dsync = file_sync(dst);
+  KFS_FileSync *ssync = file_sync(src);
+  KFS_RangeHold dhold, shold;
+
+  // holding src's whole range shared keeps its writers out, so its table
+  // stays put; lock in address order so opposite clones cannot deadlock
+  if (dsync < ssync) {
+    kfs_range_lock(&dsync->ranges, &dhold, 0, KFS_RANGE_EOF, true);
+    kfs_range_lock(&ssync->ranges, &shold, 0, KFS_RANGE_EOF, false);
+  } else {
+    kfs_range_lock(&ssync->ranges, &shold, 0, KFS_RANGE_EOF, false);
+    kfs_range_lock(&dsync->ranges, &dhold, 0, KFS_RANGE_EOF, true);
+  }
+  pthread_rwlock_wrlock(&dsync->table_lock);
+
+  KFS_ChunkTable *table = GetKFSFile(src)->chunks;
+  if (table != NULL) {
+    atomic_fetch_add(&table->refs, 1);
+  }
+  table_put(kfs_entry_home(dst), GetKFSFile(dst)->chunks);
+  GetKFSFile(dst)->chunks = table;
+
+  pthread_mutex_lock(&dsync->size_lock);
+  off_t old_size = dst->size;
+  dst->size = src->size;
+  kfs_entry_modified(dst);
+  pthread_mutex_unlock(&dsync->size_lock);
+
+  // readers ask for a view of the new data
+  KFS_ShmView *view = atomic_load(&dsync->shm);
+  if (view != NULL) {
+    kfs_shm_view_retire(view);
+  }
+
+  pthread_rwlock_unlock(&dsync->table_lock);
+  kfs_range_unlock(&ssync->ranges, &shold);
+  kfs_range_unlock(&dsync->ranges, &dhold);
+
+  if (dst->prev != NULL && dst->size != old_size) {
+    kfs_usage_charge(dst->prev, dst->size - old_size, 0);
   }
-  memcpy(file->data + offset, buf, size);
 }
 
-SizedData *kfs_read(KFS_Entry *this) {
+void kfs_file_release(KFS_Entry *this) {
   assert_is_file(this);
   KFS_File *file = GetKFSFile(this);
+  KFS_Region *region = kfs_entry_home(this);
+
+  table_put(region, file->chunks);
+  file->chunks = NULL;
+
+  KFS_FileSync *sync = atomic_load(&file->sync);
+  if (sync == NULL) {
+    return;
+  }
+
+  if (region != NULL) {
+    pthread_mutex_lock(&region->lock);
+    if (sync->prev != NULL) {
+      sync->prev->next = sync->next;
+    } else {
+      region->syncs = sync->next;
+    }
+    if (sync->next != NULL) {
+      sync->next->prev = sync->prev;
+    }
+    pthread_mutex_unlock(&region->lock);
+  }
+  sync_destroy(region, sync);
+  atomic_store(&file->sync, NULL);
+}
 
-  SizedData *sdata = new_SizedData();
-  sdata->data = file->data;
-  sdata->size = this->size;
+void kfs_file_release_region(KFS_Region *region) {
+  KFS_FileSync *sync = region->syncs;
+  while (sync != NULL) {
+    KFS_FileSync *next = sync->next;
+    sync_destroy(region, sync);
+    sync = next;
+  }
+  region->syncs = NULL;
+}
+
+int kfs_file_share(KFS_Entry *this) {
+  assert_is_file(this);
+  KFS_FileSync *sync = file_sync(this);
+  KFS_RangeHold hold;
+
+  // writers update the view before they unlock their range, so with the
+  // whole file held shared, nothing is missed while a new one is filled
+  kfs_range_lock(&sync->ranges, &hold, 0, KFS_RANGE_EOF, false);
+  KFS_ShmView *view = atomic_load(&sync->shm);
+  if (view == NULL || !atomic_load(&view->live)) {
+    pthread_rwlock_rdlock(&sync->table_lock);
+    pthread_mutex_lock(&sync->size_lock);
+    off_t size = this->size;
+    pthread_mutex_unlock(&sync->size_lock);
+
+    KFS_ShmView *fresh = kfs_shm_view_new(size);
+    if (fresh != NULL) {
+      copy_out(GetKFSFile(this)->chunks, kfs_shm_view_data(fresh), size, 0);
+      fresh->older = view;
+      // another reader may have shared it meanwhile
+      if (atomic_compare_exchange_strong(&sync->shm, &view, fresh)) {
+        view = fresh;
+      } else {
+        fresh->older = NULL;
+        kfs_shm_view_free(fresh);
+      }
+    } else {
+      view = NULL;
+    }
+    pthread_rwlock_unlock(&sync->table_lock);
+  }
 
-  return sdata;
+  int fd = view == NULL ? -1 : dup(view->fd);
+  int res = fd == -1 ? -errno : fd;
+  kfs_range_unlock(&sync->ranges, &hold);
+  return res;
 }
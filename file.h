@@ -2,9 +2,61 @@
 #define __FILE_HDEADER_INCLUDED__
 
 #include "kfs.h"
+#include <stdatomic.h>
+
+/*
+  File data lives in fixed-size chunks reached through a chunk table.  Both
+  are reference counted: a clone shares the whole table, and a writer first
+  takes a private copy of the table (pointers only) and then of each chunk it
+  touches, so only modified chunks are ever copied.  A NULL chunk, and any
+  byte past a chunk's capacity, reads as zero.
+*/
+
+#define KFS_CHUNK_SHIFT 16
+#define KFS_CHUNK_SIZE (1 << KFS_CHUNK_SHIFT)
+#define KFS_CHUNK_MIN_CAPACITY 64
+
+typedef struct {
+  _Atomic uint32_t refs;
+  uint32_t cap; // small files get a small last chunk
+  char data[];
+} KFS_Chunk;
+
+typedef struct KFS_ChunkTable {
+  _Atomic uint32_t refs;
+  size_t len;
+  size_t cap;
+  KFS_Chunk **chunks;
+} KFS_ChunkTable;
+
+/*
+  Concurrency: every operation takes a byte-range lock widened to whole
+  chunks, so reads and writes of disjoint chunks run in parallel.  The chunk
+  table is only replaced or reallocated under table_lock held exclusively,
+  which is rare because capacity grows geometrically; the size (and the
+  table length) change in a short size_lock critical section.
+*/
+typedef struct KFS_FileSync {
+  KFS_RangeLock ranges;
+  pthread_rwlock_t table_lock;
+  pthread_mutex_t size_lock;
+  struct KFS_ShmView *_Atomic shm; // NULL until shared, see shm.h
+  // in the region's list, for files whose memory comes from a region
+  struct KFS_FileSync *prev, *next;
+} KFS_FileSync;
 
 void kfs_write(KFS_Entry *this, const char *buf, long int size,
                long int offset);
-SizedData *kfs_read(KFS_Entry *this);
+// copies up to size bytes at offset into buf and returns how many
+size_t kfs_read(KFS_Entry *this, char *buf, size_t size, off_t offset);
+void kfs_truncate(KFS_Entry *this, off_t size);
+// make dst share src's data; O(1) regardless of size
+void kfs_clone(KFS_Entry *dst, KFS_Entry *src);
+void kfs_file_release(KFS_Entry *this);
+// tears down what files in region hold outside it (locks, shared views);
+// called before the region is destroyed along with their memory
+void kfs_file_release_region(KFS_Region *region);
+// a new fd of the file's shared view, made on first use, or -errno
+int kfs_file_share(KFS_Entry *this);
 
-#endif
\ No newline at end of file
+#endif
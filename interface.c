@@ -1,39 +1,168 @@
 #include "kfs.h"
+#include "kfs_ioctl.h"
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <fuse.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-#define DEBUG 0
+KFS_Entry *KFS_ROOT;
 
-#if DEBUG
-#define USER_HOME_DIR "/home/alphakai/"
-#define KFS_DIR "Nextcloud/kernel_hacking/filesystem/fuse/kfs/"
-#define LOG_OUTPUT_BASE_DIR USER_HOME_DIR KFS_DIR
-#define DEBUG_CODE(code) code
-#else
-#define DEBUG_CODE(code)
-#endif
+/*
+  Namespace lock.  Operations that only look entries up hold it shared;
+  anything that links or unlinks entries holds it exclusively.  Once an
+  exclusive holder has detached a subtree, no other operation can still be
+  holding a pointer into it, so the reclaimer may free it without further
+  synchronization.
+*/
+static pthread_rwlock_t kfs_ns_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/*
+  Every operation goes through one of these wrappers, which also time,
+  count, trace and capture it (see stats.h, perf.h, trace.h and capture.h)
+  and route paths inside KFS_STATS_DIR to virt instead.  io is the
+  (offset, size) a trace records.
+*/
+#define KFS_NS_OP(kind, name, params, args, virt, io)                          \
+  static int ns_##name params {                                                \
+    const char *path_ = KFS_PATH_OF args;                                      \
+    KFS_TraceSpan span;                                                        \
+    kfs_trace_begin(&span);                                                    \
+    KFS_PROBE2(op__entry, KFS_OP_##name, path_);                               \
+    uint64_t start = kfs_stats_now();                                          \
+    KFS_PerfSpan perf;                                                         \
+    kfs_perf_begin(&perf);                                                     \
+    int res;                                                                   \
+    if (kfs_stats_path(path_)) {                                               \
+      res = virt args;                                                         \
+    } else {                                                                   \
+      pthread_rwlock_##kind##lock(&kfs_ns_lock);                               \
+      res = itf_fuse_kfs_##name args;                                          \
+      pthread_rwlock_unlock(&kfs_ns_lock);                                     \
+      if (atomic_load_explicit(&kfs_capture_on, memory_order_relaxed)) {       \
+        KFS_CaptureArgs capture_ = KFS_CAPTURE_##name args;                    \
+        kfs_capture(KFS_OP_##name, path_, &capture_, start, res);              \
+      }                                                                        \
+    }                                                                          \
+    kfs_perf_end(&perf, KFS_OP_##name);                                        \
+    kfs_stats_record(KFS_OP_##name, start, res);                               \
+    KFS_PROBE3(op__return, KFS_OP_##name, path_, res);                         \
+    kfs_trace_end(&span, KFS_OP_##name, path_, KFS_IO io, res);                \
+    return res;                                                                \
+  }
+#define KFS_PATH_OF(...) KFS_PATH_OF_(__VA_ARGS__, 0)
+#define KFS_PATH_OF_(path, ...) path
+#define KFS_IO(offset, size) (int64_t)(offset), (uint64_t)(size)
+#define KFS_NO_IO (0, 0)
+
+KFS_NS_OP(rd, getattr, (const char *path, struct stat *stbuf), (path, stbuf),
+          kfs_stats_getattr, KFS_NO_IO)
+KFS_NS_OP(rd, readdir,
+          (const char *path, void *buf, fuse_fill_dir_t filler, off_t offset,
+           struct fuse_file_info *fi),
+          (path, buf, filler, offset, fi), kfs_stats_readdir, KFS_NO_IO)
+KFS_NS_OP(rd, open, (const char *path, struct fuse_file_info *fi), (path, fi),
+          kfs_stats_open, KFS_NO_IO)
+KFS_NS_OP(rd, read,
+          (const char *path, char *buf, size_t size, off_t offset,
+           struct fuse_file_info *fi),
+          (path, buf, size, offset, fi), kfs_stats_read, (offset, size))
+KFS_NS_OP(rd, release, (const char *path, struct fuse_file_info *fi),
+          (path, fi), kfs_stats_release, KFS_NO_IO)
+KFS_NS_OP(wr, mkdir, (const char *path, mode_t mode), (path, mode),
+          KFS_STATS_ROFS, KFS_NO_IO)
+KFS_NS_OP(rd, access, (const char *path, int mode), (path, mode),
+          kfs_stats_access, KFS_NO_IO)
+KFS_NS_OP(wr, create,
+          (const char *path, mode_t mode, struct fuse_file_info *fi),
+          (path, mode, fi), KFS_STATS_ROFS, KFS_NO_IO)
+KFS_NS_OP(rd, utimens, (const char *path, const struct timespec tv[2]),
+          (path, tv), KFS_STATS_ROFS, KFS_NO_IO)
+KFS_NS_OP(wr, unlink, (const char *path), (path), KFS_STATS_ROFS, KFS_NO_IO)
+KFS_NS_OP(wr, rmdir, (const char *path), (path), KFS_STATS_ROFS, KFS_NO_IO)
+KFS_NS_OP(wr, rename, (const char *from, const char *to), (from, to),
+          KFS_STATS_ROFS, KFS_NO_IO)
+KFS_NS_OP(rd, chmod, (const char *path, mode_t mode), (path, mode),
+          KFS_STATS_ROFS, KFS_NO_IO)
+KFS_NS_OP(rd, chown, (const char *path, uid_t uid, gid_t gid),
+          (path, uid, gid), KFS_STATS_ROFS, KFS_NO_IO)
+KFS_NS_OP(rd, truncate, (const char *path, off_t size), (path, size),
+          KFS_STATS_ROFS, (size, 0))
+// setxattr can remove whole subtrees (XATTR_RMTREE)
+KFS_NS_OP(wr, setxattr,
+          (const char *path, const char *name, const char *value, size_t size,
+           int flags),
+          (path, name, value, size, flags), KFS_STATS_ROFS, KFS_NO_IO)
+// a clone replaces the destination's data
+KFS_NS_OP(wr, ioctl,
+          (const char *path, int cmd, void *arg, struct fuse_file_info *fi,
+           unsigned int flags, void *data),
+          (path, cmd, arg, fi, flags, data), KFS_STATS_ROFS, KFS_NO_IO)
+KFS_NS_OP(rd, getxattr,
+          (const char *path, const char *name, char *value, size_t size),
+          (path, name, value, size), KFS_STATS_NODATA, KFS_NO_IO)
+
+// write creates missing files, which needs the exclusive lock
+static int ns_write(const char *path, const char *buf, size_t size,
+                    off_t offset, struct fuse_file_info *fi) {
+  KFS_TraceSpan span;
+  kfs_trace_begin(&span);
+  KFS_PROBE2(op__entry, KFS_OP_write, path);
+  uint64_t start = kfs_stats_now();
+  KFS_PerfSpan perf;
+  kfs_perf_begin(&perf);
+  int res = -EROFS;
+
+  if (!kfs_stats_path(path)) {
+    sds spath = sdsnew(path);
+    pthread_rwlock_rdlock(&kfs_ns_lock);
+    bool exists = kfs_find(KFS_ROOT, spath) != NULL;
+    if (!exists) {
+      pthread_rwlock_unlock(&kfs_ns_lock);
+      pthread_rwlock_wrlock(&kfs_ns_lock);
+    }
+    res = itf_fuse_kfs_write(path, buf, size, offset, fi);
+    pthread_rwlock_unlock(&kfs_ns_lock);
+    sdsfree(spath);
+    if (atomic_load_explicit(&kfs_capture_on, memory_order_relaxed)) {
+      KFS_CaptureArgs capture = KFS_CAPTURE_write(path, buf, size, offset, fi);
+      kfs_capture(KFS_OP_write, path, &capture, start, res);
+    }
+  }
 
-KFS_Entry *KFS_ROOT;
+  kfs_perf_end(&perf, KFS_OP_write);
+  kfs_stats_record(KFS_OP_write, start, res);
+  KFS_PROBE3(op__return, KFS_OP_write, path, res);
+  kfs_trace_end(&span, KFS_OP_write, path, offset, size, res);
+  return res;
+}
 
-struct fuse_operations kfs_ops = {.getattr = itf_fuse_kfs_getattr,
-                                  .readdir = itf_fuse_kfs_readdir,
-                                  .open = itf_fuse_kfs_open,
-                                  .read = itf_fuse_kfs_read,
-                                  .write = itf_fuse_kfs_write,
-                                  .mkdir = itf_fuse_kfs_mkdir,
-                                  .access = itf_fuse_kfs_access,
-                                  .create = itf_fuse_kfs_create,
-                                  .utimens = itf_fuse_kfs_utimens,
-                                  .unlink = itf_fuse_kfs_unlink,
-                                  .chmod = itf_fuse_kfs_chmod,
-                                  .truncate = itf_fuse_kfs_truncate};
+struct fuse_operations kfs_ops = {.getattr = ns_getattr,
+                                  .readdir = ns_readdir,
+                                  .open = ns_open,
+                                  .read = ns_read,
+                                  .write = ns_write,
+                                  .release = ns_release,
+                                  .mkdir = ns_mkdir,
+                                  .access = ns_access,
+                                  .create = ns_create,
+                                  .utimens = ns_utimens,
+                                  .unlink = ns_unlink,
+                                  .rmdir = ns_rmdir,
+                                  .rename = ns_rename,
+                                  .chmod = ns_chmod,
+                                  .chown = ns_chown,
+                                  .truncate = ns_truncate,
+                                  .setxattr = ns_setxattr,
+                                  .getxattr = ns_getxattr,
+                                  .ioctl = ns_ioctl,
+                                  .init = itf_fuse_kfs_init,
+                                  .destroy = itf_fuse_kfs_destroy};
 
 void kfs_init(void) {
   KFS_ROOT = new_KFS_Dir(sdsnew("/"));
@@ -46,69 +175,59 @@ void kfs_init(void) {
   */
 }
 
-#define CheckEntryReadPermission(path)                                         \
-  {                                                                            \
-    int access_check = itf_fuse_kfs_access(path, R_OK);                        \
-    if (access_check != 0) {                                                   \
-      return access_check;                                                     \
-    }                                                                          \
+// background services; started in order once the mount is up, stopped
+// (each draining its queue) in reverse order at unmount
+static const struct {
+  void (*start)(void);
+  void (*stop)(void);
+} kfs_services[] = {
+    {kfs_reclaim_start, kfs_reclaim_stop},
+    {kfs_notify_start, kfs_notify_stop},
+    {kfs_capture_service_start, kfs_capture_stop},
+    {kfs_share_service_start, kfs_share_stop},
+};
+
+#define KFS_SERVICE_COUNT (sizeof(kfs_services) / sizeof(kfs_services[0]))
+
+// services have to start after fuse_main has daemonized
+void *itf_fuse_kfs_init(struct fuse_conn_info *conn) {
+  kfs_session_init_conn(conn);
+#ifdef FUSE_CAP_AUTO_INVAL_DATA
+  // drop cached pages when a re-looked-up file has a new mtime
+  conn->want |= conn->capable & FUSE_CAP_AUTO_INVAL_DATA;
+#endif
+  for (size_t i = 0; i < KFS_SERVICE_COUNT; i++) {
+    kfs_services[i].start();
   }
+  return NULL;
+}
 
-typedef struct {
-  KFS_Entry *parent;
-  sds lastname;
-} DownToResult;
-
-DownToResult downToLast(sds spath) {
-  DownToResult dtr;
-
-  KFS_Entry *parent = KFS_ROOT;
-  Vector *paths = sdssplitvec(spath, '/');
-  for (size_t i = 0; i < paths->len - 1; i++) {
-    parent = kfs_find_on(parent, paths->data[i]);
+void itf_fuse_kfs_destroy(void *private_data) {
+  (void)private_data;
+  for (size_t i = KFS_SERVICE_COUNT; i-- > 0;) {
+    kfs_services[i].stop();
   }
+}
 
-  dtr.parent = parent;
-  dtr.lastname = paths->data[paths->len - 1];
-  return dtr;
+int kfs_ns_share(const char *path) {
+  pthread_rwlock_rdlock(&kfs_ns_lock);
+  int res = kfs_path_share(KFS_ROOT, path);
+  pthread_rwlock_unlock(&kfs_ns_lock);
+  return res;
 }
 
 int itf_fuse_kfs_getattr(const char *path, struct stat *stbuf) {
-  int res = 0;
-  sds spath = sdsnew(path);
-  KFS_Entry *entry = kfs_find(KFS_ROOT, spath);
-
-  DEBUG_CODE(FILE * fp;);
-  DEBUG_CODE({
-    fp = fopen(LOG_OUTPUT_BASE_DIR "log_getattr", "w");
-    if (fp) {
-      fprintf(fp, "path: %s\n", path);
-      fprintf(fp, "spath: %s\n", spath);
-      fprintf(fp, "entry is null?: %s\n", entry == NULL ? "yes" : "no");
-      fprintf(fp, "keys...\n");
-      Vector *vtree = kfs_getTree(KFS_ROOT);
-      VecForeach(vtree, elem, { fprintf(fp, "elem - %s\n", (sds)elem); });
-    }
-  });
-
-  if (entry == NULL) {
-    res = -ENOENT;
-  } else {
-    stbuf->st_mode = entry->mode;
-    stbuf->st_nlink = entry->nlink;
-    stbuf->st_size = entry->size;
-    stbuf->st_uid = entry->uid;
-    stbuf->st_gid = entry->gid;
-  }
+  return kfs_path_stat(KFS_ROOT, path, stbuf);
+}
 
-  DEBUG_CODE({
-    if (fp) {
-      fclose(fp);
-    }
-  });
+typedef struct {
+  void *buf;
+  fuse_fill_dir_t filler;
+} FuseFill;
 
-  sdsfree(spath);
-  return res;
+static int fill_fuse(void *arg, const char *name) {
+  FuseFill *fill = arg;
+  return fill->filler(fill->buf, name, NULL, 0);
 }
 
 int itf_fuse_kfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
@@ -116,367 +235,302 @@ int itf_fuse_kfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
   (void)offset;
   (void)fi;
 
-  DEBUG_CODE(FILE * fp);
-  DEBUG_CODE({
-    fp = fopen(LOG_OUTPUT_BASE_DIR "log_readdir", "w");
-    if (fp != NULL) {
-      fprintf(fp, "path: %s\n", path);
-    }
-  });
-
-  CheckEntryReadPermission(path);
-
-  int res = 0;
-  sds spath = sdsnew(path);
-  KFS_Entry *entry = kfs_find(KFS_ROOT, spath);
-
-  if (entry == NULL) {
-    res = -ENOENT;
-  } else if (EntryIsFile(entry)) {
-    filler(buf, entry->name, NULL, 0);
-  } else {
-    Vector *elems = kfs_getCurrentList(entry);
-
-    VecForeach(elems, elem, { filler(buf, (sds)elem, NULL, 0); });
-    DEBUG_CODE({
-      VecForeach(elems, elem, { fprintf(fp, "elem - %s\n", (sds)elem); });
-    });
-
-    // TODO: free elems
+  FuseFill fill = {buf, filler};
+  int res = kfs_path_readdir(KFS_ROOT, path, fill_fuse, &fill);
+  if (res == 0 && strcmp(path, "/") == 0) {
+    filler(buf, KFS_STATS_NAME, NULL, 0);
   }
-
-  DEBUG_CODE({
-    if (fp)
-      fclose(fp);
-  });
-
-  sdsfree(spath);
   return res;
 }
 
 int itf_fuse_kfs_open(const char *path, struct fuse_file_info *fi) {
-  int access_check = itf_fuse_kfs_access(path, fi->flags);
+  int access_check = kfs_path_access(KFS_ROOT, path, fi->flags);
   if (access_check != 0) {
     return access_check;
   }
 
-  int res = 0;
-  sds spath = sdsnew(path);
-  KFS_Entry *entry = kfs_find(KFS_ROOT, spath);
-
-  DEBUG_CODE(FILE * fp;);
-  DEBUG_CODE({
-    fp = fopen(LOG_OUTPUT_BASE_DIR "log_open", "w");
-    if (fp != NULL) {
-      fprintf(fp, "path: %s\n", path);
-      fclose(fp);
-    }
-  });
-
-  if (entry == NULL) {
-    res = -ENOENT;
+  KFS_Entry *entry = kfs_path_lookup(KFS_ROOT, path);
+  if (EntryIsFile(entry)) {
+    kfs_cache_open(entry, fi);
   }
-
-  sdsfree(spath);
-  return res;
+  return 0;
 }
 
 int itf_fuse_kfs_read(const char *path, char *buf, size_t size, off_t offset,
                       struct fuse_file_info *fi) {
   (void)fi;
-
-  DEBUG_CODE(FILE * fp;);
-  DEBUG_CODE({
-    fp = fopen(LOG_OUTPUT_BASE_DIR "log_read", "w");
-    if (fp != NULL) {
-      fprintf(fp, "path: %s\n", path);
-      fclose(fp);
-    }
-  });
-
-  CheckEntryReadPermission(path);
-
-  int res = 0;
-  sds spath = sdsnew(path);
-  KFS_Entry *entry = kfs_find(KFS_ROOT, spath);
-
-  if (entry == NULL) {
-    res = -ENOENT;
-  } else {
-    SizedData *sdata = kfs_read(entry);
-    size_t len = sdata->size;
-
-    if (offset < (off_t)len) {
-      if (offset + size > len) {
-        size = len - offset;
-      }
-      memcpy(buf, sdata->data, size);
-      res = size;
-    } else {
-      res = 0;
-    }
-  }
-
-  sdsfree(spath);
-  return res;
+  return kfs_path_read(KFS_ROOT, path, buf, size, offset);
 }
 
 int itf_fuse_kfs_write(const char *path, const char *buf, size_t size,
                        off_t offset, struct fuse_file_info *fi) {
   (void)fi;
-  sds spath = sdsnew(path);
-
-  int access_check = itf_fuse_kfs_access(path, W_OK);
-  if (access_check != 0) {
-    if (access_check != -ENOENT) { // fail
-      sdsfree(spath);
-      return access_check;
-    } else {
-      // check parent
-      DownToResult dtr = downToLast(spath);
-      sds parent_path = kfs_getPwd(dtr.parent);
-      access_check = itf_fuse_kfs_access(parent_path, W_OK);
+  return kfs_path_write(KFS_ROOT, path, buf, size, offset);
+}
 
-      if (access_check != 0) {
-        return access_check;
-      }
-    }
-  }
+int itf_fuse_kfs_mkdir(const char *path, mode_t mode) {
+  return kfs_path_mkdir(KFS_ROOT, path, mode);
+}
 
-  int res = 0;
-  KFS_Entry *entry = kfs_find(KFS_ROOT, spath);
+int itf_fuse_kfs_access(const char *path, int mode) {
+  return kfs_path_access(KFS_ROOT, path, mode);
+}
 
-  if (entry == NULL) {
-    // create a file
-    itf_fuse_kfs_create(path, 444, NULL);
-    entry = kfs_find(KFS_ROOT, spath);
+int itf_fuse_kfs_create(const char *path, mode_t mode,
+                        struct fuse_file_info *fi) {
+  KFS_Entry *created;
+  int res = kfs_path_create(KFS_ROOT, path, mode, &created);
+  if (res == 0 && fi != NULL) {
+    kfs_cache_open(created, fi);
   }
+  return res;
+}
 
-  kfs_write(entry, buf, size, offset);
-  res = size;
+int itf_fuse_kfs_unlink(const char *path) {
+  return kfs_path_unlink(KFS_ROOT, path);
+}
 
-  sdsfree(spath);
-  return res;
+int itf_fuse_kfs_rmdir(const char *path) {
+  return kfs_path_rmdir(KFS_ROOT, path);
 }
 
-int itf_fuse_kfs_mkdir(const char *path, mode_t mode) {
-  int res = 0;
-  sds spath = sdsnew(path);
-  KFS_Entry *entry = kfs_find(KFS_ROOT, spath);
+int itf_fuse_kfs_rename(const char *from, const char *to) {
+  if (kfs_stats_path(to)) {
+    return kfs_path_lookup(KFS_ROOT, from) == NULL ? -ENOENT : -EROFS;
+  }
+  return kfs_path_rename(KFS_ROOT, from, to);
+}
 
-  DEBUG_CODE(FILE * fp;);
-  DEBUG_CODE({
-    fp = fopen(LOG_OUTPUT_BASE_DIR "log_mkdir", "w");
-    if (fp != NULL) {
-      fprintf(fp, "path: %s\n", path);
-    }
-  });
+int itf_fuse_kfs_release(const char *path, struct fuse_file_info *fi) {
+  (void)path;
+  (void)fi;
+  return 0;
+}
 
-  if (entry != NULL) {
-    res = -EEXIST;
-  } else {
-    DownToResult dtr = downToLast(spath);
-    KFS_Entry *parent = dtr.parent;
-    sds target = dtr.lastname;
+int itf_fuse_kfs_utimens(const char *path, const struct timespec tv[2]) {
+  return kfs_path_utimens(KFS_ROOT, path, tv);
+}
 
-    KFS_Entry *new_dir = new_KFS_Dir(target);
-    new_dir->mode = mode | S_IFDIR;
-    kfs_append_child(parent, new_dir);
-  }
+int itf_fuse_kfs_chmod(const char *path, mode_t mode) {
+  return kfs_path_chmod(KFS_ROOT, path, mode);
+}
 
-  DEBUG_CODE({
-    if (fp)
-      fclose(fp);
-  });
+int itf_fuse_kfs_chown(const char *path, uid_t uid, gid_t gid) {
+  return kfs_path_chown(KFS_ROOT, path, uid, gid);
+}
 
-  sdsfree(spath);
-  return res;
+int itf_fuse_kfs_truncate(const char *path, off_t size) {
+  return kfs_path_truncate(KFS_ROOT, path, size);
 }
 
-int itf_fuse_kfs_access(const char *path, int mode) {
+#define XATTR_QUOTA_BYTES "user.kfs.quota.bytes"
+#define XATTR_QUOTA_INODES "user.kfs.quota.inodes"
+#define XATTR_USAGE_BYTES "user.kfs.usage.bytes"
+#define XATTR_USAGE_INODES "user.kfs.usage.inodes"
+// write-only: the value names a child of the directory to remove recursively
+#define XATTR_RMTREE "user.kfs.rmtree"
+// set on an empty directory to make it a scratch directory (see region.h)
+#define XATTR_SCRATCH "user.kfs.scratch"
+// page cache policy of a file or subtree (see cache.h)
+#define XATTR_CACHE "user.kfs.cache"
+// "1" or "0" on the root turns tracing on or off (see trace.h)
+#define XATTR_TRACE "user.kfs.trace"
+// "1" or "0" on the root turns hardware counters on or off (see perf.h)
+#define XATTR_PERF "user.kfs.perf"
+
+int itf_fuse_kfs_setxattr(const char *path, const char *name,
+                          const char *value, size_t size, int flags) {
+  (void)flags;
   int res = 0;
   sds spath = sdsnew(path);
   KFS_Entry *entry = kfs_find(KFS_ROOT, spath);
 
-  DEBUG_CODE(FILE * fp;);
-  DEBUG_CODE({
-    fp = fopen(LOG_OUTPUT_BASE_DIR "log_access", "w");
-    if (fp != NULL) {
-      fprintf(fp, "path: %s\n", path);
-      fclose(fp);
-    }
-  });
-
   if (entry == NULL) {
     res = -ENOENT;
-  } else {
-    if (mode == F_OK) {
-      res = 0;
-      goto RETURN;
+  } else if (strcmp(name, XATTR_QUOTA_BYTES) == 0 ||
+             strcmp(name, XATTR_QUOTA_INODES) == 0) {
+    if (!EntryIsDir(entry)) {
+      res = -ENOTDIR;
+    } else {
+      char buf[32];
+      if (size >= sizeof(buf)) {
+        res = -ERANGE;
+      } else {
+        memcpy(buf, value, size);
+        buf[size] = '\0';
+        int64_t limit;
+
+        if (!kfs_usage_parse_quota(buf, &limit)) {
+          res = -EINVAL;
+        } else {
+          if (strcmp(name, XATTR_QUOTA_BYTES) == 0) {
+            kfs_usage_set_quota(entry, limit, entry->usage.quota_inodes);
+          } else {
+            kfs_usage_set_quota(entry, entry->usage.quota_bytes, limit);
+          }
+          kfs_entry_changed(entry);
+        }
+      }
     }
-
-    uid_t uid = getuid();
-    gid_t gid = getgid();
-
-    int target;
-
-    if (entry->uid == uid) {
-      // left 3bit
-      target = entry->mode >> 6;
-    } else if (entry->gid == gid) {
-      // middle 3 bit
-      target = (entry->mode & 0b111000) >> 3;
+  } else if (strcmp(name, XATTR_SCRATCH) == 0) {
+    if (!EntryIsDir(entry)) {
+      res = -ENOTDIR;
+    } else if (GetAVLTree(entry)->size > 0) {
+      res = -ENOTEMPTY;
+    } else if (!kfs_is_scratch(entry) && !kfs_scratch_enable(entry)) {
+      res = -EINVAL; // already inside a scratch directory
     } else {
-      // right 3 bit
-      target = (entry->mode & 0b111);
+      kfs_entry_changed(entry);
     }
-
-    if (mode & R_OK) {
-      if ((target & R_OK) == 0) {
-        goto FAIL;
-      }
+  } else if (strcmp(name, XATTR_CACHE) == 0) {
+    int policy = kfs_cache_policy_of(value, size);
+    if (policy == -1) {
+      res = -EINVAL;
+    } else {
+      entry->cache_policy = policy;
+      kfs_entry_changed(entry);
     }
-
-    if (mode & W_OK) {
-      if ((target & W_OK) == 0) {
-        goto FAIL;
-      }
+  } else if (strcmp(name, XATTR_TRACE) == 0) {
+    if (entry != KFS_ROOT) {
+      res = -EINVAL;
+    } else if (size == 1 && (value[0] == '0' || value[0] == '1')) {
+      kfs_trace_enable(value[0] == '1');
+    } else {
+      res = -EINVAL;
     }
-
-    if (mode & X_OK) {
-      if ((target & X_OK) == 0) {
-        goto FAIL;
-      }
+  } else if (strcmp(name, XATTR_PERF) == 0) {
+    if (entry != KFS_ROOT) {
+      res = -EINVAL;
+    } else if (size == 1 && (value[0] == '0' || value[0] == '1')) {
+      res = kfs_perf_enable(value[0] == '1') ? 0 : -ENOTSUP;
+    } else {
+      res = -EINVAL;
     }
-
-    goto RETURN;
-
-  FAIL:
-    res = -EACCES;
-  }
-
-RETURN:
-
-  sdsfree(spath);
-  return res;
-}
-
-// TODO: Permission check
-int itf_fuse_kfs_create(const char *path, mode_t mode,
-                        struct fuse_file_info *fi) {
-  (void)fi;
-  int res = 0;
-  sds spath = sdsnew(path);
-  KFS_Entry *entry = kfs_find(KFS_ROOT, spath);
-
-  DEBUG_CODE(FILE * fp;);
-  DEBUG_CODE({
-    fp = fopen(LOG_OUTPUT_BASE_DIR "log_create", "w");
-    if (fp != NULL) {
-      fprintf(fp, "path: %s\n", path);
-      fclose(fp);
+  } else if (strcmp(name, XATTR_RMTREE) == 0) {
+    if (!EntryIsDir(entry)) {
+      res = -ENOTDIR;
+    } else {
+      sds target = sdsnewlen(value, size);
+      if (sdslen(target) == 0 || strchr(target, '/') != NULL) {
+        res = -EINVAL;
+      } else if (!kfs_remove_tree(entry, target)) {
+        res = -ENOENT;
+      } else {
+        // the kernel only knows that an xattr was set
+        sds removed = sdscatprintf(sdsempty(), "%s/%s",
+                                   strcmp(path, "/") == 0 ? "" : path, target);
+        kfs_notify_path(removed);
+        sdsfree(removed);
+      }
+      sdsfree(target);
     }
-  });
-
-  if (entry != NULL) {
-    res = -EEXIST;
   } else {
-    DownToResult dtr = downToLast(spath);
-    KFS_Entry *parent = dtr.parent;
-    sds target = dtr.lastname;
-
-    KFS_Entry *new_file = new_KFS_File(target);
-    new_file->mode = mode | S_IFREG;
-    kfs_append_child(parent, new_file);
+    res = -ENOTSUP;
   }
 
   sdsfree(spath);
   return res;
 }
 
-int itf_fuse_kfs_unlink(const char *path) {
+int itf_fuse_kfs_getxattr(const char *path, const char *name, char *value,
+                          size_t size) {
   int res = 0;
   sds spath = sdsnew(path);
   KFS_Entry *entry = kfs_find(KFS_ROOT, spath);
 
   if (entry == NULL) {
     res = -ENOENT;
+  } else if (strcmp(name, XATTR_CACHE) == 0) {
+    const char *policy = kfs_cache_policy_name(kfs_cache_effective(entry));
+    size_t len = strlen(policy);
+    if (size == 0) {
+      res = len;
+    } else if (len > size) {
+      res = -ERANGE;
+    } else {
+      memcpy(value, policy, len);
+      res = len;
+    }
+  } else if (!EntryIsDir(entry)) {
+    res = -ENODATA;
   } else {
-    DownToResult dtr = downToLast(spath);
-    KFS_Entry *parent = dtr.parent;
-    sds target = dtr.lastname;
-
-    avl_delete(GetAVLTree(parent), target, path_cmp);
-  }
-
-  sdsfree(spath);
-  return res;
-}
-
-int itf_fuse_kfs_utimens(const char *path, const struct timespec tv[2]) {
-  int res = 0;
-  sds spath = sdsnew(path);
-  KFS_Entry *entry = kfs_find(KFS_ROOT, spath);
+    KFS_UsageStat st = kfs_usage_get(entry);
+    int64_t v;
+
+    if (strcmp(name, XATTR_QUOTA_BYTES) == 0) {
+      v = entry->usage.quota_bytes;
+    } else if (strcmp(name, XATTR_QUOTA_INODES) == 0) {
+      v = entry->usage.quota_inodes;
+    } else if (strcmp(name, XATTR_USAGE_BYTES) == 0) {
+      v = st.bytes;
+    } else if (strcmp(name, XATTR_USAGE_INODES) == 0) {
+      v = st.inodes;
+    } else if (strcmp(name, XATTR_SCRATCH) == 0 && kfs_is_scratch(entry)) {
+      v = entry->region->reserved;
+    } else if (strcmp(name, XATTR_TRACE) == 0 && entry == KFS_ROOT) {
+      v = atomic_load(&kfs_trace_on);
+    } else if (strcmp(name, XATTR_PERF) == 0 && entry == KFS_ROOT) {
+      v = atomic_load(&kfs_perf_on);
+    } else {
+      res = -ENODATA;
+    }
 
-  if (entry == NULL) {
-    res = -ENOENT;
-  } else {
-    entry->atime = tv[0];
-    entry->mtime = tv[1];
+    if (res == 0) {
+      char buf[32];
+      int len = snprintf(buf, sizeof(buf), "%lld", (long long)v);
+      if (size == 0) {
+        res = len;
+      } else if ((size_t)len > size) {
+        res = -ERANGE;
+      } else {
+        memcpy(value, buf, len);
+        res = len;
+      }
+    }
   }
 
   sdsfree(spath);
   return res;
 }
 
-int itf_fuse_kfs_chmod(const char *path, mode_t mode) {
-  int res = 0;
-  sds spath = sdsnew(path);
-  KFS_Entry *entry = kfs_find(KFS_ROOT, spath);
+int itf_fuse_kfs_ioctl(const char *path, int cmd, void *arg,
+                       struct fuse_file_info *fi, unsigned int flags,
+                       void *data) {
+  (void)arg;
+  (void)fi;
 
-  if (entry == NULL) {
-    res = -ENOENT;
-  } else {
-    entry->mode = mode | (EntryIsFile(entry) ? S_IFREG : S_IFDIR);
+  if (flags & FUSE_IOCTL_COMPAT) {
+    return -ENOSYS;
   }
-
-  sdsfree(spath);
-  return res;
-}
-
-int itf_fuse_kfs_chown(const char *path, uid_t uid, gid_t gid) {
-  int res = 0;
-  sds spath = sdsnew(path);
-  KFS_Entry *entry = kfs_find(KFS_ROOT, spath);
-
-  if (entry == NULL) {
-    res = -ENOENT;
-  } else {
-    entry->uid = uid;
-    entry->gid = gid;
+  if ((unsigned int)cmd != KFS_IOC_CLONE) {
+    return -ENOTTY;
   }
 
-  sdsfree(spath);
-  return res;
-}
+  struct kfs_ioc_clone *req = data;
+  req->src[KFS_IOC_PATH_MAX - 1] = '\0';
 
-int itf_fuse_kfs_truncate(const char *path, off_t size) {
   int res = 0;
   sds spath = sdsnew(path);
-  KFS_Entry *entry = kfs_find(KFS_ROOT, spath);
+  sds ssrc = req->src[0] == '/' ? sdsnew(req->src)
+                                : sdscatprintf(sdsempty(), "/%s", req->src);
+  KFS_Entry *dst = kfs_find(KFS_ROOT, spath);
+  KFS_Entry *src = kfs_find(KFS_ROOT, ssrc);
 
-  if (entry == NULL) {
+  if (dst == NULL || src == NULL) {
     res = -ENOENT;
+  } else if (EntryIsDir(dst) || EntryIsDir(src)) {
+    res = -EISDIR;
   } else {
-    if (EntryIsFile(entry)) {
-      KFS_File *file = GetKFSFile(entry);
-      file->data = realloc(file->data, size);
-      entry->size = size;
-    } else {
-      res = -EISDIR;
+    off_t growth = src->size - dst->size;
+    if (growth <= 0 || (res = kfs_usage_check(dst->prev, growth, 0)) == 0) {
+      kfs_clone(dst, src);
+      // the ioctl reply carries no attributes, so the kernel would keep
+      // serving dst's old size and pages
+      kfs_notify_path(path);
     }
   }
 
   sdsfree(spath);
+  sdsfree(ssrc);
   return res;
 }
@@ -1,6 +1,6 @@
 #ifndef __INTERFACE_HEADER_INCLUDED__
 #define __INTERFACE_HEADER_INCLUDED__
-#define FUSE_USE_VERSION 26
+#define FUSE_USE_VERSION 28
 
 #include "kfs.h"
 #include <fuse.h>
@@ -14,6 +14,7 @@ int itf_fuse_kfs_read(const char *path, char *buf, size_t size, off_t offset,
                       struct fuse_file_info *fi);
 int itf_fuse_kfs_write(const char *path, const char *buf, size_t size,
                        off_t offset, struct fuse_file_info *fi);
+int itf_fuse_kfs_release(const char *path, struct fuse_file_info *fi);
 
 int itf_fuse_kfs_mkdir(const char *path, mode_t mode);
 int itf_fuse_kfs_access(const char *path, int mode);
@@ -21,13 +22,27 @@ int itf_fuse_kfs_create(const char *path, mode_t mode,
                         struct fuse_file_info *fi);
 int itf_fuse_kfs_utimens(const char *path, const struct timespec tv[2]);
 int itf_fuse_kfs_unlink(const char *path);
+int itf_fuse_kfs_rmdir(const char *path);
+int itf_fuse_kfs_rename(const char *from, const char *to);
 int itf_fuse_kfs_chmod(const char *path, mode_t mode);
-// int (*chown) (const char *, uid_t, gid_t);
+int itf_fuse_kfs_chown(const char *path, uid_t uid, gid_t gid);
 int itf_fuse_kfs_truncate(const char *path, off_t size);
+int itf_fuse_kfs_setxattr(const char *path, const char *name,
+                          const char *value, size_t size, int flags);
+int itf_fuse_kfs_getxattr(const char *path, const char *name, char *value,
+                          size_t size);
+int itf_fuse_kfs_ioctl(const char *path, int cmd, void *arg,
+                       struct fuse_file_info *fi, unsigned int flags,
+                       void *data);
+
+void *itf_fuse_kfs_init(struct fuse_conn_info *conn);
+void itf_fuse_kfs_destroy(void *private_data);
 
 extern struct fuse_operations kfs_ops;
 extern KFS_Entry *KFS_ROOT;
 
 void kfs_init(void);
+// a new fd of path's shared view (shm.h), under the namespace lock
+int kfs_ns_share(const char *path);
 
 #endif
\ No newline at end of file
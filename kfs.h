@@ -11,8 +11,18 @@
 ///////////////   Vector   ///////////////
 #include "vector.h"
 
+///////////////    Alloc   ///////////////
+#include "alloc.h"
+
 ///////////////     AVL    ///////////////
 #include "avl.h"
+#include "avl_gen.h"
+
+///////////////   Region   ///////////////
+#include "region.h"
+
+///////////////    Usage   ///////////////
+#include "usage.h"
 
 ///////////////    Entry   ///////////////
 #include "entry.h"
@@ -20,13 +30,59 @@
 ///////////////     Dir    ///////////////
 #include "dir.h"
 
+///////////////     Walk    ///////////////
+#include "walk.h"
+
+///////////////   Reclaim   ///////////////
+#include "reclaim.h"
+
+/////////////// Range lock ///////////////
+#include "rangelock.h"
+
 ///////////////     File    ///////////////
 #include "file.h"
 
+///////////////     Shm     ///////////////
+#include "shm.h"
+
+///////////////     Path    ///////////////
+#include "path.h"
+
+// libkfs is built with KFS_CORE: everything above, none of FUSE
+#ifndef KFS_CORE
+
 ///////////////     Shell    ///////////////
 #include "shell.h"
 
 //////////////  Interface  ////////////////
 #include "interface.h"
 
+///////////////   Session   ///////////////
+#include "session.h"
+
+///////////////   Notify    ///////////////
+#include "notify.h"
+
+///////////////    Cache    ///////////////
+#include "cache.h"
+
+///////////////    Stats    ///////////////
+#include "stats.h"
+
+///////////////    Perf     ///////////////
+#include "perf.h"
+
+///////////////    Trace    ///////////////
+#include "trace.h"
+
+///////////////   Capture   ///////////////
+#include "capture.h"
+
+///////////////   Replay    ///////////////
+#include "replay.h"
+
+///////////////    Share    ///////////////
+#include "share.h"
+#endif
+
 #endif
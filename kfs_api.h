@@ -0,0 +1,67 @@
+#ifndef __KFS_API_HEADER_INCLUDED__
+#define __KFS_API_HEADER_INCLUDED__
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/*
+  libkfs: KFS inside the process that uses it, without FUSE, a mount or a
+  daemon.  Every call is a plain function call on the caller's thread.
+  make lib builds generated/libkfs.a and generated/libkfs.so; this header
+  is all a client includes.
+
+  A KFS_FS is a file system of its own with its own root, and a process
+  may have any number of them.  All calls are thread-safe: lookups, reads
+  and writes to existing files of one instance run concurrently, anything
+  that links or unlinks entries runs alone.
+
+  Results follow the FUSE callbacks: 0 or a byte count on success, -errno
+  on failure.  Paths are absolute ("/a/b").  Reads and writes fail with
+  -EINVAL for a negative offset or one that size would carry past the
+  largest file offset, as pread and pwrite do.
+
+  A KFS_Handle names its file by path, like the FUSE high-level API, but
+  keeps the lookup: it resolves the path again only after an unlink,
+  rmdir or rename somewhere in the instance.  If its file was removed or
+  renamed away meanwhile, calls on it fail with -ENOENT.  Handles may be
+  shared between threads.
+*/
+
+#define KFS_API __attribute__((visibility("default")))
+
+typedef struct KFS_FS KFS_FS;
+typedef struct KFS_Handle KFS_Handle;
+
+// returns non-zero to stop the listing
+typedef int (*KFS_DirFiller)(void *arg, const char *name);
+
+KFS_API KFS_FS *kfs_fs_new(void);
+// every handle must be closed first
+KFS_API void kfs_fs_free(KFS_FS *fs);
+
+KFS_API int kfs_fs_stat(KFS_FS *fs, const char *path, struct stat *st);
+// ".", ".." and the children of path
+KFS_API int kfs_fs_readdir(KFS_FS *fs, const char *path, KFS_DirFiller filler,
+                           void *arg);
+KFS_API int kfs_fs_mkdir(KFS_FS *fs, const char *path, mode_t mode);
+KFS_API int kfs_fs_rmdir(KFS_FS *fs, const char *path);
+KFS_API int kfs_fs_unlink(KFS_FS *fs, const char *path);
+KFS_API int kfs_fs_rename(KFS_FS *fs, const char *from, const char *to);
+KFS_API ssize_t kfs_fs_read(KFS_FS *fs, const char *path, void *buf,
+                            size_t size, off_t offset);
+// creates the file if it is missing
+KFS_API ssize_t kfs_fs_write(KFS_FS *fs, const char *path, const void *buf,
+                             size_t size, off_t offset);
+
+// flags is O_RDONLY, O_WRONLY or O_RDWR, optionally with O_CREAT, O_EXCL
+// and O_TRUNC; mode is used when the file is created
+KFS_API int kfs_fs_open(KFS_FS *fs, const char *path, int flags, mode_t mode,
+                        KFS_Handle **handle);
+KFS_API ssize_t kfs_fs_pread(KFS_Handle *handle, void *buf, size_t size,
+                             off_t offset);
+KFS_API ssize_t kfs_fs_pwrite(KFS_Handle *handle, const void *buf,
+                              size_t size, off_t offset);
+KFS_API int kfs_fs_fstat(KFS_Handle *handle, struct stat *st);
+KFS_API int kfs_fs_close(KFS_Handle *handle);
+
+#endif
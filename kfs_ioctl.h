@@ -0,0 +1,19 @@
+#ifndef __KFS_IOCTL_HEADER_INCLUDED__
+#define __KFS_IOCTL_HEADER_INCLUDED__
+/*
+  ioctls understood by a mounted KFS.  This header is meant to be included
+  by client programs, so it depends on nothing but the system headers.
+*/
+#include <sys/ioctl.h>
+
+#define KFS_IOC_PATH_MAX 4096
+
+// issued on the destination file: make it a copy-on-write clone of src,
+// given relative to the mount point
+struct kfs_ioc_clone {
+  char src[KFS_IOC_PATH_MAX];
+};
+
+#define KFS_IOC_CLONE _IOW('K', 1, struct kfs_ioc_clone)
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef __KFS_SHM_HEADER_INCLUDED__
+#define __KFS_SHM_HEADER_INCLUDED__
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+  Shared-memory reads for processes on the same host as a KFS daemon
+  started with -o kfs_share=SOCKET.  kfs_shm_open asks the daemon, over
+  that Unix socket, for a shared view of a file.  The view is a memfd
+  holding a copy of the file's data, which the daemon keeps up to date on
+  every write.  The client maps it read-only, so kfs_shm_pread is a memcpy
+  with no syscall at all.  This suits files that are read far more often
+  than they change.
+
+  make lib builds generated/libkfs_shm.a and libkfs_shm.so.  A client
+  needs only this header and neither FUSE nor the rest of KFS.
+
+  Consistency: a read returns the file as it was at one moment.  The daemon
+  makes seq odd while it changes the data and even again afterwards, and a
+  read retries if seq was odd or moved meanwhile.
+
+  A view has a fixed capacity.  If the file outgrows it, is replaced by a
+  clone or is removed, the daemon retires the view.  The next read then
+  asks the daemon again (the only case where a read makes syscalls).  It
+  maps a fresh view, or fails with -ENOENT once the file is gone.
+
+  A KFS_ShmClient may be shared between threads.  A KFS_ShmFile is used by
+  one thread at a time.  Results are 0 (or a byte count) on success and
+  -errno on failure.
+*/
+
+#define KFS_SHM_MAGIC 0x5353464bu // "KFSS"
+
+// the first page of every view; the data starts at data_offset
+typedef struct {
+  uint32_t magic;
+  uint32_t data_offset;
+  uint64_t capacity;       // bytes of data the view can hold
+  _Atomic uint64_t seq;    // odd while the daemon changes the view
+  _Atomic uint64_t size;   // the file's size
+  _Atomic uint32_t retired; // ask the daemon for a new view
+} KFS_ShmHeader;
+
+/*
+  Wire protocol, one SOCK_SEQPACKET message each way:
+    request:  the absolute path inside the mount, without a terminating NUL
+    response: an int32_t, 0 or -errno; on success it carries the view's
+              memfd as SCM_RIGHTS
+  Only peers with the daemon's uid (or root) are answered.
+*/
+
+#define KFS_SHM_API __attribute__((visibility("default")))
+
+typedef struct KFS_ShmClient KFS_ShmClient;
+typedef struct KFS_ShmFile KFS_ShmFile;
+
+KFS_SHM_API int kfs_shm_connect(const char *socket_path,
+                                KFS_ShmClient **client);
+// every file opened through client must be closed first
+KFS_SHM_API void kfs_shm_disconnect(KFS_ShmClient *client);
+
+KFS_SHM_API int kfs_shm_open(KFS_ShmClient *client, const char *path,
+                             KFS_ShmFile **file);
+KFS_SHM_API ssize_t kfs_shm_pread(KFS_ShmFile *file, void *buf, size_t size,
+                                  off_t offset);
+// the file's size, or -errno
+KFS_SHM_API off_t kfs_shm_size(KFS_ShmFile *file);
+KFS_SHM_API void kfs_shm_close(KFS_ShmFile *file);
+
+#endif
@@ -1,11 +1,62 @@
 #include "kfs.h"
 #include <stdio.h>
+#include <stdlib.h>
 
 static void shell_main(void) {
   KFS_Entry *root = new_KFS_Dir("/");
   kfs_shell(root);
 }
 
+// fuse_main, with the multi-threaded loop replaced by kfs_session_loop
+static int fuse_session_main(int argc, char *argv[]) {
+  struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+  struct fuse_chan *ch;
+  struct fuse *fuse;
+  struct fuse_session *se;
+  char *mountpoint = NULL;
+  int multithreaded, foreground;
+  int res = 1;
+
+  if (kfs_session_parse(&args) == -1 || kfs_cache_parse(&args) == -1 ||
+      kfs_trace_parse(&args) == -1 || kfs_perf_parse(&args) == -1 ||
+      kfs_capture_parse(&args) == -1 || kfs_share_parse(&args) == -1 ||
+      kfs_notify_parse(&args) == -1) {
+    goto FREE_ARGS;
+  }
+  if (fuse_parse_cmdline(&args, &mountpoint, &multithreaded, &foreground) ==
+          -1 ||
+      mountpoint == NULL) {
+    goto FREE_ARGS;
+  }
+
+  ch = fuse_mount(mountpoint, &args);
+  if (ch == NULL) {
+    goto FREE_ARGS;
+  }
+
+  fuse = fuse_new(ch, &args, &kfs_ops, sizeof(kfs_ops), NULL);
+  if (fuse == NULL) {
+    fuse_unmount(mountpoint, ch);
+    goto FREE_ARGS;
+  }
+
+  se = fuse_get_session(fuse);
+  if (fuse_daemonize(foreground) == 0 && fuse_set_signal_handlers(se) == 0) {
+    kfs_notify_bind(ch);
+    res = multithreaded ? kfs_session_loop(fuse) : fuse_loop(fuse);
+    kfs_notify_bind(NULL); // ch goes away with the mount
+    fuse_remove_signal_handlers(se);
+  }
+
+  fuse_unmount(mountpoint, ch);
+  fuse_destroy(fuse);
+
+FREE_ARGS:
+  free(mountpoint);
+  fuse_opt_free_args(&args);
+  return res == 0 ? 0 : 1;
+}
+
 int main(int argc, char *argv[]) {
   if (argc == 2 && strcmp((const char *)argv[1], "-s") == 0) {
     shell_main();
@@ -14,7 +65,7 @@ int main(int argc, char *argv[]) {
       printf("error!");
     } else {
       kfs_init();
-      fuse_main(argc, argv, &kfs_ops, NULL);
+      return fuse_session_main(argc, argv);
     }
   }
   return 0;
@@ -0,0 +1,135 @@
+#include "kfs.h"
+#include <fuse_lowlevel.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+static pthread_mutex_t notify_lock = PTHREAD_MUTEX_INITIALIZER;
+// held while sending, so that unbinding waits for a send in progress
+static pthread_mutex_t notify_send_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notify_wakeup = PTHREAD_COND_INITIALIZER;
+static Vector *notify_queue; // sds paths
+static struct fuse_chan *notify_chan;
+static bool notify_running;
+static bool notify_stopping;
+static pthread_t notify_thread;
+static atomic_size_t notify_queued;
+
+int kfs_notify_parse(struct fuse_args *args) {
+  return fuse_opt_insert_arg(args, 1,
+                             "-oentry_timeout=" KFS_CACHE_TIMEOUT
+                             ",attr_timeout=" KFS_CACHE_TIMEOUT
+                             ",negative_timeout=" KFS_CACHE_TIMEOUT);
+}
+
+static void send_one(struct fuse_chan *ch, sds path) {
+  const char *top = path;
+  while (*top == '/') {
+    top++;
+  }
+  size_t len = strcspn(top, "/");
+
+  if (ch != NULL && len > 0) {
+    fuse_lowlevel_notify_inval_entry(ch, FUSE_ROOT_ID, top, len);
+  }
+}
+
+// sends a batch; duplicates within it only go out once
+static void send_batch(Vector *batch) {
+  pthread_mutex_lock(&notify_send_lock);
+  struct fuse_chan *ch = notify_chan;
+
+  for (size_t i = 0; i < batch->len; i++) {
+    bool seen = false;
+    for (size_t j = 0; j < i && !seen; j++) {
+      seen = strcmp(batch->data[i], batch->data[j]) == 0;
+    }
+    if (!seen) {
+      send_one(ch, batch->data[i]);
+    }
+  }
+  pthread_mutex_unlock(&notify_send_lock);
+
+  for (size_t i = 0; i < batch->len; i++) {
+    sdsfree(batch->data[i]);
+  }
+  atomic_fetch_sub(&notify_queued, batch->len);
+}
+
+static void ensure_queue(void) {
+  if (notify_queue == NULL) {
+    notify_queue = new_vec();
+  }
+}
+
+static void *notify_main(void *arg __attribute__((unused))) {
+  pthread_mutex_lock(&notify_lock);
+
+  for (;;) {
+    while (notify_queue->len == 0 && !notify_stopping) {
+      pthread_cond_wait(&notify_wakeup, &notify_lock);
+    }
+    if (notify_queue->len == 0) {
+      break;
+    }
+
+    Vector *batch = notify_queue;
+    notify_queue = new_vec();
+    pthread_mutex_unlock(&notify_lock);
+
+    send_batch(batch);
+    free_vec(batch);
+
+    pthread_mutex_lock(&notify_lock);
+  }
+
+  pthread_mutex_unlock(&notify_lock);
+  return NULL;
+}
+
+void kfs_notify_start(void) {
+  pthread_mutex_lock(&notify_lock);
+  ensure_queue();
+  if (!notify_running) {
+    notify_stopping = false;
+    if (pthread_create(&notify_thread, NULL, notify_main, NULL) == 0) {
+      notify_running = true;
+    }
+  }
+  pthread_mutex_unlock(&notify_lock);
+}
+
+void kfs_notify_stop(void) {
+  pthread_mutex_lock(&notify_lock);
+  if (!notify_running) {
+    pthread_mutex_unlock(&notify_lock);
+    return;
+  }
+  notify_stopping = true;
+  pthread_cond_signal(&notify_wakeup);
+  pthread_mutex_unlock(&notify_lock);
+
+  pthread_join(notify_thread, NULL);
+  notify_running = false;
+}
+
+void kfs_notify_bind(struct fuse_chan *ch) {
+  pthread_mutex_lock(&notify_send_lock);
+  pthread_mutex_lock(&notify_lock);
+  notify_chan = ch;
+  pthread_mutex_unlock(&notify_lock);
+  pthread_mutex_unlock(&notify_send_lock);
+}
+
+void kfs_notify_path(const char *path) {
+  pthread_mutex_lock(&notify_lock);
+  if (notify_chan != NULL && notify_running) {
+    ensure_queue();
+    vec_push(notify_queue, sdsnew(path));
+    atomic_fetch_add(&notify_queued, 1);
+    pthread_cond_signal(&notify_wakeup);
+  }
+  pthread_mutex_unlock(&notify_lock);
+}
+
+size_t kfs_notify_pending(void) { return atomic_load(&notify_queued); }
@@ -0,0 +1,30 @@
+#ifndef __NOTIFY_HEADER_INCLUDED__
+#define __NOTIFY_HEADER_INCLUDED__
+#include "kfs.h"
+
+/*
+  Kernel cache coherence.  The kernel is told to keep entries, attributes
+  and negative lookups for KFS_CACHE_TIMEOUT seconds, which is only safe
+  because changes it did not make itself (xattr-driven removals, clones)
+  are pushed to it as invalidations.
+
+  The high-level API hides node ids, so an invalidation drops the dentry of
+  the path's first component under the root; the kernel looks the whole
+  subtree up again on next use.  Notifications are sent from a thread of
+  their own: the kernel may hold the very inode lock the notification
+  needs while it waits for the request that triggered it.
+*/
+
+#define KFS_CACHE_TIMEOUT "86400"
+
+// puts the default timeouts in front of args, so user options still win
+int kfs_notify_parse(struct fuse_args *args);
+void kfs_notify_start(void);
+void kfs_notify_stop(void); // sends what is queued first
+// the channel to notify; once bound to NULL nothing is sent any more
+void kfs_notify_bind(struct fuse_chan *ch);
+// queue an invalidation of path; dropped when no channel is bound
+void kfs_notify_path(const char *path);
+size_t kfs_notify_pending(void);
+
+#endif
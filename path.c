@@ -0,0 +1,419 @@
+#include "kfs.h"
+#include <errno.h>
+#include <unistd.h>
+
+// path without trailing slashes ("/" stays); *dir_only is set if it had
+// any, since then it may only name a directory
+static sds path_new(const char *path, bool *dir_only) {
+  sds spath = sdsnew(path);
+  *dir_only = false;
+  while (sdslen(spath) > 1 && spath[sdslen(spath) - 1] == '/') {
+    sdsrange(spath, 0, -2);
+    *dir_only = true;
+  }
+  return spath;
+}
+
+KFS_PathParent kfs_path_parent(KFS_Entry *root, sds path) {
+  KFS_PathParent pp;
+
+  KFS_Entry *parent = root;
+  Vector *paths = sdssplitvec(path, '/');
+  // a leading '/' splits off an empty first component
+  size_t first = paths->len > 1 && sdslen(paths->data[0]) == 0 ? 1 : 0;
+  for (size_t i = first; i < paths->len - 1; i++) {
+    parent = kfs_find_on(parent, paths->data[i]);
+    if (parent == NULL || !EntryIsDir(parent)) {
+      parent = NULL;
+      break;
+    }
+  }
+
+  pp.lastname = paths->data[paths->len - 1];
+  // "/" has no parent, and nothing can be named ""
+  pp.parent = sdslen(pp.lastname) > 0 ? parent : NULL;
+  for (size_t i = 0; i < paths->len - 1; i++) {
+    sdsfree(paths->data[i]);
+  }
+  free_vec(paths);
+  return pp;
+}
+
+KFS_Entry *kfs_path_lookup(KFS_Entry *root, const char *path) {
+  bool dir_only;
+  sds spath = path_new(path, &dir_only);
+  KFS_Entry *entry = kfs_find(root, spath);
+  sdsfree(spath);
+  return entry != NULL && dir_only && !EntryIsDir(entry) ? NULL : entry;
+}
+
+void kfs_entry_stat(KFS_Entry *entry, struct stat *stbuf) {
+  stbuf->st_mode = entry->mode;
+  stbuf->st_nlink = entry->nlink;
+  stbuf->st_size = entry->size;
+  stbuf->st_uid = entry->uid;
+  stbuf->st_gid = entry->gid;
+  stbuf->st_blocks = (entry->size + 511) / 512;
+  stbuf->st_atim = entry->atime;
+  stbuf->st_mtim = entry->mtime;
+  stbuf->st_ctim = entry->ctime;
+}
+
+int kfs_path_stat(KFS_Entry *root, const char *path, struct stat *stbuf) {
+  KFS_Entry *entry = kfs_path_lookup(root, path);
+  if (entry == NULL) {
+    return -ENOENT;
+  }
+
+  kfs_entry_stat(entry, stbuf);
+  return 0;
+}
+
+int kfs_path_access(KFS_Entry *root, const char *path, int mode) {
+  KFS_Entry *entry = kfs_path_lookup(root, path);
+  if (entry == NULL) {
+    return -ENOENT;
+  }
+  if (mode == F_OK) {
+    return 0;
+  }
+
+  int target;
+  if (entry->uid == getuid()) {
+    // left 3bit
+    target = entry->mode >> 6;
+  } else if (entry->gid == getgid()) {
+    // middle 3 bit
+    target = (entry->mode & 0b111000) >> 3;
+  } else {
+    // right 3 bit
+    target = (entry->mode & 0b111);
+  }
+
+  if ((mode & R_OK) && (target & R_OK) == 0) {
+    return -EACCES;
+  }
+  if ((mode & W_OK) && (target & W_OK) == 0) {
+    return -EACCES;
+  }
+  if ((mode & X_OK) && (target & X_OK) == 0) {
+    return -EACCES;
+  }
+  return 0;
+}
+
+int kfs_path_readdir(KFS_Entry *root, const char *path, KFS_NameFiller filler,
+                     void *arg) {
+  int res = kfs_path_access(root, path, R_OK);
+  if (res != 0) {
+    return res;
+  }
+
+  KFS_Entry *entry = kfs_path_lookup(root, path);
+  if (EntryIsFile(entry)) {
+    filler(arg, entry->name);
+  } else {
+    Vector *elems = kfs_getCurrentList(entry);
+    VecForeach(elems, elem, {
+      if (filler(arg, (sds)elem) != 0) {
+        break;
+      }
+    });
+    kfs_freeCurrentList(elems);
+  }
+  return 0;
+}
+
+ssize_t kfs_path_read(KFS_Entry *root, const char *path, char *buf,
+                      size_t size, off_t offset) {
+  int res = kfs_path_access(root, path, R_OK);
+  if (res != 0) {
+    return res;
+  }
+
+  KFS_Entry *entry = kfs_path_lookup(root, path);
+  if (EntryIsDir(entry)) {
+    return -EISDIR;
+  }
+  return kfs_read(entry, buf, size, offset);
+}
+
+int kfs_path_share(KFS_Entry *root, const char *path) {
+  int res = kfs_path_access(root, path, R_OK);
+  if (res != 0) {
+    return res;
+  }
+
+  KFS_Entry *entry = kfs_path_lookup(root, path);
+  if (EntryIsDir(entry)) {
+    return -EISDIR;
+  }
+  return kfs_file_share(entry);
+}
+
+ssize_t kfs_path_write(KFS_Entry *root, const char *path, const char *buf,
+                       size_t size, off_t offset) {
+  int res = kfs_path_access(root, path, W_OK);
+  if (res == -ENOENT) {
+    // check parent
+    bool dir_only;
+    sds spath = path_new(path, &dir_only);
+    KFS_PathParent pp = kfs_path_parent(root, spath);
+    sdsfree(pp.lastname);
+    sdsfree(spath);
+    if (pp.parent == NULL) {
+      return -ENOENT;
+    }
+
+    sds parent_path = kfs_getPwd(pp.parent);
+    res = kfs_path_access(root, parent_path, W_OK);
+    sdsfree(parent_path);
+    if (res != 0) {
+      return res;
+    }
+  } else if (res != 0) {
+    return res;
+  }
+
+  KFS_Entry *entry = kfs_path_lookup(root, path);
+  if (entry == NULL) {
+    // create a file
+    res = kfs_path_create(root, path, 444, &entry);
+    if (res != 0) {
+      return res;
+    }
+  }
+  return kfs_entry_write(entry, buf, size, offset);
+}
+
+ssize_t kfs_entry_write(KFS_Entry *entry, const char *buf, size_t size,
+                        off_t offset) {
+  if (EntryIsDir(entry)) {
+    return -EISDIR;
+  }
+
+  off_t growth = offset + (off_t)size - entry->size;
+  int res;
+  if (growth > 0 && (res = kfs_usage_check(entry->prev, growth, 0)) != 0) {
+    return res;
+  }
+
+  kfs_write(entry, buf, size, offset);
+  return size;
+}
+
+// a new entry named after path's last component, linked into its parent
+static int path_link(KFS_Entry *root, const char *path, int entry_type,
+                     mode_t mode, KFS_Entry **created) {
+  bool dir_only;
+  sds spath = path_new(path, &dir_only);
+  int res = 0;
+
+  if (dir_only && entry_type != tKFS_Dir) {
+    res = -EISDIR;
+  } else if (kfs_find(root, spath) != NULL) {
+    res = -EEXIST;
+  } else {
+    KFS_PathParent pp = kfs_path_parent(root, spath);
+    KFS_Entry *parent = pp.parent;
+
+    res = parent == NULL ? -ENOENT : kfs_usage_check(parent, 0, 1);
+    if (res == 0) {
+      KFS_Entry *entry = make_child_entry(parent, pp.lastname, entry_type);
+      entry->mode = mode | (entry_type == tKFS_Dir ? S_IFDIR : S_IFREG);
+      kfs_append_child(parent, entry);
+      if (created != NULL) {
+        *created = entry;
+      }
+    }
+    sdsfree(pp.lastname);
+  }
+
+  sdsfree(spath);
+  return res;
+}
+
+int kfs_path_mkdir(KFS_Entry *root, const char *path, mode_t mode) {
+  return path_link(root, path, tKFS_Dir, mode, NULL);
+}
+
+// TODO: Permission check
+int kfs_path_create(KFS_Entry *root, const char *path, mode_t mode,
+                    KFS_Entry **created) {
+  return path_link(root, path, tKFS_File, mode, created);
+}
+
+int kfs_path_unlink(KFS_Entry *root, const char *path) {
+  KFS_Entry *entry = kfs_path_lookup(root, path);
+
+  if (entry == NULL) {
+    return -ENOENT;
+  }
+  if (EntryIsDir(entry)) {
+    return -EISDIR;
+  }
+  kfs_remove_tree(entry->prev, entry->name);
+  return 0;
+}
+
+int kfs_path_rmdir(KFS_Entry *root, const char *path) {
+  KFS_Entry *entry = kfs_path_lookup(root, path);
+
+  if (entry == NULL) {
+    return -ENOENT;
+  }
+  if (!EntryIsDir(entry)) {
+    return -ENOTDIR;
+  }
+  if (entry->prev == NULL) {
+    return -EBUSY;
+  }
+  if (GetAVLTree(entry)->size > 0) {
+    return -ENOTEMPTY;
+  }
+  kfs_remove_tree(entry->prev, entry->name);
+  return 0;
+}
+
+int kfs_path_rename(KFS_Entry *root, const char *from, const char *to) {
+  int res = 0;
+  bool dir_only;
+  sds sto = path_new(to, &dir_only);
+  KFS_Entry *entry = kfs_path_lookup(root, from);
+  KFS_Entry *target = kfs_find(root, sto);
+  KFS_PathParent pp = {NULL, NULL};
+
+  if (entry == NULL) {
+    res = -ENOENT;
+    goto RETURN;
+  }
+  if (entry->prev == NULL || target == root) {
+    res = -EBUSY;
+    goto RETURN;
+  }
+  if (dir_only && !EntryIsDir(entry)) {
+    res = -ENOTDIR;
+    goto RETURN;
+  }
+  if (entry == target) {
+    goto RETURN;
+  }
+
+  pp = kfs_path_parent(root, sto);
+  KFS_Entry *dst = pp.parent;
+  if (dst == NULL) {
+    res = -ENOENT;
+    goto RETURN;
+  }
+
+  // a directory cannot be moved below itself
+  for (KFS_Entry *e = dst; e != NULL; e = e->prev) {
+    if (e == entry) {
+      res = -EINVAL;
+      goto RETURN;
+    }
+  }
+
+  if (target != NULL) {
+    if (EntryIsDir(entry) && !EntryIsDir(target)) {
+      res = -ENOTDIR;
+    } else if (!EntryIsDir(entry) && EntryIsDir(target)) {
+      res = -EISDIR;
+    } else if (EntryIsDir(target) && GetAVLTree(target)->size > 0) {
+      res = -ENOTEMPTY;
+    }
+    if (res != 0) {
+      goto RETURN;
+    }
+  }
+
+  // scratch regions are freed as a whole, so nothing may move in or out
+  if (kfs_entry_home(entry) != dst->region) {
+    res = -EXDEV;
+    goto RETURN;
+  }
+
+  if (dst != entry->prev) {
+    KFS_UsageStat st = kfs_usage_of(entry);
+    if ((res = kfs_usage_check(dst, st.bytes, st.inodes)) != 0) {
+      goto RETURN;
+    }
+  }
+
+  // both steps run under the exclusive namespace lock, so nobody can
+  // observe the target missing in between
+  if (target != NULL) {
+    kfs_remove_tree(dst, target->name);
+  }
+  kfs_move_child(entry->prev, entry->name, dst, pp.lastname);
+
+RETURN:
+  sdsfree(pp.lastname);
+  sdsfree(sto);
+  return res;
+}
+
+int kfs_path_truncate(KFS_Entry *root, const char *path, off_t size) {
+  KFS_Entry *entry = kfs_path_lookup(root, path);
+
+  if (entry == NULL) {
+    return -ENOENT;
+  }
+  if (!EntryIsFile(entry)) {
+    return -EISDIR;
+  }
+
+  int res = kfs_usage_check(entry->prev, size - entry->size, 0);
+  if (res == 0) {
+    kfs_truncate(entry, size);
+  }
+  return res;
+}
+
+int kfs_path_utimens(KFS_Entry *root, const char *path,
+                     const struct timespec tv[2]) {
+  KFS_Entry *entry = kfs_path_lookup(root, path);
+  if (entry == NULL) {
+    return -ENOENT;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  if (tv[0].tv_nsec != UTIME_OMIT) {
+    entry->atime = tv[0].tv_nsec == UTIME_NOW ? now : tv[0];
+  }
+  if (tv[1].tv_nsec != UTIME_OMIT) {
+    entry->mtime = tv[1].tv_nsec == UTIME_NOW ? now : tv[1];
+  }
+  kfs_entry_changed(entry);
+  return 0;
+}
+
+int kfs_path_chmod(KFS_Entry *root, const char *path, mode_t mode) {
+  KFS_Entry *entry = kfs_path_lookup(root, path);
+  if (entry == NULL) {
+    return -ENOENT;
+  }
+
+  entry->mode = mode | (EntryIsFile(entry) ? S_IFREG : S_IFDIR);
+  kfs_entry_changed(entry);
+  return 0;
+}
+
+int kfs_path_chown(KFS_Entry *root, const char *path, uid_t uid, gid_t gid) {
+  KFS_Entry *entry = kfs_path_lookup(root, path);
+  if (entry == NULL) {
+    return -ENOENT;
+  }
+
+  // -1 leaves the id as it is
+  if (uid != (uid_t)-1) {
+    entry->uid = uid;
+  }
+  if (gid != (gid_t)-1) {
+    entry->gid = gid;
+  }
+  kfs_entry_changed(entry);
+  return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef __PATH_HEADER_INCLUDED__
+#define __PATH_HEADER_INCLUDED__
+#include "kfs.h"
+#include <sys/stat.h>
+
+/*
+  Path operations on the tree below root: everything a FUSE callback does
+  that has nothing to do with FUSE.  The daemon (interface.c) and the
+  embedding API (kfs_api.h) are both thin layers over these.  Results
+  follow the callbacks: 0 or a byte count on success, -errno on failure.
+
+  Trailing slashes are ignored, but a path with one only names a
+  directory: files are not found through it and cannot be created by it.
+
+  Nothing here locks.  Callers hold their namespace lock shared for
+  lookups, reads and writes to existing files, and exclusively for
+  anything that links or unlinks entries (see interface.c).
+*/
+
+// the parent directory of path and its last component, which the caller
+// frees; parent is NULL if the path runs through something that is
+// missing or not a directory, or if the last component is empty ("/" or
+// a trailing slash, which callers strip first)
+typedef struct {
+  KFS_Entry *parent;
+  sds lastname;
+} KFS_PathParent;
+
+KFS_PathParent kfs_path_parent(KFS_Entry *root, sds path);
+KFS_Entry *kfs_path_lookup(KFS_Entry *root, const char *path);
+
+// returns non-zero to stop the listing
+typedef int (*KFS_NameFiller)(void *arg, const char *name);
+
+void kfs_entry_stat(KFS_Entry *entry, struct stat *stbuf);
+int kfs_path_stat(KFS_Entry *root, const char *path, struct stat *stbuf);
+// mode is a mask of R_OK, W_OK and X_OK, checked against getuid()/getgid()
+int kfs_path_access(KFS_Entry *root, const char *path, int mode);
+// ".", ".." and the children; a file lists itself
+int kfs_path_readdir(KFS_Entry *root, const char *path, KFS_NameFiller filler,
+                     void *arg);
+ssize_t kfs_path_read(KFS_Entry *root, const char *path, char *buf,
+                      size_t size, off_t offset);
+// a new fd of the file's shared view (shm.h)
+int kfs_path_share(KFS_Entry *root, const char *path);
+// creates the file if it is missing and its parent is writable
+ssize_t kfs_path_write(KFS_Entry *root, const char *path, const char *buf,
+                       size_t size, off_t offset);
+// kfs_write behind the quota check, for callers that resolved the entry
+ssize_t kfs_entry_write(KFS_Entry *entry, const char *buf, size_t size,
+                        off_t offset);
+int kfs_path_mkdir(KFS_Entry *root, const char *path, mode_t mode);
+// created may be NULL
+int kfs_path_create(KFS_Entry *root, const char *path, mode_t mode,
+                    KFS_Entry **created);
+int kfs_path_unlink(KFS_Entry *root, const char *path);
+int kfs_path_rmdir(KFS_Entry *root, const char *path);
+int kfs_path_rename(KFS_Entry *root, const char *from, const char *to);
+int kfs_path_truncate(KFS_Entry *root, const char *path, off_t size);
+int kfs_path_utimens(KFS_Entry *root, const char *path,
+                     const struct timespec tv[2]);
+int kfs_path_chmod(KFS_Entry *root, const char *path, mode_t mode);
+int kfs_path_chown(KFS_Entry *root, const char *path, uid_t uid, gid_t gid);
+
+#endif
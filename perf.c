@@ -0,0 +1,264 @@
+#include "kfs.h"
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+atomic_bool kfs_perf_on;
+
+#define CACHE_EVENT(cache)                                                     \
+  ((cache) | PERF_COUNT_HW_CACHE_OP_READ << 8 |                                \
+   PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+
+static const struct {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+} events[KFS_PERF_COUNT] = {
+    [KFS_PERF_cycles] = {"cycles", PERF_TYPE_HARDWARE,
+                         PERF_COUNT_HW_CPU_CYCLES},
+    [KFS_PERF_instructions] = {"instructions", PERF_TYPE_HARDWARE,
+                               PERF_COUNT_HW_INSTRUCTIONS},
+    [KFS_PERF_llc_misses] = {"llc_misses", PERF_TYPE_HW_CACHE,
+                             CACHE_EVENT(PERF_COUNT_HW_CACHE_LL)},
+    [KFS_PERF_dtlb_misses] = {"dtlb_misses", PERF_TYPE_HW_CACHE,
+                              CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB)},
+};
+
+// a thread's counter group; events that failed to open have no slot
+typedef struct {
+  int leader;
+  int fds[KFS_PERF_COUNT];
+  int slots[KFS_PERF_COUNT]; // position in a group read, -1 if not open
+  int n;
+} Group;
+
+typedef struct {
+  _Atomic uint64_t count;
+  _Atomic uint64_t sums[KFS_PERF_COUNT];
+} OpShard;
+
+typedef struct Shard {
+  OpShard ops[KFS_OP_COUNT];
+  struct Shard *next;
+} Shard;
+
+static pthread_mutex_t shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static Shard *shards;
+static _Thread_local Shard *my_shard;
+static KFS_PerfStats baseline[KFS_OP_COUNT];
+
+static _Thread_local Group *my_group;
+static _Thread_local bool group_tried;
+static pthread_key_t group_key;
+static pthread_once_t group_key_once = PTHREAD_ONCE_INIT;
+// events some thread could not open; they are not reported
+static _Atomic unsigned missing;
+
+static struct {
+  int on;
+} perf_opts;
+
+static const struct fuse_opt perf_fuse_opts[] = {{"kfs_perf", 0, 1},
+                                                 FUSE_OPT_END};
+
+int kfs_perf_parse(struct fuse_args *args) {
+  if (fuse_opt_parse(args, &perf_opts, perf_fuse_opts, NULL) == -1) {
+    return -1;
+  }
+  if (perf_opts.on && !kfs_perf_enable(true)) {
+    fprintf(stderr, "kfs_perf: hardware counters are not available\n");
+  }
+  return 0;
+}
+
+static void close_group(void *arg) {
+  Group *g = arg;
+  for (int i = 0; i < KFS_PERF_COUNT; i++) {
+    if (g->fds[i] != -1) {
+      close(g->fds[i]);
+    }
+  }
+  xfree(&g);
+}
+
+static void make_group_key(void) {
+  pthread_key_create(&group_key, close_group);
+}
+
+static int open_event(int i, int leader) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = events[i].type;
+  attr.config = events[i].config;
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.disabled = leader == -1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+// opened on first use and closed when the thread exits
+static Group *group(void) {
+  if (group_tried) {
+    return my_group;
+  }
+  group_tried = true;
+  pthread_once(&group_key_once, make_group_key);
+
+  Group *g = xmalloc(sizeof(Group));
+  g->leader = -1;
+  g->n = 0;
+  for (int i = 0; i < KFS_PERF_COUNT; i++) {
+    g->fds[i] = open_event(i, g->leader);
+    g->slots[i] = g->fds[i] != -1 ? g->n++ : -1;
+    if (g->fds[i] == -1) {
+      atomic_fetch_or(&missing, 1u << i);
+    } else if (g->leader == -1) {
+      g->leader = g->fds[i];
+    }
+  }
+
+  if (g->leader == -1) {
+    xfree(&g);
+    return NULL;
+  }
+  ioctl(g->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  pthread_setspecific(group_key, g);
+  my_group = g;
+  return g;
+}
+
+bool kfs_perf_read(uint64_t values[KFS_PERF_COUNT]) {
+  Group *g = group();
+  if (g == NULL) {
+    return false;
+  }
+
+  uint64_t buf[1 + KFS_PERF_COUNT]; // nr, then the values in group order
+  if (read(g->leader, buf, sizeof(buf)) < (ssize_t)sizeof(uint64_t)) {
+    return false;
+  }
+  for (int i = 0; i < KFS_PERF_COUNT; i++) {
+    values[i] = g->slots[i] != -1 ? buf[1 + g->slots[i]] : 0;
+  }
+  return true;
+}
+
+bool kfs_perf_enable(bool on) {
+  if (on && group() == NULL) {
+    return false;
+  }
+  atomic_store(&kfs_perf_on, on);
+  return true;
+}
+
+// only the owning thread writes a shard
+static inline void bump(_Atomic uint64_t *counter, uint64_t n) {
+  atomic_store_explicit(
+      counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+      memory_order_relaxed);
+}
+
+static Shard *shard(void) {
+  if (my_shard == NULL) {
+    Shard *s = xmalloc(sizeof(Shard));
+    memset(s, 0, sizeof(Shard));
+
+    pthread_mutex_lock(&shards_lock);
+    s->next = shards;
+    shards = s;
+    pthread_mutex_unlock(&shards_lock);
+    my_shard = s;
+  }
+  return my_shard;
+}
+
+void kfs_perf_push(const KFS_PerfSpan *span, int op) {
+  uint64_t now[KFS_PERF_COUNT];
+  if (!kfs_perf_read(now)) {
+    return;
+  }
+
+  OpShard *s = &shard()->ops[op];
+  bump(&s->count, 1);
+  for (int i = 0; i < KFS_PERF_COUNT; i++) {
+    bump(&s->sums[i], now[i] - span->values[i]);
+  }
+}
+
+// callers hold shards_lock
+static void sum_shards(int op, KFS_PerfStats *out) {
+  memset(out, 0, sizeof(*out));
+  for (Shard *s = shards; s != NULL; s = s->next) {
+    OpShard *o = &s->ops[op];
+    out->count += atomic_load_explicit(&o->count, memory_order_relaxed);
+    for (int i = 0; i < KFS_PERF_COUNT; i++) {
+      out->sums[i] += atomic_load_explicit(&o->sums[i], memory_order_relaxed);
+    }
+  }
+}
+
+void kfs_perf_get(int op, KFS_PerfStats *out) {
+  pthread_mutex_lock(&shards_lock);
+  sum_shards(op, out);
+  out->count -= baseline[op].count;
+  for (int i = 0; i < KFS_PERF_COUNT; i++) {
+    out->sums[i] -= baseline[op].sums[i];
+    out->counted[i] = (atomic_load(&missing) & (1u << i)) == 0;
+  }
+  pthread_mutex_unlock(&shards_lock);
+}
+
+void kfs_perf_reset(void) {
+  pthread_mutex_lock(&shards_lock);
+  for (int op = 0; op < KFS_OP_COUNT; op++) {
+    sum_shards(op, &baseline[op]);
+  }
+  pthread_mutex_unlock(&shards_lock);
+}
+
+static sds cat_average(sds out, const KFS_PerfStats *stats, int event) {
+  if (!stats->counted[event]) {
+    return sdscat(out, " -");
+  }
+  return sdscatprintf(out, " %.1f",
+                      stats->count > 0
+                          ? (double)stats->sums[event] / stats->count
+                          : 0.0);
+}
+
+sds kfs_perf_render(void) {
+  sds out = sdsnew("op count");
+  for (int i = 0; i < KFS_PERF_COUNT; i++) {
+    out = sdscatprintf(out, " %s%s", events[i].name,
+                       i == KFS_PERF_instructions ? " ipc" : "");
+  }
+  out = sdscat(out, "\n");
+
+  KFS_PerfStats stats;
+  for (int op = 0; op < KFS_OP_COUNT; op++) {
+    kfs_perf_get(op, &stats);
+    out = sdscatprintf(out, "%s %llu", kfs_stats_op_name(op),
+                       (unsigned long long)stats.count);
+    for (int i = 0; i < KFS_PERF_COUNT; i++) {
+      out = cat_average(out, &stats, i);
+      if (i != KFS_PERF_instructions) {
+        continue;
+      }
+      if (stats.counted[KFS_PERF_cycles] && stats.counted[i] &&
+          stats.sums[KFS_PERF_cycles] > 0) {
+        out = sdscatprintf(out, " %.2f",
+                           (double)stats.sums[i] / stats.sums[KFS_PERF_cycles]);
+      } else {
+        out = sdscat(out, " -");
+      }
+    }
+    out = sdscat(out, "\n");
+  }
+  return out;
+}
@@ -0,0 +1,77 @@
+#ifndef __PERF_HEADER_INCLUDED__
+#define __PERF_HEADER_INCLUDED__
+#include "kfs.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+  Hardware counters per operation type, to tell cache and TLB misses
+  apart from plain work when a lookup gets slower.  Off by default; while
+  on, every operation reads its thread's perf_event_open group (cycles,
+  instructions, LLC misses and dTLB load misses, user space only) before
+  and after, and the differences are summed per operation type.  Each
+  read is a system call, so latencies measured at the same time include
+  about two of them.
+
+  Served at /.kfs/perf next to the latency stats, one line per operation
+  with per-operation averages ("-" for a counter the CPU or hypervisor
+  does not offer):
+    op count cycles instructions ipc llc_misses dtlb_misses
+
+  Turned on with -o kfs_perf, the user.kfs.perf xattr of the root ("1"
+  or "0") or the shell's perf command.  It cannot be turned on where
+  perf_event_open is refused, e.g. with kernel.perf_event_paranoid > 2.
+*/
+
+#define KFS_PERF_EVENTS(X)                                                     \
+  X(cycles)                                                                    \
+  X(instructions)                                                              \
+  X(llc_misses)                                                                \
+  X(dtlb_misses)
+
+#define KFS_PERF_ENUM(name) KFS_PERF_##name,
+enum { KFS_PERF_EVENTS(KFS_PERF_ENUM) KFS_PERF_COUNT };
+#undef KFS_PERF_ENUM
+
+#define KFS_PERF_FILE KFS_STATS_DIR "/perf"
+
+extern atomic_bool kfs_perf_on;
+
+typedef struct {
+  bool valid; // counters were read at the start
+  uint64_t values[KFS_PERF_COUNT];
+} KFS_PerfSpan;
+
+typedef struct {
+  uint64_t count;
+  uint64_t sums[KFS_PERF_COUNT];
+  bool counted[KFS_PERF_COUNT]; // false for events that could not be opened
+} KFS_PerfStats;
+
+// the calling thread's counters; false if it has none
+bool kfs_perf_read(uint64_t values[KFS_PERF_COUNT]);
+void kfs_perf_push(const KFS_PerfSpan *span, int op);
+
+static inline void kfs_perf_begin(KFS_PerfSpan *span) {
+  span->valid =
+      __builtin_expect(atomic_load_explicit(&kfs_perf_on, memory_order_relaxed),
+                       0) &&
+      kfs_perf_read(span->values);
+}
+
+static inline void kfs_perf_end(const KFS_PerfSpan *span, int op) {
+  if (__builtin_expect(span->valid, 0)) {
+    kfs_perf_push(span, op);
+  }
+}
+
+// consumes the kfs_perf option from args
+int kfs_perf_parse(struct fuse_args *args);
+// false if counters are not available here
+bool kfs_perf_enable(bool on);
+// totals since the last reset
+void kfs_perf_get(int op, KFS_PerfStats *out);
+void kfs_perf_reset(void);
+sds kfs_perf_render(void);
+
+#endif
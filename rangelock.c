@@ -0,0 +1,67 @@
+#include "kfs.h"
+
+void kfs_range_init(KFS_RangeLock *rl) {
+  pthread_mutex_init(&rl->lock, NULL);
+  pthread_cond_init(&rl->released, NULL);
+  rl->held = NULL;
+}
+
+void kfs_range_destroy(KFS_RangeLock *rl) {
+  assert(rl->held == NULL);
+  pthread_mutex_destroy(&rl->lock);
+  pthread_cond_destroy(&rl->released);
+}
+
+static bool conflicts(KFS_RangeLock *rl, KFS_RangeHold *hold) {
+  for (KFS_RangeHold *h = rl->held; h != NULL; h = h->next) {
+    if (h->start < hold->end && hold->start < h->end &&
+        (h->write || hold->write)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void fill(KFS_RangeHold *hold, off_t start, off_t end, bool write) {
+  hold->start = start;
+  hold->end = end;
+  hold->write = write;
+}
+
+void kfs_range_lock(KFS_RangeLock *rl, KFS_RangeHold *hold, off_t start,
+                    off_t end, bool write) {
+  fill(hold, start, end, write);
+
+  pthread_mutex_lock(&rl->lock);
+  while (conflicts(rl, hold)) {
+    pthread_cond_wait(&rl->released, &rl->lock);
+  }
+  hold->next = rl->held;
+  rl->held = hold;
+  pthread_mutex_unlock(&rl->lock);
+}
+
+bool kfs_range_trylock(KFS_RangeLock *rl, KFS_RangeHold *hold, off_t start,
+                       off_t end, bool write) {
+  fill(hold, start, end, write);
+
+  pthread_mutex_lock(&rl->lock);
+  bool ok = !conflicts(rl, hold);
+  if (ok) {
+    hold->next = rl->held;
+    rl->held = hold;
+  }
+  pthread_mutex_unlock(&rl->lock);
+  return ok;
+}
+
+void kfs_range_unlock(KFS_RangeLock *rl, KFS_RangeHold *hold) {
+  pthread_mutex_lock(&rl->lock);
+  KFS_RangeHold **p = &rl->held;
+  while (*p != hold) {
+    p = &(*p)->next;
+  }
+  *p = hold->next;
+  pthread_cond_broadcast(&rl->released);
+  pthread_mutex_unlock(&rl->lock);
+}
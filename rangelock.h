@@ -0,0 +1,37 @@
+#ifndef __RANGELOCK_HEADER_INCLUDED__
+#define __RANGELOCK_HEADER_INCLUDED__
+#include <pthread.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+  Byte-range reader/writer lock.  Holders of overlapping ranges exclude each
+  other if either of them writes; disjoint ranges never wait.  The caller
+  supplies the KFS_RangeHold (usually on its stack), so taking a range does
+  not allocate.
+*/
+
+#define KFS_RANGE_EOF ((off_t)(~(unsigned long long)0 >> 1))
+
+typedef struct KFS_RangeHold {
+  off_t start;
+  off_t end; // exclusive
+  bool write;
+  struct KFS_RangeHold *next;
+} KFS_RangeHold;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t released;
+  KFS_RangeHold *held;
+} KFS_RangeLock;
+
+void kfs_range_init(KFS_RangeLock *rl);
+void kfs_range_destroy(KFS_RangeLock *rl);
+void kfs_range_lock(KFS_RangeLock *rl, KFS_RangeHold *hold, off_t start,
+                    off_t end, bool write);
+bool kfs_range_trylock(KFS_RangeLock *rl, KFS_RangeHold *hold, off_t start,
+                       off_t end, bool write);
+void kfs_range_unlock(KFS_RangeLock *rl, KFS_RangeHold *hold);
+
+#endif
@@ -0,0 +1,135 @@
+#include "kfs.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+static pthread_mutex_t reclaim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reclaim_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t reclaim_idle = PTHREAD_COND_INITIALIZER;
+static Vector *reclaim_queue; // detached subtree roots
+static bool reclaim_running;
+static bool reclaim_stopping;
+static bool reclaim_busy;
+static pthread_t reclaim_thread;
+static atomic_size_t reclaim_queued;
+
+static void push_child(sds name __attribute__((unused)), KFS_Entry *child,
+                       void *stack) {
+  vec_push((Vector *)stack, child);
+}
+
+// frees the whole subtree, yielding between batches
+static void free_subtree(KFS_Entry *root) {
+  Vector *stack = new_vec();
+  size_t freed = 0;
+
+  vec_push(stack, root);
+  while (stack->len > 0) {
+    KFS_Entry *entry = vec_pop(stack);
+    // below a scratch directory everything lives in its region, which
+    // free_KFS_Entry releases in one go
+    if (EntryIsDir(entry) && entry->region == NULL) {
+      KFS_DirIndex_foreach(GetAVLTree(entry), push_child, stack);
+    }
+    free_KFS_Entry(entry);
+
+    if (++freed % KFS_RECLAIM_BATCH == 0) {
+      sched_yield();
+    }
+  }
+
+  free_vec(stack);
+}
+
+static void *reclaim_main(void *arg __attribute__((unused))) {
+  pthread_mutex_lock(&reclaim_lock);
+
+  for (;;) {
+    while (reclaim_queue->len == 0 && !reclaim_stopping) {
+      pthread_cond_broadcast(&reclaim_idle);
+      pthread_cond_wait(&reclaim_wakeup, &reclaim_lock);
+    }
+    if (reclaim_queue->len == 0) {
+      break;
+    }
+
+    KFS_Entry *root = vec_pop(reclaim_queue);
+    reclaim_busy = true;
+    pthread_mutex_unlock(&reclaim_lock);
+
+    free_subtree(root);
+    atomic_fetch_sub(&reclaim_queued, 1);
+
+    pthread_mutex_lock(&reclaim_lock);
+    reclaim_busy = false;
+  }
+
+  pthread_cond_broadcast(&reclaim_idle);
+  pthread_mutex_unlock(&reclaim_lock);
+  return NULL;
+}
+
+static void ensure_queue(void) {
+  if (reclaim_queue == NULL) {
+    reclaim_queue = new_vec();
+  }
+}
+
+void kfs_reclaim_start(void) {
+  pthread_mutex_lock(&reclaim_lock);
+  ensure_queue();
+  if (!reclaim_running) {
+    reclaim_stopping = false;
+    if (pthread_create(&reclaim_thread, NULL, reclaim_main, NULL) == 0) {
+      reclaim_running = true;
+    }
+  }
+  pthread_mutex_unlock(&reclaim_lock);
+}
+
+void kfs_reclaim_stop(void) {
+  pthread_mutex_lock(&reclaim_lock);
+  if (!reclaim_running) {
+    pthread_mutex_unlock(&reclaim_lock);
+    kfs_reclaim_drain();
+    return;
+  }
+  reclaim_stopping = true;
+  pthread_cond_signal(&reclaim_wakeup);
+  pthread_mutex_unlock(&reclaim_lock);
+
+  pthread_join(reclaim_thread, NULL);
+  reclaim_running = false;
+}
+
+void kfs_reclaim_enqueue(KFS_Entry *detached) {
+  assert(detached->prev == NULL);
+
+  pthread_mutex_lock(&reclaim_lock);
+  ensure_queue();
+  vec_push(reclaim_queue, detached);
+  atomic_fetch_add(&reclaim_queued, 1);
+  pthread_cond_signal(&reclaim_wakeup);
+  pthread_mutex_unlock(&reclaim_lock);
+}
+
+void kfs_reclaim_drain(void) {
+  pthread_mutex_lock(&reclaim_lock);
+  ensure_queue();
+
+  if (reclaim_running) {
+    while (reclaim_queue->len > 0 || reclaim_busy) {
+      pthread_cond_wait(&reclaim_idle, &reclaim_lock);
+    }
+  } else {
+    while (reclaim_queue->len > 0) {
+      KFS_Entry *root = vec_pop(reclaim_queue);
+      free_subtree(root);
+      atomic_fetch_sub(&reclaim_queued, 1);
+    }
+  }
+
+  pthread_mutex_unlock(&reclaim_lock);
+}
+
+size_t kfs_reclaim_pending(void) { return atomic_load(&reclaim_queued); }
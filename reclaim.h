@@ -0,0 +1,23 @@
+#ifndef __RECLAIM_HEADER_INCLUDED__
+#define __RECLAIM_HEADER_INCLUDED__
+#include "kfs.h"
+
+/*
+  Background reclamation of detached subtrees.  Unlinking only takes the
+  subtree out of its parent's index; the entries, names, indexes and file
+  data below it are handed to a reclaimer thread that frees them in batches
+  of KFS_RECLAIM_BATCH entries.  The caller must guarantee that nothing can
+  still reach the subtree (see kfs_ns_wrlock in interface.c).
+*/
+
+#define KFS_RECLAIM_BATCH 4096
+
+void kfs_reclaim_start(void);
+void kfs_reclaim_stop(void); // drains the queue first
+void kfs_reclaim_enqueue(KFS_Entry *detached);
+// free everything queued so far; when the thread is not running this is
+// done by the caller
+void kfs_reclaim_drain(void);
+size_t kfs_reclaim_pending(void);
+
+#endif
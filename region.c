@@ -0,0 +1,146 @@
+#include "kfs.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+KFS_Region *kfs_region_new(KFS_Entry *owner) {
+  KFS_Region *region = xmalloc(sizeof(KFS_Region));
+  pthread_mutex_init(&region->lock, NULL);
+  region->blocks = NULL;
+  region->reserved = 0;
+  region->bumped = 0;
+  region->syncs = NULL;
+  region->quota_dirs = 0;
+  region->owner = owner;
+  return region;
+}
+
+void kfs_region_destroy(KFS_Region *region) {
+  KFS_RegionBlock *block = region->blocks;
+  while (block != NULL) {
+    KFS_RegionBlock *next = block->next;
+    kfs_alloc_count(KFS_ALLOC_regions, -1,
+                    -(int64_t)(sizeof(KFS_RegionBlock) + block->size));
+    free(block);
+    block = next;
+  }
+
+  pthread_mutex_destroy(&region->lock);
+  free(region);
+}
+
+static KFS_RegionBlock *new_block(KFS_Region *region, size_t size) {
+  KFS_RegionBlock *block;
+  if (posix_memalign((void **)&block, KFS_CACHE_LINE,
+                     sizeof(KFS_RegionBlock) + size) != 0) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  block->size = size;
+  block->used = 0;
+  region->reserved += size;
+  kfs_alloc_count(KFS_ALLOC_regions, 1, sizeof(KFS_RegionBlock) + size);
+  return block;
+}
+
+// a block of its own, exactly as large as one allocation (to a page),
+// behind the head so the space left in the head is not abandoned
+static KFS_RegionBlock *large_block(KFS_Region *region, size_t size) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  KFS_RegionBlock *block = new_block(region, (size + page - 1) / page * page);
+  block->used = block->size;
+
+  KFS_RegionBlock *head = region->blocks;
+  if (head != NULL) {
+    block->next = head->next;
+    head->next = block;
+  } else {
+    block->next = NULL;
+    region->blocks = block;
+  }
+  return block;
+}
+
+// small allocations bump into the head, which grows with the bytes small
+// allocations have taken so far, so large scratch trees use few blocks
+static KFS_RegionBlock *head_block(KFS_Region *region, size_t need) {
+  size_t size = region->bumped < KFS_REGION_MIN_BLOCK ? KFS_REGION_MIN_BLOCK
+                                                      : region->bumped;
+  if (size > KFS_REGION_MAX_BLOCK) {
+    size = KFS_REGION_MAX_BLOCK;
+  }
+  if (size < need) {
+    size = need;
+  }
+
+  KFS_RegionBlock *block = new_block(region, size);
+  region->bumped += size;
+  block->next = region->blocks;
+  region->blocks = block;
+  return block;
+}
+
+void *kfs_region_alloc(KFS_Region *region, size_t size, size_t align) {
+  if (region == NULL) {
+    void *ptr;
+    if (align <= sizeof(void *)) {
+      return xmalloc(size);
+    }
+    if (posix_memalign(&ptr, align, size) != 0) {
+      fprintf(stderr, "Failed to allocate memory\n");
+      exit(EXIT_FAILURE);
+    }
+    return ptr;
+  }
+
+  pthread_mutex_lock(&region->lock);
+
+  void *ptr;
+  if (size >= KFS_REGION_MIN_BLOCK / 2) {
+    ptr = large_block(region, size)->data;
+  } else {
+    KFS_RegionBlock *block = region->blocks;
+    size_t at = block ? (block->used + align - 1) & ~(align - 1) : 0;
+    if (block == NULL || at + size > block->size) {
+      block = head_block(region, size);
+      at = 0;
+    }
+    block->used = at + size;
+    ptr = block->data + at;
+  }
+
+  pthread_mutex_unlock(&region->lock);
+  return ptr;
+}
+
+void *kfs_region_realloc(KFS_Region *region, void *ptr, size_t old_size,
+                         size_t new_size) {
+  if (region == NULL) {
+    return xrealloc(ptr, new_size);
+  }
+
+  void *fresh = kfs_region_alloc(region, new_size, sizeof(void *));
+  if (ptr != NULL) {
+    memcpy(fresh, ptr, old_size < new_size ? old_size : new_size);
+  }
+  return fresh;
+}
+
+void kfs_region_free(KFS_Region *region, void *ptr) {
+  if (region == NULL) {
+    free(ptr);
+  }
+}
+
+bool kfs_scratch_enable(KFS_Entry *dir) {
+  assert_is_dir(dir);
+  if (dir->region != NULL || GetAVLTree(dir)->size > 0) {
+    return false;
+  }
+
+  dir->region = kfs_region_new(dir);
+  return true;
+}
+
+bool kfs_is_scratch(KFS_Entry *dir) {
+  return dir->region != NULL && dir->region->owner == dir;
+}
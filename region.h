@@ -0,0 +1,50 @@
+#ifndef __REGION_HEADER_INCLUDED__
+#define __REGION_HEADER_INCLUDED__
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+  Bump allocator backing a scratch directory.  Everything created below the
+  directory (entries, names, index pools, file chunks) is carved out of the
+  region's blocks and individual frees are no-ops; removing the directory
+  releases all blocks at once.  A NULL region means the regular heap.
+  Allocations of KFS_REGION_MIN_BLOCK/2 or more, such as file chunks, get
+  a block of their own sized to fit.
+*/
+
+#define KFS_REGION_MIN_BLOCK (64 * 1024)
+#define KFS_REGION_MAX_BLOCK (16 * 1024 * 1024)
+
+struct KFS_Entry;
+
+typedef struct KFS_RegionBlock {
+  struct KFS_RegionBlock *next;
+  size_t size;
+  size_t used;
+  char data[] __attribute__((aligned(64)));
+} KFS_RegionBlock;
+
+typedef struct KFS_Region {
+  pthread_mutex_t lock;
+  KFS_RegionBlock *blocks;
+  size_t reserved; // bytes held in blocks
+  size_t bumped;   // of which in blocks small allocations bump into
+  struct KFS_Entry *owner; // the scratch directory
+  struct KFS_FileSync *syncs; // of files in the region, see file.h
+  int quota_dirs; // directories in the region with a quota, see usage.h
+} KFS_Region;
+
+KFS_Region *kfs_region_new(struct KFS_Entry *owner);
+void kfs_region_destroy(KFS_Region *region);
+// align must be a power of two no larger than 64
+void *kfs_region_alloc(KFS_Region *region, size_t size, size_t align);
+void *kfs_region_realloc(KFS_Region *region, void *ptr, size_t old_size,
+                         size_t new_size);
+void kfs_region_free(KFS_Region *region, void *ptr);
+
+// turn an empty, non-scratch directory into a scratch directory
+bool kfs_scratch_enable(struct KFS_Entry *dir);
+bool kfs_is_scratch(struct KFS_Entry *dir);
+
+#endif
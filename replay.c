@@ -0,0 +1,221 @@
+#include "kfs.h"
+#include "kfs_ioctl.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+static int get_varint(FILE *in, uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = fgetc(in);
+    if (c == EOF) {
+      return -1;
+    }
+    *v |= (uint64_t)(c & 0x7f) << shift;
+    if ((c & 0x80) == 0) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int get_signed(FILE *in, int64_t *v) {
+  uint64_t u;
+  if (get_varint(in, &u) != 0) {
+    return -1;
+  }
+  *v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+  return 0;
+}
+
+static sds get_string(FILE *in, bool varint_len) {
+  uint64_t len;
+  if (varint_len) {
+    if (get_varint(in, &len) != 0) {
+      return NULL;
+    }
+  } else {
+    int c = fgetc(in);
+    if (c == EOF) {
+      return NULL;
+    }
+    len = c;
+  }
+
+  sds s = sdsnewlen(NULL, len);
+  if (fread(s, 1, len, in) != len) {
+    sdsfree(s);
+    return NULL;
+  }
+  return s;
+}
+
+static int ignore_entry(void *buf, const char *name, const struct stat *st,
+                        off_t off) {
+  (void)buf;
+  (void)name;
+  (void)st;
+  (void)off;
+  return 0;
+}
+
+static double seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+  int op;
+  sds path;
+  sds path2;
+  int64_t res;
+  int64_t a;
+  int64_t b;
+  sds name;
+  sds value;
+} Op;
+
+static char *io_buf;
+static size_t io_cap;
+
+static char *io_buffer(size_t size) {
+  if (size > io_cap) {
+    io_buf = xrealloc(io_buf, size);
+    memset(io_buf, 0, size);
+    io_cap = size;
+  }
+  return io_buf;
+}
+
+static int run(Op *op) {
+  struct fuse_file_info fi;
+  memset(&fi, 0, sizeof(fi));
+
+  switch (op->op) {
+  case KFS_OP_getattr: {
+    struct stat st;
+    return kfs_ops.getattr(op->path, &st);
+  }
+  case KFS_OP_readdir:
+    return kfs_ops.readdir(op->path, NULL, ignore_entry, 0, &fi);
+  case KFS_OP_open:
+    fi.flags = op->a;
+    return kfs_ops.open(op->path, &fi);
+  case KFS_OP_read:
+    return kfs_ops.read(op->path, io_buffer(op->b), op->b, op->a, &fi);
+  case KFS_OP_write:
+    return kfs_ops.write(op->path, io_buffer(op->b), op->b, op->a, &fi);
+  case KFS_OP_release:
+    return kfs_ops.release(op->path, &fi);
+  case KFS_OP_mkdir:
+    return kfs_ops.mkdir(op->path, op->a);
+  case KFS_OP_access:
+    return kfs_ops.access(op->path, op->a);
+  case KFS_OP_create:
+    return kfs_ops.create(op->path, op->a, &fi);
+  case KFS_OP_utimens: {
+    struct timespec tv[2];
+    tv[0].tv_sec = tv[1].tv_sec = 0;
+    tv[0].tv_nsec = tv[1].tv_nsec = UTIME_NOW;
+    return kfs_ops.utimens(op->path, tv);
+  }
+  case KFS_OP_unlink:
+    return kfs_ops.unlink(op->path);
+  case KFS_OP_rmdir:
+    return kfs_ops.rmdir(op->path);
+  case KFS_OP_rename:
+    return op->path2 != NULL ? kfs_ops.rename(op->path, op->path2) : -EINVAL;
+  case KFS_OP_chmod:
+    return kfs_ops.chmod(op->path, op->a);
+  case KFS_OP_chown:
+    return kfs_ops.chown(op->path, op->a, op->b);
+  case KFS_OP_truncate:
+    return kfs_ops.truncate(op->path, op->a);
+  case KFS_OP_setxattr:
+    return kfs_ops.setxattr(op->path, op->name, op->value, sdslen(op->value),
+                            0);
+  case KFS_OP_getxattr:
+    return kfs_ops.getxattr(op->path, op->name, io_buffer(op->b), op->b);
+  case KFS_OP_ioctl: {
+    struct kfs_ioc_clone req;
+    memset(&req, 0, sizeof(req));
+    if (op->path2 != NULL) {
+      strncpy(req.src, op->path2, sizeof(req.src) - 1);
+    }
+    return kfs_ops.ioctl(op->path, op->a, NULL, &fi, 0, &req);
+  }
+  default:
+    return -ENOSYS;
+  }
+}
+
+int kfs_replay(FILE *in, bool timed, KFS_ReplayResult *result) {
+  char magic[8];
+  if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) ||
+      memcmp(magic, KFS_CAPTURE_MAGIC, sizeof(magic)) != 0) {
+    return -1;
+  }
+
+  Vector *paths = new_vec();
+  vec_push(paths, sdsnew("/"));
+  memset(result, 0, sizeof(*result));
+  double start = seconds();
+  double due = 0; // seconds into the capture
+  int ret = 0;
+  int c;
+
+  while ((c = fgetc(in)) != EOF) {
+    if (c == KFS_CAPTURE_PATH) {
+      uint64_t parent, component;
+      if (get_varint(in, &parent) != 0 || get_varint(in, &component) != 0 ||
+          parent >= paths->len) {
+        ret = -1;
+        break;
+      }
+      sds base = paths->data[parent];
+      vec_push(paths, sdscatprintf(sdsempty(), "%s/n%llu",
+                                   parent == 0 ? "" : base,
+                                   (unsigned long long)component));
+      continue;
+    }
+
+    Op op = {.op = c};
+    uint64_t dt, id, id2;
+    if (c >= KFS_OP_COUNT || get_varint(in, &dt) != 0 ||
+        get_varint(in, &id) != 0 || get_varint(in, &id2) != 0 ||
+        get_signed(in, &op.res) != 0 || get_signed(in, &op.a) != 0 ||
+        get_signed(in, &op.b) != 0 || id >= paths->len ||
+        id2 > paths->len || (op.name = get_string(in, false)) == NULL ||
+        (op.value = get_string(in, true)) == NULL) {
+      sdsfree(op.name);
+      ret = -1;
+      break;
+    }
+    op.path = paths->data[id];
+    op.path2 = id2 > 0 ? paths->data[id2 - 1] : NULL;
+
+    due += dt / 1e6;
+    if (timed) {
+      double wait = due - (seconds() - start);
+      if (wait > 0) {
+        struct timespec ts;
+        ts.tv_sec = (time_t)wait;
+        ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+        nanosleep(&ts, NULL);
+      }
+    }
+
+    if (run(&op) != op.res) {
+      result->diverged++;
+    }
+    result->ops++;
+    sdsfree(op.name);
+    sdsfree(op.value);
+  }
+
+  result->seconds = seconds() - start;
+  VecForeach(paths, path, { sdsfree(path); });
+  free_vec(paths);
+  return ret;
+}
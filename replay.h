@@ -0,0 +1,24 @@
+#ifndef __REPLAY_HEADER_INCLUDED__
+#define __REPLAY_HEADER_INCLUDED__
+#include "kfs.h"
+#include <stdio.h>
+
+/*
+  Replays a capture (see capture.h) in-process through kfs_ops, so it runs
+  the same locking, stats and tracing as a mount, without one.  Writes
+  carry zeros.  A replayed operation whose result differs from the
+  captured one counts as diverged, which is expected when the capture did
+  not start on an empty file system.
+*/
+
+typedef struct {
+  uint64_t ops;
+  uint64_t diverged;
+  double seconds;
+} KFS_ReplayResult;
+
+// timed: keep the captured pacing instead of running flat out;
+// 0, or -1 if the input is not a well-formed capture
+int kfs_replay(FILE *in, bool timed, KFS_ReplayResult *result);
+
+#endif
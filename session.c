@@ -0,0 +1,343 @@
+#define _GNU_SOURCE // CPU_SET, pthread_setaffinity_np
+#include "kfs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <fuse_lowlevel.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// from <linux/fuse.h>; not every libfuse 2 install ships it
+#ifndef FUSE_DEV_IOC_CLONE
+#define FUSE_DEV_IOC_CLONE _IOR(229, 0, uint32_t)
+#endif
+#define FUSE_IN_HEADER_SIZE 40
+
+KFS_SessionOpts kfs_session_opts = {.idle_mode = KFS_IDLE_BLOCK,
+                                    .spin_us = 50};
+
+#define KFS_SESSION_OPT(t, field)                                              \
+  { t, offsetof(KFS_SessionOpts, field), 1 }
+
+static const struct fuse_opt session_opts[] = {
+    KFS_SESSION_OPT("kfs_workers=%d", workers),
+    KFS_SESSION_OPT("kfs_queue_depth=%u", queue_depth),
+    KFS_SESSION_OPT("kfs_idle=%s", idle),
+    KFS_SESSION_OPT("kfs_spin_us=%d", spin_us),
+    KFS_SESSION_OPT("kfs_nopin", nopin),
+    KFS_SESSION_OPT("kfs_noclone", noclone),
+    KFS_SESSION_OPT("kfs_max_write=%u", max_write),
+    KFS_SESSION_OPT("kfs_max_readahead=%u", max_readahead),
+    KFS_SESSION_OPT("kfs_sync_read", sync_read),
+    KFS_SESSION_OPT("kfs_small_writes", small_writes),
+    KFS_SESSION_OPT("kfs_stock_conn", stock_conn),
+    FUSE_OPT_END};
+
+int kfs_session_parse(struct fuse_args *args) {
+  KFS_SessionOpts *opts = &kfs_session_opts;
+  if (fuse_opt_parse(args, opts, session_opts, NULL) == -1) {
+    return -1;
+  }
+
+  if (opts->idle != NULL) {
+    if (strcmp(opts->idle, "spin") == 0) {
+      opts->idle_mode = KFS_IDLE_SPIN;
+    } else if (strcmp(opts->idle, "block") == 0) {
+      opts->idle_mode = KFS_IDLE_BLOCK;
+    } else {
+      fprintf(stderr, "kfs: unknown kfs_idle mode '%s'\n", opts->idle);
+      return -1;
+    }
+  }
+  if (opts->workers <= 0) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    opts->workers = n > 0 ? (int)n : 1;
+  }
+
+  return 0;
+}
+
+void kfs_session_init_conn(struct fuse_conn_info *conn) {
+  KFS_SessionOpts *opts = &kfs_session_opts;
+
+  if (opts->queue_depth > 0) {
+    conn->max_background = opts->queue_depth;
+    conn->congestion_threshold = opts->queue_depth * 3 / 4;
+  }
+  if (opts->stock_conn) {
+    return;
+  }
+
+  // max_write and max_readahead arrive as the most libfuse's buffers and
+  // the kernel accept, so they can only be lowered
+  if (opts->max_write > 0 && opts->max_write < conn->max_write) {
+    conn->max_write = opts->max_write;
+  }
+  if (opts->max_readahead > 0 && opts->max_readahead < conn->max_readahead) {
+    conn->max_readahead = opts->max_readahead;
+  }
+
+  if (!opts->small_writes) {
+    conn->want |= conn->capable & FUSE_CAP_BIG_WRITES;
+  }
+  // libfuse asks for async reads if either of these is set
+  if (opts->sync_read) {
+    conn->want &= ~FUSE_CAP_ASYNC_READ;
+    conn->async_read = 0;
+  } else {
+    conn->want |= conn->capable & FUSE_CAP_ASYNC_READ;
+    conn->async_read = (conn->capable & FUSE_CAP_ASYNC_READ) != 0;
+  }
+}
+
+typedef struct {
+  pthread_t thread;
+  int id;
+  struct fuse_session *se;
+  struct fuse_chan *ch; // own clone, or the shared channel
+  size_t bufsize;
+  char *buf;
+} Worker;
+
+static struct fuse_chan *session_chan;
+static sem_t session_done;
+
+struct fuse_chan *kfs_session_chan(void) { return session_chan; }
+
+/*
+  Channel operations for cloned descriptors, mirroring libfuse's own
+  kernel channel; the worker is the channel's data.
+*/
+static int clone_receive(struct fuse_chan **chp, char *buf, size_t size) {
+  Worker *w = fuse_chan_data(*chp);
+
+  for (;;) {
+    ssize_t res = read(fuse_chan_fd(*chp), buf, size);
+    int err = errno;
+
+    if (fuse_session_exited(w->se)) {
+      return 0;
+    }
+    if (res == -1) {
+      if (err == ENOENT) { // the request was interrupted; read again
+        continue;
+      }
+      if (err == ENODEV) { // unmounted
+        fuse_session_exit(w->se);
+        return 0;
+      }
+      if (err != EINTR && err != EAGAIN) {
+        perror("kfs: reading device");
+      }
+      return -err;
+    }
+    if ((size_t)res < FUSE_IN_HEADER_SIZE) {
+      fprintf(stderr, "kfs: short read on fuse device\n");
+      return -EIO;
+    }
+    return res;
+  }
+}
+
+static int clone_send(struct fuse_chan *ch, const struct iovec iov[],
+                      size_t count) {
+  if (iov == NULL) {
+    return 0;
+  }
+
+  ssize_t res = writev(fuse_chan_fd(ch), iov, count);
+  int err = errno;
+  if (res == -1) {
+    Worker *w = fuse_chan_data(ch);
+    // ENOENT: the request was interrupted in the meantime
+    if (!fuse_session_exited(w->se) && err != ENOENT) {
+      perror("kfs: writing device");
+    }
+    return -err;
+  }
+  return 0;
+}
+
+static void clone_destroy(struct fuse_chan *ch) { close(fuse_chan_fd(ch)); }
+
+static struct fuse_chan_ops clone_ops = {
+    .receive = clone_receive, .send = clone_send, .destroy = clone_destroy};
+
+static struct fuse_chan *clone_chan(Worker *w, struct fuse_chan *master) {
+  int fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+  if (fd == -1) {
+    return NULL;
+  }
+
+  uint32_t master_fd = fuse_chan_fd(master);
+  if (ioctl(fd, FUSE_DEV_IOC_CLONE, &master_fd) == -1) {
+    close(fd);
+    return NULL;
+  }
+
+  struct fuse_chan *ch = fuse_chan_new(&clone_ops, fd, w->bufsize, w);
+  if (ch == NULL) {
+    close(fd);
+  }
+  return ch;
+}
+
+static void pin(Worker *w) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus <= 0) {
+    return;
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(w->id % cpus, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+// spin mode: the descriptor is non-blocking; poll it for a while before
+// sleeping, so a burst of requests does not pay a wakeup per request
+static void wait_readable(Worker *w) {
+  int fd = fuse_chan_fd(w->ch);
+  double deadline = kfs_session_opts.spin_us * 1e3;
+  struct timespec start, now;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (;;) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (poll(&pfd, 1, 0) > 0) {
+      return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((now.tv_sec - start.tv_sec) * 1e9 + (now.tv_nsec - start.tv_nsec) >
+        deadline) {
+      break;
+    }
+    sched_yield();
+  }
+
+  struct pollfd pfd = {.fd = fd, .events = POLLIN};
+  poll(&pfd, 1, -1);
+}
+
+static void *worker_main(void *arg) {
+  Worker *w = arg;
+  if (!kfs_session_opts.nopin) {
+    pin(w);
+  }
+
+  while (!fuse_session_exited(w->se)) {
+    struct fuse_chan *ch = w->ch;
+    struct fuse_buf fbuf = {.mem = w->buf, .size = w->bufsize};
+
+    int res = fuse_session_receive_buf(w->se, &fbuf, &ch);
+    if (res == -EINTR) {
+      continue;
+    }
+    if (res == -EAGAIN) {
+      wait_readable(w);
+      continue;
+    }
+    if (res <= 0) {
+      if (res < 0) {
+        fuse_session_exit(w->se);
+      }
+      break;
+    }
+
+    // the loop is stopped by cancelling workers blocked in read; never
+    // while a request is half processed
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    fuse_session_process_buf(w->se, &fbuf, ch);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+  }
+
+  sem_post(&session_done);
+  return NULL;
+}
+
+int kfs_session_loop(struct fuse *fuse) {
+  KFS_SessionOpts *opts = &kfs_session_opts;
+  struct fuse_session *se = fuse_get_session(fuse);
+  struct fuse_chan *master = fuse_session_next_chan(se, NULL);
+  session_chan = master;
+
+  int nworkers = opts->workers;
+  Worker *workers = xmalloc(sizeof(Worker) * nworkers);
+  size_t bufsize = fuse_chan_bufsize(master);
+  bool spin = opts->idle_mode == KFS_IDLE_SPIN;
+  int cloned = 0;
+
+  sem_init(&session_done, 0, 0);
+
+  for (int i = 0; i < nworkers; i++) {
+    Worker *w = &workers[i];
+    w->id = i;
+    w->se = se;
+    w->bufsize = bufsize;
+    w->buf = xmalloc(bufsize);
+    w->ch = master;
+
+    // worker 0 keeps the mount's own channel
+    if (i > 0 && !opts->noclone) {
+      struct fuse_chan *ch = clone_chan(w, master);
+      if (ch != NULL) {
+        w->ch = ch;
+        cloned++;
+      }
+    }
+    if (spin) {
+      int fd = fuse_chan_fd(w->ch);
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+  }
+
+  // signals belong to the main thread, which only waits for the workers
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  int started = 0;
+  for (; started < nworkers; started++) {
+    if (pthread_create(&workers[started].thread, NULL, worker_main,
+                       &workers[started]) != 0) {
+      fuse_session_exit(se);
+      break;
+    }
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  if (!fuse_session_exited(se)) {
+    fprintf(stderr, "kfs: %d workers, %d cloned channels, %s idle\n",
+            nworkers, cloned, spin ? "spin" : "block");
+  }
+  while (!fuse_session_exited(se)) {
+    sem_wait(&session_done);
+  }
+
+  for (int i = 0; i < started; i++) {
+    pthread_cancel(workers[i].thread);
+  }
+  for (int i = 0; i < started; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+  for (int i = 0; i < nworkers; i++) {
+    if (workers[i].ch != master) {
+      fuse_chan_destroy(workers[i].ch);
+    }
+    free(workers[i].buf);
+  }
+
+  free(workers);
+  sem_destroy(&session_done);
+  fuse_session_reset(se);
+  session_chan = NULL;
+  return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef __SESSION_HEADER_INCLUDED__
+#define __SESSION_HEADER_INCLUDED__
+#include "kfs.h"
+
+/*
+  Our own multi-threaded session loop, replacing fuse_main/fuse_loop_mt.
+  A fixed pool of workers, optionally pinned to CPUs, each reading from its
+  own clone of the /dev/fuse channel when the kernel supports
+  FUSE_DEV_IOC_CLONE (all of them share the mount's channel otherwise).
+  Mount options:
+    -o kfs_workers=N      worker count (default: online CPUs)
+    -o kfs_queue_depth=N  kernel background queue depth (max_background)
+    -o kfs_idle=MODE      block: sleep in read(2) while idle (default)
+                          spin:  poll the channel for kfs_spin_us first
+    -o kfs_spin_us=N      spin window per idle period (default 50)
+    -o kfs_nopin          do not pin workers to CPUs
+    -o kfs_noclone        share one channel even if cloning works
+  Connection parameters, negotiated in the init handler.  By default KFS
+  asks for big writes and async reads, and takes the largest max_write and
+  max_readahead the kernel and libfuse offer:
+    -o kfs_max_write=N      cap on the size of one write request
+    -o kfs_max_readahead=N  cap on kernel readahead
+    -o kfs_sync_read        no async reads
+    -o kfs_small_writes     no big writes (page-sized write requests)
+    -o kfs_stock_conn       leave the connection at libfuse's defaults
+*/
+
+enum { KFS_IDLE_BLOCK, KFS_IDLE_SPIN };
+
+typedef struct {
+  int workers;
+  unsigned queue_depth; // 0: kernel default
+  char *idle;
+  int idle_mode;
+  int spin_us;
+  int nopin;
+  int noclone;
+  unsigned max_write;     // 0: as large as offered
+  unsigned max_readahead; // 0: as large as offered
+  int sync_read;
+  int small_writes;
+  int stock_conn;
+} KFS_SessionOpts;
+
+extern KFS_SessionOpts kfs_session_opts;
+
+// consumes the kfs_* options from args
+int kfs_session_parse(struct fuse_args *args);
+int kfs_session_loop(struct fuse *fuse);
+// applied from the init handler
+void kfs_session_init_conn(struct fuse_conn_info *conn);
+// the mount's channel, for notifications; NULL before the loop starts
+struct fuse_chan *kfs_session_chan(void);
+
+#endif
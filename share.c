@@ -0,0 +1,236 @@
+#define _GNU_SOURCE // accept4, struct ucred
+#include "kfs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static pthread_mutex_t share_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool share_running;
+static pthread_t share_thread;
+static int share_listen_fd = -1;
+static int share_wake[2] = {-1, -1}; // written to by stop
+static sds share_socket;
+
+static struct {
+  char *socket;
+} share_opts;
+
+static const struct fuse_opt share_fuse_opts[] = {{"kfs_share=%s", 0, 0},
+                                                  FUSE_OPT_END};
+
+int kfs_share_parse(struct fuse_args *args) {
+  if (fuse_opt_parse(args, &share_opts, share_fuse_opts, NULL) == -1) {
+    return -1;
+  }
+
+  // the daemon changes to / before the socket is bound
+  if (share_opts.socket != NULL && share_opts.socket[0] != '/') {
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+      return -1;
+    }
+    sds abs = sdscatprintf(sdsempty(), "%s/%s", cwd, share_opts.socket);
+    free(share_opts.socket);
+    share_opts.socket = strdup(abs);
+    sdsfree(abs);
+  }
+  return 0;
+}
+
+void kfs_share_service_start(void) {
+  if (share_opts.socket != NULL && !kfs_share_listen(share_opts.socket)) {
+    perror(share_opts.socket);
+  }
+}
+
+// like FUSE without allow_other: only the daemon's user, and root
+static bool peer_allowed(int fd) {
+  struct ucred cred;
+  socklen_t len = sizeof(cred);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1) {
+    return false;
+  }
+  return cred.uid == 0 || cred.uid == getuid();
+}
+
+// res is a view fd, which is passed on and closed, or -errno
+static void reply(int fd, int res) {
+  int32_t status = res < 0 ? res : 0;
+  struct iovec iov = {&status, sizeof(status)};
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  if (res >= 0) {
+    memset(&control, 0, sizeof(control));
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &res, sizeof(int));
+  }
+
+  // a reader that went away is noticed on its next poll
+  sendmsg(fd, &msg, MSG_NOSIGNAL);
+  if (res >= 0) {
+    close(res);
+  }
+}
+
+// false once the connection is closed
+static bool serve(int fd) {
+  char path[4096];
+  ssize_t len = recv(fd, path, sizeof(path) - 1, 0);
+  if (len <= 0) {
+    return false;
+  }
+
+  path[len] = '\0';
+  reply(fd, path[0] == '/' ? kfs_ns_share(path) : -EINVAL);
+  return true;
+}
+
+static void *share_main(void *arg __attribute__((unused))) {
+  struct pollfd fds[2 + KFS_SHARE_MAX_CLIENTS];
+  nfds_t nfds = 2;
+  fds[0] = (struct pollfd){.fd = share_wake[0], .events = POLLIN};
+  fds[1] = (struct pollfd){.fd = share_listen_fd, .events = POLLIN};
+
+  for (;;) {
+    if (poll(fds, nfds, -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (fds[0].revents != 0) {
+      break;
+    }
+
+    for (nfds_t i = 2; i < nfds;) {
+      if (fds[i].revents != 0 && !serve(fds[i].fd)) {
+        close(fds[i].fd);
+        fds[i] = fds[--nfds];
+      } else {
+        fds[i++].revents = 0;
+      }
+    }
+
+    if (fds[1].revents != 0) {
+      int fd = accept4(share_listen_fd, NULL, NULL, SOCK_CLOEXEC);
+      bool room = nfds < 2 + KFS_SHARE_MAX_CLIENTS;
+      if (fd != -1 && room && peer_allowed(fd)) {
+        fds[nfds++] = (struct pollfd){.fd = fd, .events = POLLIN};
+      } else if (fd != -1) {
+        close(fd);
+      }
+      fds[1].revents = 0;
+    }
+  }
+
+  for (nfds_t i = 2; i < nfds; i++) {
+    close(fds[i].fd);
+  }
+  return NULL;
+}
+
+// a listening socket at socket_path, or -1 with errno set
+static int open_socket(const char *socket_path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  // a socket left behind by a daemon that did not stop cleanly
+  struct stat st;
+  if (stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(socket_path);
+  }
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  if (listen(fd, SOMAXCONN) == -1) {
+    int saved = errno;
+    close(fd);
+    unlink(socket_path);
+    errno = saved;
+    return -1;
+  }
+  return fd;
+}
+
+bool kfs_share_listen(const char *socket_path) {
+  kfs_share_stop();
+  int fd = open_socket(socket_path);
+  if (fd == -1) {
+    return false;
+  }
+
+  pthread_mutex_lock(&share_lock);
+  share_listen_fd = fd;
+  share_socket = sdsnew(socket_path);
+  share_running = pipe2(share_wake, O_CLOEXEC) == 0 &&
+                  pthread_create(&share_thread, NULL, share_main, NULL) == 0;
+  bool ok = share_running;
+  pthread_mutex_unlock(&share_lock);
+
+  if (!ok) {
+    int saved = errno;
+    kfs_share_stop();
+    errno = saved;
+  }
+  return ok;
+}
+
+void kfs_share_stop(void) {
+  pthread_mutex_lock(&share_lock);
+  if (share_running) {
+    char stop = 1;
+    if (write(share_wake[1], &stop, 1) == 1) {
+      pthread_join(share_thread, NULL);
+    }
+    share_running = false;
+  }
+  if (share_listen_fd != -1) {
+    close(share_listen_fd);
+    share_listen_fd = -1;
+  }
+  for (int i = 0; i < 2; i++) {
+    if (share_wake[i] != -1) {
+      close(share_wake[i]);
+      share_wake[i] = -1;
+    }
+  }
+  if (share_socket != NULL) {
+    unlink(share_socket);
+    sdsfree(share_socket);
+    share_socket = NULL;
+  }
+  pthread_mutex_unlock(&share_lock);
+}
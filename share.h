@@ -0,0 +1,25 @@
+#ifndef __SHARE_HEADER_INCLUDED__
+#define __SHARE_HEADER_INCLUDED__
+#include "kfs.h"
+
+/*
+  The Unix socket that hands out shared views of files (shm.h) to readers
+  on the same host; the protocol and the client are in kfs_shm.h.  One
+  thread polls the socket and its connections.  A request costs a lookup
+  under the namespace lock and, the first time, a copy of the file into
+  its view, so it is answered inline.
+
+  Turned on with -o kfs_share=SOCKET.
+*/
+
+#define KFS_SHARE_MAX_CLIENTS 256
+
+// consumes the kfs_share option from args
+int kfs_share_parse(struct fuse_args *args);
+// the service started by init: listens on the socket given with kfs_share=
+void kfs_share_service_start(void);
+// replaces a stale socket at socket_path
+bool kfs_share_listen(const char *socket_path);
+void kfs_share_stop(void); // closes every connection and removes the socket
+
+#endif
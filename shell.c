@@ -1,4 +1,5 @@
 #include "kfs.h"
+#include <fnmatch.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,9 +15,21 @@
 #define Cat "cat"
 #define Help "help"
 #define Copy "cp"
-
-static const char *KFSCommands[] = {Mkdir, Chdir,        Touch, Ls,   Pwd,
-                                    Tree,  CopyFromHost, Cat,   Help, Copy};
+#define Du "du"
+#define Find "find"
+#define Quota "quota"
+#define Rm "rm"
+#define Mv "mv"
+#define Stats "stats"
+#define Trace "trace"
+#define Perf "perf"
+#define Alloc "alloc"
+
+static const char *KFSCommands[] = {Mkdir, Chdir, Touch,        Ls,
+                                    Pwd,   Tree,  CopyFromHost, Cat,
+                                    Help,  Copy,  Du,           Find,
+                                    Quota, Rm,    Mv,           Stats,
+                                    Trace, Perf,  Alloc};
 
 KFSShellContext *new_KFSShellContext(KFS_Entry *root) {
   assert_is_dir(root);
@@ -26,16 +39,25 @@ KFSShellContext *new_KFSShellContext(KFS_Entry *root) {
   return ctx;
 }
 
-bool kfs_mkdir(KFSShellContext *ctx, sds name) {
-  WithCtx(ctx, {
-    KFS_Entry *ret = kfs_find_on(cwd, name);
-    if (ret == NULL) {
-      kfs_append_child(cwd, new_KFS_Dir(name));
-      return true;
-    }
+// the absolute path of name, which is relative to cwd unless it starts
+// with '/'; mkdir, touch, ls and cat go through the same path layer as the
+// daemon and libkfs
+static sds shell_path(KFSShellContext *ctx, const char *name) {
+  if (name[0] == '/') {
+    return sdsnew(name);
+  }
+  sds path = kfs_getPwd(ctx->cwd);
+  if (path[sdslen(path) - 1] != '/') {
+    path = sdscat(path, "/");
+  }
+  return sdscat(path, name);
+}
 
-    return false;
-  });
+bool kfs_mkdir(KFSShellContext *ctx, sds name) {
+  sds path = shell_path(ctx, name);
+  int res = kfs_path_mkdir(ctx->root, path, 0755);
+  sdsfree(path);
+  return res == 0;
 }
 
 bool kfs_chdir(KFSShellContext *ctx, sds target) {
@@ -67,40 +89,270 @@ bool kfs_chdir(KFSShellContext *ctx, sds target) {
 }
 
 bool kfs_touch(KFSShellContext *ctx, sds name) {
-  WithCtx(ctx, {
-    KFS_Entry *ret = kfs_find_on(cwd, name);
-    if (ret == NULL) {
-      kfs_append_child(cwd, new_KFS_File(name));
-      return true;
+  sds path = shell_path(ctx, name);
+  int res = kfs_path_create(ctx->root, path, 0444, NULL);
+  sdsfree(path);
+  return res == 0;
+}
+
+static int print_name(void *arg __attribute__((unused)), const char *name) {
+  printf("%s\n", name);
+  return 0;
+}
+
+bool kfs_ls(KFSShellContext *ctx, sds path) {
+  sds full = shell_path(ctx, path);
+  int res = kfs_path_readdir(ctx->root, full, print_name, NULL);
+  sdsfree(full);
+  return res == 0;
+}
+
+bool kfs_pwd(KFSShellContext *ctx) {
+  sds pwd = kfs_getPwd(ctx->cwd);
+  printf("%s\n", pwd);
+  sdsfree(pwd);
+
+  return true;
+}
+
+static bool print_path(KFS_WalkEntry *we, void *ctx __attribute__((unused))) {
+  printf("%s\n", we->path);
+  return true;
+}
+
+bool kfs_tree(KFSShellContext *ctx) {
+  sds pwd = kfs_getPwd(ctx->cwd);
+  kfs_walk(ctx->cwd, pwd, 1, KFS_WALK_SORTED, print_path, NULL);
+  sdsfree(pwd);
+  return true;
+}
+
+// resolve an optional path argument, defaulting to cwd
+static KFS_Entry *shell_target(KFSShellContext *ctx, sds path) {
+  if (path == NULL) {
+    return ctx->cwd;
+  }
+  return path[0] == '/' ? kfs_find(ctx->root, path) : kfs_find(ctx->cwd, path);
+}
+
+// O(1): reads the rollups kept by usage.c
+bool kfs_du(KFSShellContext *ctx, sds path) {
+  KFS_Entry *entry = shell_target(ctx, path);
+  if (entry == NULL) {
+    return false;
+  }
+
+  KFS_UsageStat st =
+      EntryIsDir(entry) ? kfs_usage_get(entry) : kfs_usage_of(entry);
+  sds pwd = kfs_getPwd(entry);
+  printf("%lld\t%lld entries\t%s\n", (long long)st.bytes,
+         (long long)st.inodes, pwd);
+
+  sdsfree(pwd);
+  return true;
+}
+
+bool kfs_quota(KFSShellContext *ctx, sds bytes, sds path) {
+  KFS_Entry *entry = shell_target(ctx, path);
+  int64_t limit;
+  if (entry == NULL || !EntryIsDir(entry) ||
+      !kfs_usage_parse_quota(bytes, &limit)) {
+    return false;
+  }
+
+  kfs_usage_set_quota(entry, limit, entry->usage.quota_inodes);
+  return true;
+}
+
+// the subtree is detached right away and freed by the reclaimer
+bool kfs_rm(KFSShellContext *ctx, sds path, bool recursive) {
+  KFS_Entry *entry = shell_target(ctx, path);
+  if (entry == NULL || entry->prev == NULL) {
+    return false;
+  }
+  if (EntryIsDir(entry) && !recursive && GetAVLTree(entry)->size > 0) {
+    return false;
+  }
+  for (KFS_Entry *e = ctx->cwd; e != NULL; e = e->prev) {
+    if (e == entry) { // would pull the working directory out from under us
+      return false;
     }
+  }
 
+  return kfs_remove_tree(entry->prev, entry->name);
+}
+
+// resolve DST of mv/cp: an existing directory means "into it under
+// default_name", anything else names the new entry itself
+static KFS_Entry *shell_dest(KFSShellContext *ctx, sds dst, sds default_name,
+                             sds *name) {
+  sds probe = sdsdup(dst); // kfs_find trims its argument
+  KFS_Entry *target = shell_target(ctx, probe);
+  sdsfree(probe);
+
+  if (target != NULL && EntryIsDir(target)) {
+    *name = sdsdup(default_name);
+    return target;
+  }
+
+  KFS_Entry *parent;
+  char *slash = strrchr(dst, '/');
+  if (slash == NULL) {
+    parent = ctx->cwd;
+    *name = sdsnew(dst);
+  } else {
+    sds dir = sdsnewlen(dst, slash - dst);
+    parent = sdslen(dir) == 0 ? ctx->root : shell_target(ctx, dir);
+    *name = sdsnew(slash + 1);
+    sdsfree(dir);
+  }
+
+  if (parent == NULL || !EntryIsDir(parent) || sdslen(*name) == 0) {
+    sdsfree(*name);
+    return NULL;
+  }
+  return parent;
+}
+
+// mv SRC DIR moves SRC into DIR, mv SRC PATH moves and renames it
+bool kfs_mv(KFSShellContext *ctx, sds src, sds dst) {
+  KFS_Entry *entry = shell_target(ctx, src);
+  if (entry == NULL || entry->prev == NULL) {
     return false;
-  });
+  }
+
+  sds name;
+  KFS_Entry *parent = shell_dest(ctx, dst, entry->name, &name);
+  if (parent == NULL) {
+    return false;
+  }
+
+  bool ok = kfs_find_on(parent, name) == NULL &&
+            kfs_entry_home(entry) == parent->region;
+  for (KFS_Entry *e = parent; ok && e != NULL; e = e->prev) {
+    ok = e != entry;
+  }
+  if (ok) {
+    kfs_move_child(entry->prev, entry->name, parent, name);
+  }
+
+  sdsfree(name);
+  return ok;
 }
 
-bool kfs_ls(KFSShellContext *ctx, sds path) {
-  KFS_Entry *entry = kfs_find(ctx->root, path);
+// copy-on-write: the copy shares src's data until either side is written
+bool kfs_cp(KFSShellContext *ctx, sds src, sds dst) {
+  KFS_Entry *entry = shell_target(ctx, src);
+  if (entry == NULL || EntryIsDir(entry)) {
+    return false;
+  }
 
-  if (!entry) {
+  sds name;
+  KFS_Entry *parent = shell_dest(ctx, dst, entry->name, &name);
+  if (parent == NULL) {
     return false;
   }
 
-  Vector *vls = kfs_getCurrentList(entry);
+  KFS_Entry *copy = kfs_find_on(parent, name);
+  bool ok = true;
+  if (copy == NULL) {
+    copy = make_child_entry(parent, name, tKFS_File);
+    copy->mode = entry->mode;
+    kfs_append_child(parent, copy);
+  } else {
+    ok = EntryIsFile(copy);
+  }
+  if (ok) {
+    kfs_clone(copy, entry);
+  }
 
-  VecForeach(vls, elem, { printf("%s\n", (sds)elem); });
+  sdsfree(name);
+  return ok;
+}
 
+static bool find_visit(KFS_WalkEntry *we, void *pattern) {
+  if (fnmatch(pattern, we->entry->name, 0) == 0) {
+    printf("%s\n", we->path);
+  }
   return true;
 }
 
-bool kfs_pwd(KFSShellContext *ctx) {
-  printf("%s\n", kfs_getPwd(ctx->cwd));
+bool kfs_findName(KFSShellContext *ctx, sds pattern, sds path) {
+  KFS_Entry *entry = shell_target(ctx, path);
+  if (entry == NULL) {
+    return false;
+  }
 
+  sds pwd = kfs_getPwd(entry);
+  kfs_walk(entry, pwd, 0, 0, find_visit, pattern);
+  sdsfree(pwd);
   return true;
 }
 
-bool kfs_tree(KFSShellContext *ctx) {
-  Vector *vtree = kfs_getTree(ctx->cwd);
-  VecForeach(vtree, elem, { printf("%s\n", (sds)elem); });
+// per-operation stats of the FUSE handlers; "stats reset" starts over
+bool kfs_stats(KFSShellContext *ctx __attribute__((unused)), sds arg) {
+  if (arg != NULL) {
+    if (strcmp(arg, "reset") != 0) {
+      return false;
+    }
+    kfs_stats_reset();
+    return true;
+  }
+
+  sds text = kfs_stats_render();
+  fputs(text, stdout);
+  sdsfree(text);
+  return true;
+}
+
+// trace on|off|clear, or trace dump FILE to save the snapshot on the host
+bool kfs_trace(KFSShellContext *ctx __attribute__((unused)), sds arg,
+               sds file) {
+  if (arg == NULL) {
+    printf("tracing is %s\n", atomic_load(&kfs_trace_on) ? "on" : "off");
+  } else if (strcmp(arg, "on") == 0 || strcmp(arg, "off") == 0) {
+    kfs_trace_enable(strcmp(arg, "on") == 0);
+  } else if (strcmp(arg, "clear") == 0) {
+    kfs_trace_clear();
+  } else if (strcmp(arg, "dump") == 0 && file != NULL) {
+    FILE *fp = fopen(file, "wb");
+    if (fp == NULL) {
+      return false;
+    }
+    sds snapshot = kfs_trace_snapshot();
+    bool ok = fwrite(snapshot, 1, sdslen(snapshot), fp) == sdslen(snapshot);
+    sdsfree(snapshot);
+    return fclose(fp) == 0 && ok;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// hardware counters per operation; perf on|off|reset
+bool kfs_perf(KFSShellContext *ctx __attribute__((unused)), sds arg) {
+  if (arg == NULL) {
+    sds text = kfs_perf_render();
+    fputs(text, stdout);
+    sdsfree(text);
+  } else if (strcmp(arg, "on") == 0 || strcmp(arg, "off") == 0) {
+    if (!kfs_perf_enable(strcmp(arg, "on") == 0)) {
+      printf("hardware counters are not available\n");
+      return false;
+    }
+  } else if (strcmp(arg, "reset") == 0) {
+    kfs_perf_reset();
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// live heap use per subsystem
+bool kfs_alloc(KFSShellContext *ctx __attribute__((unused))) {
+  sds text = kfs_alloc_render();
+  fputs(text, stdout);
+  sdsfree(text);
   return true;
 }
 
@@ -122,41 +374,49 @@ bool kfs_copyFromHost(KFSShellContext *ctx, sds src, sds dst) {
   }
 
   WithCtx(ctx, {
-    src = sdscatprintf(sdsempty(), "%s/%s", cwd_name, src);
-    FILE *src_fp = fopen(src, "rb");
+    sds path = sdscatprintf(sdsempty(), "%s/%s", cwd_name, src);
+    FILE *src_fp = fopen(path, "rb");
 
     if (src_fp == NULL) {
+      sdsfree(path);
       return false;
     }
     fclose(src_fp);
 
     if (kfs_find_on(cwd, dst) != NULL) {
+      sdsfree(path);
       return false;
     }
 
-    sds buf = readText(src);
-    KFS_Entry *new_file = new_KFS_File(dst);
+    sds buf = readText(path);
+    KFS_Entry *new_file = make_child_entry(cwd, dst, tKFS_File);
     kfs_write(new_file, (char *)buf, sdslen(buf) + 1, 0);
     kfs_append_child(cwd, new_file);
+    sdsfree(buf);
+    sdsfree(path);
     return true;
   });
 }
 
 bool kfs_cat(KFSShellContext *ctx, sds name) {
-  WithCtx(ctx, {
-    KFS_Entry *ret = kfs_find_on(cwd, name);
-    if (ret == NULL) {
-      return false;
-    }
-    if (EntryIsDir(ret)) {
-      return false;
+  sds path = shell_path(ctx, name);
+  struct stat st;
+  bool result =
+      kfs_path_stat(ctx->root, path, &st) == 0 && S_ISREG(st.st_mode);
+
+  if (result) {
+    char *buf = xmalloc(st.st_size + 1);
+    ssize_t n = kfs_path_read(ctx->root, path, buf, st.st_size, 0);
+    result = n >= 0;
+    if (result) {
+      buf[n] = '\0';
+      printf("%s\n", buf);
     }
+    free(buf);
+  }
 
-    SizedData *buf = kfs_read(ret);
-    printf("%s\n", (sds)buf->data);
-
-    return true;
-  });
+  sdsfree(path);
+  return result;
 }
 
 void kfs_shell(KFS_Entry *root) {
@@ -164,7 +424,9 @@ void kfs_shell(KFS_Entry *root) {
   char input[1024];
 
   while (1) {
-    printf("%s > ", kfs_getPwd(ctx->cwd));
+    sds prompt = kfs_getPwd(ctx->cwd);
+    printf("%s > ", prompt);
+    sdsfree(prompt);
 
     memset(input, 0, sizeof(input));
     fgets(input, 1024, stdin);
@@ -186,7 +448,7 @@ void kfs_shell(KFS_Entry *root) {
 
     sds scmd = sdsnew(input);
     Vector *cmds = sdssplitvec(scmd, ' ');
-    bool result;
+    bool result = false;
 
 #define ifcmdIs(e) if (strcmp(cmds->data[0], e) == 0)
 
@@ -209,6 +471,30 @@ void kfs_shell(KFS_Entry *root) {
     else ifcmdIs(Tree) {
       result = kfs_tree(ctx);
     }
+    else ifcmdIs(Du) {
+      result = kfs_du(ctx, cmds->len > 1 ? cmds->data[1] : NULL);
+    }
+    else ifcmdIs(Quota) {
+      result = cmds->len > 1 &&
+               kfs_quota(ctx, cmds->data[1],
+                         cmds->len > 2 ? cmds->data[2] : NULL);
+    }
+    else ifcmdIs(Find) {
+      result = cmds->len > 1 &&
+               kfs_findName(ctx, cmds->data[1],
+                            cmds->len > 2 ? cmds->data[2] : NULL);
+    }
+    else ifcmdIs(Rm) {
+      bool recursive = cmds->len > 2 && strcmp(cmds->data[1], "-r") == 0;
+      result =
+          cmds->len > 1 && kfs_rm(ctx, cmds->data[cmds->len - 1], recursive);
+    }
+    else ifcmdIs(Copy) {
+      result = cmds->len > 2 && kfs_cp(ctx, cmds->data[1], cmds->data[2]);
+    }
+    else ifcmdIs(Mv) {
+      result = cmds->len > 2 && kfs_mv(ctx, cmds->data[1], cmds->data[2]);
+    }
     else ifcmdIs(CopyFromHost) {
       result = kfs_copyFromHost(ctx, cmds->data[1], cmds->data[2]);
     }
@@ -218,11 +504,26 @@ void kfs_shell(KFS_Entry *root) {
     else ifcmdIs(Help) {
       result = kfs_help(ctx);
     }
+    else ifcmdIs(Stats) {
+      result = kfs_stats(ctx, cmds->len > 1 ? cmds->data[1] : NULL);
+    }
+    else ifcmdIs(Trace) {
+      result = kfs_trace(ctx, cmds->len > 1 ? cmds->data[1] : NULL,
+                         cmds->len > 2 ? cmds->data[2] : NULL);
+    }
+    else ifcmdIs(Perf) {
+      result = kfs_perf(ctx, cmds->len > 1 ? cmds->data[1] : NULL);
+    }
+    else ifcmdIs(Alloc) {
+      result = kfs_alloc(ctx);
+    }
 
     if (!result) {
       printf("command error\n");
     }
 
+    VecForeach(cmds, cmd, { sdsfree(cmd); });
+    free_vec(cmds);
     sdsfree(scmd);
   }
 }
\ No newline at end of file
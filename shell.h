@@ -26,6 +26,17 @@ bool kfs_touch(KFSShellContext *ctx, sds name);
 bool kfs_ls(KFSShellContext *ctx, sds path);
 bool kfs_pwd(KFSShellContext *ctx);
 bool kfs_tree(KFSShellContext *ctx);
+bool kfs_du(KFSShellContext *ctx, sds path);
+bool kfs_quota(KFSShellContext *ctx, sds bytes, sds path);
+bool kfs_rm(KFSShellContext *ctx, sds path, bool recursive);
+bool kfs_mv(KFSShellContext *ctx, sds src, sds dst);
+bool kfs_cp(KFSShellContext *ctx, sds src, sds dst);
+bool kfs_findName(KFSShellContext *ctx, sds pattern, sds path);
+bool kfs_stats(KFSShellContext *ctx __attribute__((unused)), sds arg);
+bool kfs_trace(KFSShellContext *ctx __attribute__((unused)), sds arg,
+               sds file);
+bool kfs_perf(KFSShellContext *ctx __attribute__((unused)), sds arg);
+bool kfs_alloc(KFSShellContext *ctx __attribute__((unused)));
 bool kfs_help(KFSShellContext *ctx __attribute__((unused)));
 bool kfs_copyFromHost(KFSShellContext *ctx, sds src, sds dst);
 bool kfs_cat(KFSShellContext *ctx, sds name);
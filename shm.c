@@ -0,0 +1,156 @@
+#define _GNU_SOURCE // memfd_create, F_ADD_SEALS
+#include "kfs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static size_t page_size(void) { return sysconf(_SC_PAGESIZE); }
+
+// room for a quarter more than asked, so appends do not retire every view
+static size_t view_capacity(off_t size) {
+  size_t page = page_size();
+  size_t want = size + size / 4;
+  return want < page ? page : (want + page - 1) / page * page;
+}
+
+KFS_ShmView *kfs_shm_view_new(off_t size) {
+  size_t data_offset = page_size();
+  size_t capacity = view_capacity(size);
+  size_t map_size = data_offset + capacity;
+
+  int fd = memfd_create("kfs_view", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd == -1) {
+    return NULL;
+  }
+  KFS_ShmHeader *header = MAP_FAILED;
+  if (ftruncate(fd, map_size) == 0) {
+    header = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (header == MAP_FAILED) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return NULL;
+  }
+
+  // readers must neither resize the view under us nor write to it
+  int seals = F_SEAL_SHRINK | F_SEAL_GROW;
+#ifdef F_SEAL_FUTURE_WRITE
+  seals |= F_SEAL_FUTURE_WRITE;
+#endif
+  fcntl(fd, F_ADD_SEALS, seals | F_SEAL_SEAL);
+
+  header->magic = KFS_SHM_MAGIC;
+  header->data_offset = data_offset;
+  header->capacity = capacity;
+  atomic_init(&header->seq, 0);
+  atomic_init(&header->size, size);
+  atomic_init(&header->retired, 0);
+
+  KFS_ShmView *view = xmalloc(sizeof(KFS_ShmView));
+  view->fd = fd;
+  view->header = header;
+  view->map_size = map_size;
+  atomic_init(&view->live, true);
+  pthread_mutex_init(&view->lock, NULL);
+  view->older = NULL;
+  kfs_alloc_count(KFS_ALLOC_shm, 1, map_size);
+  return view;
+}
+
+char *kfs_shm_view_data(KFS_ShmView *view) {
+  return (char *)view->header + view->header->data_offset;
+}
+
+// readers retry while seq is odd; see kfs_shm_pread
+static void update_begin(KFS_ShmHeader *header) {
+  atomic_store_explicit(&header->seq,
+                        atomic_load_explicit(&header->seq,
+                                             memory_order_relaxed) +
+                            1,
+                        memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+}
+
+static void update_end(KFS_ShmHeader *header) {
+  atomic_store_explicit(&header->seq,
+                        atomic_load_explicit(&header->seq,
+                                             memory_order_relaxed) +
+                            1,
+                        memory_order_release);
+}
+
+// with view->lock held
+static void retire_locked(KFS_ShmView *view) {
+  if (!atomic_load(&view->live)) {
+    return;
+  }
+
+  update_begin(view->header);
+  atomic_store_explicit(&view->header->retired, 1, memory_order_relaxed);
+  update_end(view->header);
+
+  atomic_store(&view->live, false);
+  munmap(view->header, view->map_size);
+  close(view->fd);
+  view->header = NULL;
+  kfs_alloc_count(KFS_ALLOC_shm, -1, -(int64_t)view->map_size);
+}
+
+void kfs_shm_view_write(KFS_ShmView *view, const char *buf, size_t size,
+                        off_t offset) {
+  pthread_mutex_lock(&view->lock);
+  if (atomic_load(&view->live)) {
+    KFS_ShmHeader *header = view->header;
+    if (offset + size > header->capacity) {
+      retire_locked(view);
+    } else {
+      update_begin(header);
+      memcpy(kfs_shm_view_data(view) + offset, buf, size);
+      uint64_t end = offset + size;
+      if (end > atomic_load_explicit(&header->size, memory_order_relaxed)) {
+        atomic_store_explicit(&header->size, end, memory_order_relaxed);
+      }
+      update_end(header);
+    }
+  }
+  pthread_mutex_unlock(&view->lock);
+}
+
+void kfs_shm_view_truncate(KFS_ShmView *view, off_t size) {
+  pthread_mutex_lock(&view->lock);
+  if (atomic_load(&view->live)) {
+    KFS_ShmHeader *header = view->header;
+    if ((uint64_t)size > header->capacity) {
+      retire_locked(view);
+    } else {
+      // bytes past the end must read as zero if the file grows again
+      off_t old_size =
+          atomic_load_explicit(&header->size, memory_order_relaxed);
+      update_begin(header);
+      if (size < old_size) {
+        memset(kfs_shm_view_data(view) + size, 0, old_size - size);
+      }
+      atomic_store_explicit(&header->size, size, memory_order_relaxed);
+      update_end(header);
+    }
+  }
+  pthread_mutex_unlock(&view->lock);
+}
+
+void kfs_shm_view_retire(KFS_ShmView *view) {
+  pthread_mutex_lock(&view->lock);
+  retire_locked(view);
+  pthread_mutex_unlock(&view->lock);
+}
+
+void kfs_shm_view_free(KFS_ShmView *view) {
+  while (view != NULL) {
+    KFS_ShmView *older = view->older;
+    kfs_shm_view_retire(view);
+    pthread_mutex_destroy(&view->lock);
+    xfree(&view);
+    view = older;
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef __SHM_HEADER_INCLUDED__
+#define __SHM_HEADER_INCLUDED__
+#include "kfs.h"
+#include "kfs_shm.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+  The daemon's side of shared views (kfs_shm.h): a memfd holding a copy of
+  a file's data.  A file has none until a reader asks for one through
+  kfs_file_share.  From then on, kfs_write, kfs_truncate and kfs_clone
+  update the view inside its seqlock while they still hold the file's
+  range lock, so the view never misses a change.
+
+  Retiring a view unmaps it here at once.  Its memory goes when the last
+  reader unmaps it too.  The small struct stays chained to the file's
+  current view until the file is freed, because a writer of another range
+  may still be about to look at it.
+*/
+
+typedef struct KFS_ShmView {
+  int fd;
+  KFS_ShmHeader *header;
+  size_t map_size;
+  atomic_bool live;
+  pthread_mutex_t lock; // writers of different ranges take turns
+  struct KFS_ShmView *older;
+} KFS_ShmView;
+
+// a live view with room for size bytes, or NULL with errno set
+KFS_ShmView *kfs_shm_view_new(off_t size);
+char *kfs_shm_view_data(KFS_ShmView *view);
+// retires the view instead if the data would not fit
+void kfs_shm_view_write(KFS_ShmView *view, const char *buf, size_t size,
+                        off_t offset);
+void kfs_shm_view_truncate(KFS_ShmView *view, off_t size);
+void kfs_shm_view_retire(KFS_ShmView *view);
+// frees view and every older one
+void kfs_shm_view_free(KFS_ShmView *view);
+
+#endif
@@ -0,0 +1,225 @@
+#define _GNU_SOURCE // MSG_CMSG_CLOEXEC
+#include "kfs_shm.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+  The client side of kfs_shm.h.  It stands alone on purpose, without
+  kfs.h, sds or xmalloc, so that libkfs_shm is this file only.
+*/
+
+struct KFS_ShmClient {
+  int fd;
+  pthread_mutex_t lock; // one request in flight per connection
+};
+
+struct KFS_ShmFile {
+  KFS_ShmClient *client;
+  char *path;
+  KFS_ShmHeader *header;
+  size_t map_size;
+};
+
+int kfs_shm_connect(const char *socket_path, KFS_ShmClient **client) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    return -ENAMETOOLONG;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return -errno;
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    int res = -errno;
+    close(fd);
+    return res;
+  }
+
+  KFS_ShmClient *c = malloc(sizeof(KFS_ShmClient));
+  if (c == NULL) {
+    close(fd);
+    return -ENOMEM;
+  }
+  c->fd = fd;
+  pthread_mutex_init(&c->lock, NULL);
+  *client = c;
+  return 0;
+}
+
+void kfs_shm_disconnect(KFS_ShmClient *client) {
+  close(client->fd);
+  pthread_mutex_destroy(&client->lock);
+  free(client);
+}
+
+// the view fd for path, or -errno
+static int request(KFS_ShmClient *client, const char *path) {
+  int32_t status = -EPROTO;
+  struct iovec iov = {&status, sizeof(status)};
+  union {
+    char buf[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  pthread_mutex_lock(&client->lock);
+  ssize_t n = send(client->fd, path, strlen(path), MSG_NOSIGNAL);
+  if (n != -1) {
+    n = recvmsg(client->fd, &msg, MSG_CMSG_CLOEXEC);
+  }
+  pthread_mutex_unlock(&client->lock);
+  if (n == -1) {
+    return -errno;
+  }
+
+  int fd = -1;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET &&
+      cmsg->cmsg_type == SCM_RIGHTS) {
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  }
+  if (n != sizeof(status) || status > 0 || (status == 0) != (fd != -1)) {
+    status = -EPROTO;
+  }
+  if (status != 0 && fd != -1) {
+    close(fd);
+  }
+  return status == 0 ? fd : status;
+}
+
+// replaces the file's view with a fresh one from the daemon
+static int map_view(KFS_ShmFile *file) {
+  int fd = request(file->client, file->path);
+  if (fd < 0) {
+    return fd;
+  }
+
+  struct stat st;
+  void *map = MAP_FAILED;
+  int res = 0;
+  if (fstat(fd, &st) == -1) {
+    res = -errno;
+  } else if ((size_t)st.st_size < sizeof(KFS_ShmHeader)) {
+    res = -EPROTO;
+  } else if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) ==
+             MAP_FAILED) {
+    res = -errno;
+  }
+  close(fd);
+  if (res != 0) {
+    return res;
+  }
+
+  KFS_ShmHeader *header = map;
+  if (header->magic != KFS_SHM_MAGIC ||
+      header->data_offset + header->capacity > (uint64_t)st.st_size) {
+    munmap(map, st.st_size);
+    return -EPROTO;
+  }
+
+  if (file->header != NULL) {
+    munmap(file->header, file->map_size);
+  }
+  file->header = header;
+  file->map_size = st.st_size;
+  return 0;
+}
+
+int kfs_shm_open(KFS_ShmClient *client, const char *path, KFS_ShmFile **file) {
+  KFS_ShmFile *f = malloc(sizeof(KFS_ShmFile));
+  if (f == NULL || (f->path = strdup(path)) == NULL) {
+    free(f);
+    return -ENOMEM;
+  }
+  f->client = client;
+  f->header = NULL;
+  f->map_size = 0;
+
+  int res = map_view(f);
+  if (res != 0) {
+    free(f->path);
+    free(f);
+    return res;
+  }
+  *file = f;
+  return 0;
+}
+
+/*
+  A seqlock read: copies up to size bytes at offset and the file size as
+  of one moment.  An odd seq means the daemon is changing the view; a seq
+  that moved meanwhile means the copy may be torn.  Either way it is
+  tried again.
+*/
+static ssize_t read_view(KFS_ShmFile *file, void *buf, size_t size,
+                         off_t offset, off_t *file_size) {
+  if (offset < 0) {
+    return -EINVAL;
+  }
+
+  for (;;) {
+    KFS_ShmHeader *header = file->header;
+    uint64_t seq = atomic_load_explicit(&header->seq, memory_order_acquire);
+    if (seq & 1) {
+      continue;
+    }
+    if (atomic_load_explicit(&header->retired, memory_order_relaxed)) {
+      int res = map_view(file);
+      if (res != 0) {
+        return res;
+      }
+      continue;
+    }
+
+    uint64_t end = atomic_load_explicit(&header->size, memory_order_relaxed);
+    if (end > header->capacity) { // torn; seq will have moved
+      end = header->capacity;
+    }
+    size_t n = 0;
+    if ((uint64_t)offset < end && size > 0) {
+      n = end - offset < size ? end - offset : size;
+      memcpy(buf, (char *)header + header->data_offset + offset, n);
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&header->seq, memory_order_relaxed) == seq) {
+      if (file_size != NULL) {
+        *file_size = end;
+      }
+      return n;
+    }
+  }
+}
+
+ssize_t kfs_shm_pread(KFS_ShmFile *file, void *buf, size_t size,
+                      off_t offset) {
+  return read_view(file, buf, size, offset, NULL);
+}
+
+off_t kfs_shm_size(KFS_ShmFile *file) {
+  off_t size;
+  ssize_t res = read_view(file, NULL, 0, 0, &size);
+  return res < 0 ? res : size;
+}
+
+void kfs_shm_close(KFS_ShmFile *file) {
+  munmap(file->header, file->map_size);
+  free(file->path);
+  free(file);
+}
@@ -0,0 +1,277 @@
+#include "kfs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+  _Atomic uint64_t count;
+  _Atomic uint64_t errors;
+  _Atomic uint64_t sum_ns;
+  _Atomic uint64_t buckets[KFS_STATS_BUCKETS];
+} OpShard;
+
+typedef struct Shard {
+  OpShard ops[KFS_OP_COUNT];
+  struct Shard *next;
+} Shard;
+
+static pthread_mutex_t shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static Shard *shards;
+static _Thread_local Shard *my_shard;
+// totals at the last reset; shards only ever grow
+static KFS_OpStats baseline[KFS_OP_COUNT];
+
+#define KFS_STATS_NAME_OF(name) #name,
+static const char *const op_names[] = {KFS_STATS_OPS(KFS_STATS_NAME_OF)};
+#undef KFS_STATS_NAME_OF
+
+const char *kfs_stats_op_name(int op) { return op_names[op]; }
+
+static size_t bucket_of(uint64_t v) {
+  if (v < KFS_STATS_SUB) {
+    return v;
+  }
+  int msb = 63 - __builtin_clzll(v);
+  if (msb > KFS_STATS_MAX_SHIFT) {
+    return KFS_STATS_BUCKETS - 1;
+  }
+  int shift = msb - KFS_STATS_SUB_BITS;
+  return (size_t)(shift + 1) * KFS_STATS_SUB +
+         ((v >> shift) & (KFS_STATS_SUB - 1));
+}
+
+static uint64_t bucket_low(size_t idx) {
+  size_t group = idx / KFS_STATS_SUB;
+  uint64_t sub = idx % KFS_STATS_SUB;
+  return group == 0 ? sub : (KFS_STATS_SUB + sub) << (group - 1);
+}
+
+static uint64_t bucket_high(size_t idx) {
+  return idx == KFS_STATS_BUCKETS - 1 ? UINT64_MAX : bucket_low(idx + 1) - 1;
+}
+
+// only the owning thread writes a shard
+static inline void bump(_Atomic uint64_t *counter, uint64_t n) {
+  atomic_store_explicit(
+      counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+      memory_order_relaxed);
+}
+
+static Shard *shard(void) {
+  if (my_shard == NULL) {
+    Shard *s = xmalloc(sizeof(Shard));
+    memset(s, 0, sizeof(Shard));
+
+    pthread_mutex_lock(&shards_lock);
+    s->next = shards;
+    shards = s;
+    pthread_mutex_unlock(&shards_lock);
+    my_shard = s;
+  }
+  return my_shard;
+}
+
+void kfs_stats_record(int op, uint64_t start_ns, int res) {
+  uint64_t elapsed = kfs_stats_now() - start_ns;
+  OpShard *s = &shard()->ops[op];
+
+  bump(&s->count, 1);
+  bump(&s->sum_ns, elapsed);
+  bump(&s->buckets[bucket_of(elapsed)], 1);
+  if (res < 0) {
+    bump(&s->errors, 1);
+  }
+}
+
+// callers hold shards_lock
+static void sum_shards(int op, KFS_OpStats *out) {
+  memset(out, 0, sizeof(*out));
+  for (Shard *s = shards; s != NULL; s = s->next) {
+    OpShard *o = &s->ops[op];
+    out->count += atomic_load_explicit(&o->count, memory_order_relaxed);
+    out->errors += atomic_load_explicit(&o->errors, memory_order_relaxed);
+    out->sum_ns += atomic_load_explicit(&o->sum_ns, memory_order_relaxed);
+    for (size_t i = 0; i < KFS_STATS_BUCKETS; i++) {
+      out->buckets[i] +=
+          atomic_load_explicit(&o->buckets[i], memory_order_relaxed);
+    }
+  }
+}
+
+void kfs_stats_get(int op, KFS_OpStats *out) {
+  pthread_mutex_lock(&shards_lock);
+  sum_shards(op, out);
+  KFS_OpStats *base = &baseline[op];
+  out->count -= base->count;
+  out->errors -= base->errors;
+  out->sum_ns -= base->sum_ns;
+  for (size_t i = 0; i < KFS_STATS_BUCKETS; i++) {
+    out->buckets[i] -= base->buckets[i];
+  }
+  pthread_mutex_unlock(&shards_lock);
+}
+
+void kfs_stats_reset(void) {
+  pthread_mutex_lock(&shards_lock);
+  for (int op = 0; op < KFS_OP_COUNT; op++) {
+    sum_shards(op, &baseline[op]);
+  }
+  pthread_mutex_unlock(&shards_lock);
+}
+
+uint64_t kfs_stats_percentile(const KFS_OpStats *stats, double p) {
+  if (stats->count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(p * stats->count + 0.5);
+  if (rank == 0) {
+    rank = 1;
+  }
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < KFS_STATS_BUCKETS; i++) {
+    seen += stats->buckets[i];
+    if (seen >= rank) {
+      return bucket_high(i);
+    }
+  }
+  return bucket_high(KFS_STATS_BUCKETS - 1);
+}
+
+sds kfs_stats_render(void) {
+  sds out = sdsnew(
+      "op count errors mean_ns p50_ns p90_ns p99_ns p999_ns max_ns\n");
+  KFS_OpStats *stats = xmalloc(sizeof(KFS_OpStats));
+
+  for (int op = 0; op < KFS_OP_COUNT; op++) {
+    kfs_stats_get(op, stats);
+    uint64_t mean = stats->count > 0 ? stats->sum_ns / stats->count : 0;
+    out = sdscatprintf(
+        out, "%s %llu %llu %llu %llu %llu %llu %llu %llu\n", op_names[op],
+        (unsigned long long)stats->count, (unsigned long long)stats->errors,
+        (unsigned long long)mean,
+        (unsigned long long)kfs_stats_percentile(stats, 0.5),
+        (unsigned long long)kfs_stats_percentile(stats, 0.9),
+        (unsigned long long)kfs_stats_percentile(stats, 0.99),
+        (unsigned long long)kfs_stats_percentile(stats, 0.999),
+        (unsigned long long)kfs_stats_percentile(stats, 1.0));
+  }
+
+  xfree(&stats);
+  return out;
+}
+
+// files of the virtual tree, rendered once per open
+static const struct {
+  const char *path;
+  sds (*render)(void);
+} virtual_files[] = {
+    {KFS_STATS_FILE, kfs_stats_render},
+    {KFS_STATS_DIR "/trace", kfs_trace_snapshot},
+    {KFS_PERF_FILE, kfs_perf_render},
+    {KFS_ALLOC_FILE, kfs_alloc_render},
+};
+
+#define VIRTUAL_FILES (sizeof(virtual_files) / sizeof(virtual_files[0]))
+
+static int virtual_file(const char *path) {
+  for (size_t i = 0; i < VIRTUAL_FILES; i++) {
+    if (strcmp(path, virtual_files[i].path) == 0) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+bool kfs_stats_path(const char *path) {
+  size_t len = strlen(KFS_STATS_DIR);
+  return strncmp(path, KFS_STATS_DIR, len) == 0 &&
+         (path[len] == '\0' || path[len] == '/');
+}
+
+int kfs_stats_getattr(const char *path, struct stat *stbuf) {
+  memset(stbuf, 0, sizeof(*stbuf));
+  stbuf->st_uid = KFS_ROOT->uid;
+  stbuf->st_gid = KFS_ROOT->gid;
+  clock_gettime(CLOCK_REALTIME, &stbuf->st_mtim);
+  stbuf->st_atim = stbuf->st_ctim = stbuf->st_mtim;
+
+  if (strcmp(path, KFS_STATS_DIR) == 0) {
+    stbuf->st_mode = S_IFDIR | 0555;
+    stbuf->st_nlink = 2;
+  } else if (virtual_file(path) != -1) {
+    // the size is unknown until the file is opened; reads use direct_io
+    stbuf->st_mode = S_IFREG | 0444;
+    stbuf->st_nlink = 1;
+  } else {
+    return -ENOENT;
+  }
+  return 0;
+}
+
+int kfs_stats_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                      off_t offset, struct fuse_file_info *fi) {
+  (void)offset;
+  (void)fi;
+
+  if (strcmp(path, KFS_STATS_DIR) != 0) {
+    return virtual_file(path) != -1 ? -ENOTDIR : -ENOENT;
+  }
+  for (size_t i = 0; i < VIRTUAL_FILES; i++) {
+    filler(buf, virtual_files[i].path + strlen(KFS_STATS_DIR "/"), NULL, 0);
+  }
+  return 0;
+}
+
+int kfs_stats_access(const char *path, int mode) {
+  struct stat st;
+  int res = kfs_stats_getattr(path, &st);
+  if (res == 0 && (mode & W_OK)) {
+    res = -EROFS;
+  }
+  return res;
+}
+
+// contents are rendered once per open, so reads are consistent
+int kfs_stats_open(const char *path, struct fuse_file_info *fi) {
+  int file = virtual_file(path);
+  if (file == -1) {
+    return strcmp(path, KFS_STATS_DIR) == 0 ? -EISDIR : -ENOENT;
+  }
+  if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+    return -EROFS;
+  }
+
+  fi->fh = (uint64_t)(uintptr_t)virtual_files[file].render();
+  fi->direct_io = 1;
+  return 0;
+}
+
+int kfs_stats_read(const char *path, char *buf, size_t size, off_t offset,
+                   struct fuse_file_info *fi) {
+  (void)path;
+  sds text = (sds)(uintptr_t)fi->fh;
+  if (text == NULL) {
+    return -EBADF;
+  }
+
+  size_t len = sdslen(text);
+  if ((size_t)offset >= len) {
+    return 0;
+  }
+  if (size > len - offset) {
+    size = len - offset;
+  }
+  memcpy(buf, text + offset, size);
+  return size;
+}
+
+int kfs_stats_release(const char *path, struct fuse_file_info *fi) {
+  (void)path;
+  sdsfree((sds)(uintptr_t)fi->fh);
+  fi->fh = 0;
+  return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef __STATS_HEADER_INCLUDED__
+#define __STATS_HEADER_INCLUDED__
+#include "kfs.h"
+#include <stdint.h>
+#include <time.h>
+
+/*
+  Per-operation counters and latency histograms.  Each thread records into
+  a shard of its own, so recording is a handful of uncontended stores;
+  readers sum the shards.  Histograms are log-linear in the style of
+  HdrHistogram: 16 sub-buckets per power of two, values up to 2^40 ns,
+  so any percentile is within about 6% of the true value.
+
+  The numbers are served read-only at /.kfs/stats inside the mount (and by
+  the shell's stats command), one line per operation:
+    op count errors mean_ns p50_ns p90_ns p99_ns p999_ns max_ns
+  /.kfs also holds the trace snapshot (see trace.h), the hardware
+  counters (see perf.h) and the heap use per subsystem (see alloc.h).
+*/
+
+#define KFS_STATS_OPS(X)                                                       \
+  X(getattr)                                                                   \
+  X(readdir)                                                                   \
+  X(open)                                                                      \
+  X(read)                                                                      \
+  X(write)                                                                     \
+  X(release)                                                                   \
+  X(mkdir)                                                                     \
+  X(access)                                                                    \
+  X(create)                                                                    \
+  X(utimens)                                                                   \
+  X(unlink)                                                                    \
+  X(rmdir)                                                                     \
+  X(rename)                                                                    \
+  X(chmod)                                                                     \
+  X(chown)                                                                     \
+  X(truncate)                                                                  \
+  X(setxattr)                                                                  \
+  X(getxattr)                                                                  \
+  X(ioctl)
+
+#define KFS_STATS_ENUM(name) KFS_OP_##name,
+enum { KFS_STATS_OPS(KFS_STATS_ENUM) KFS_OP_COUNT };
+#undef KFS_STATS_ENUM
+
+#define KFS_STATS_SUB_BITS 4
+#define KFS_STATS_SUB (1 << KFS_STATS_SUB_BITS)
+#define KFS_STATS_MAX_SHIFT 40
+#define KFS_STATS_BUCKETS                                                      \
+  ((KFS_STATS_MAX_SHIFT - KFS_STATS_SUB_BITS + 2) * KFS_STATS_SUB)
+
+// the virtual tree
+#define KFS_STATS_NAME ".kfs"
+#define KFS_STATS_DIR "/" KFS_STATS_NAME
+#define KFS_STATS_FILE KFS_STATS_DIR "/stats"
+
+typedef struct {
+  uint64_t count;
+  uint64_t errors;
+  uint64_t sum_ns;
+  uint64_t buckets[KFS_STATS_BUCKETS];
+} KFS_OpStats;
+
+static inline uint64_t kfs_stats_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// res < 0 counts as an error
+void kfs_stats_record(int op, uint64_t start_ns, int res);
+const char *kfs_stats_op_name(int op);
+// totals since the last reset
+void kfs_stats_get(int op, KFS_OpStats *out);
+// p in [0, 1]; the upper end of the bucket holding that rank
+uint64_t kfs_stats_percentile(const KFS_OpStats *stats, double p);
+void kfs_stats_reset(void);
+sds kfs_stats_render(void);
+
+// handlers for paths inside KFS_STATS_DIR, the virtual tree
+bool kfs_stats_path(const char *path);
+int kfs_stats_getattr(const char *path, struct stat *stbuf);
+int kfs_stats_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                      off_t offset, struct fuse_file_info *fi);
+int kfs_stats_open(const char *path, struct fuse_file_info *fi);
+int kfs_stats_read(const char *path, char *buf, size_t size, off_t offset,
+                   struct fuse_file_info *fi);
+int kfs_stats_release(const char *path, struct fuse_file_info *fi);
+int kfs_stats_access(const char *path, int mode);
+// everything else
+#define KFS_STATS_ROFS(...) (-EROFS)
+#define KFS_STATS_NODATA(...) (-ENODATA)
+
+#endif
@@ -0,0 +1,213 @@
+#include "kfs.h"
+#include "tester.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdlib.h>
+
+#define FILES 100
+#define FILE_BYTES 5000
+#define SOAK_ROUNDS 200 // more with KFS_SOAK_SECONDS, see make soak
+
+typedef struct {
+  KFS_AllocStats kinds[KFS_ALLOC_COUNT];
+  size_t heap; // bytes malloc has handed out and not taken back
+} Snapshot;
+
+// glibc's per-thread cache keeps freed chunks counted as in use, so
+// malloc's own totals only add up exactly with the cache turned off, as
+// make soak does with GLIBC_TUNABLES=glibc.malloc.tcache_count=0
+static bool exact_heap(void) {
+  const char *tunables = getenv("GLIBC_TUNABLES");
+  return tunables != NULL &&
+         strstr(tunables, "glibc.malloc.tcache_count=0") != NULL;
+}
+
+static void snapshot(Snapshot *s) {
+  for (int kind = 0; kind < KFS_ALLOC_COUNT; kind++) {
+    kfs_alloc_get(kind, &s->kinds[kind]);
+  }
+  s->heap = exact_heap() ? mallinfo2().uordblks : 0;
+}
+
+static int64_t grown(const Snapshot *before, const Snapshot *after, int kind) {
+  return after->kinds[kind].bytes - before->kinds[kind].bytes;
+}
+
+static int64_t added(const Snapshot *before, const Snapshot *after,
+                     int kind) {
+  return after->kinds[kind].objects - before->kinds[kind].objects;
+}
+
+static bool unchanged(const Snapshot *before, const Snapshot *after) {
+  for (int kind = 0; kind < KFS_ALLOC_COUNT; kind++) {
+    if (grown(before, after, kind) != 0 || added(before, after, kind) != 0) {
+      fprintf(stderr, "%s: %+lld objects, %+lld bytes\n",
+              kfs_alloc_kind_name(kind),
+              (long long)added(before, after, kind),
+              (long long)grown(before, after, kind));
+      return false;
+    }
+  }
+  if (before->heap != after->heap) {
+    fprintf(stderr, "heap: %+lld bytes\n",
+            (long long)after->heap - (long long)before->heap);
+    return false;
+  }
+  return true;
+}
+
+static void make_files(const char *dir) {
+  char data[FILE_BYTES];
+  memset(data, 'a', sizeof(data));
+  for (int i = 0; i < FILES; i++) {
+    char path[64];
+    snprintf(path, sizeof(path), "%s/f%d", dir, i);
+    assert(kfs_ops.create(path, 0644, NULL) == 0);
+    assert(kfs_ops.write(path, data, sizeof(data), 0, NULL) == FILE_BYTES);
+  }
+}
+
+static void remove_tree(const char *name) {
+  sds sname = sdsnew(name);
+  assert(kfs_remove_tree(KFS_ROOT, sname));
+  kfs_reclaim_drain();
+  sdsfree(sname);
+}
+
+static sds read_virtual(const char *path) {
+  struct fuse_file_info fi;
+  memset(&fi, 0, sizeof(fi));
+  fi.flags = O_RDONLY;
+  char buf[4096];
+
+  assert(kfs_ops.open(path, &fi) == 0);
+  int n = kfs_ops.read(path, buf, sizeof(buf), 0, &fi);
+  assert(n > 0);
+  kfs_ops.release(path, &fi);
+  return sdsnewlen(buf, n);
+}
+
+TEST_CASE(test_alloc_accounting, {
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  // the root's index pool is allocated once and kept
+  assert(kfs_ops.mkdir("/keep", 0755) == 0);
+  Snapshot before;
+  Snapshot during;
+  Snapshot after;
+  snapshot(&before);
+
+  assert(kfs_ops.mkdir("/d", 0755) == 0);
+  make_files("/d");
+  // a write creates missing files, also below the root
+  assert(kfs_ops.write("/d/new", "x", 1, 0, NULL) == 1);
+  snapshot(&during);
+  assert(added(&before, &during, KFS_ALLOC_entries) == FILES + 2);
+  assert(grown(&before, &during, KFS_ALLOC_entries) ==
+         (FILES + 2) * (int64_t)sizeof(KFS_Entry));
+  assert(added(&before, &during, KFS_ALLOC_names) == FILES + 2);
+  assert(grown(&before, &during, KFS_ALLOC_avl) >=
+         FILES * (int64_t)sizeof(KFS_DirIndexNode));
+  assert(grown(&before, &during, KFS_ALLOC_file_data) >=
+         FILES * FILE_BYTES);
+
+  sds text = read_virtual(KFS_ALLOC_FILE);
+  assert(strncmp(text, "subsystem objects bytes\n", 24) == 0);
+  assert(strstr(text, "\nfile_data ") != NULL);
+  assert(strstr(text, "\ntotal ") != NULL);
+  sdsfree(text);
+
+  remove_tree("d");
+  snapshot(&after);
+  assert(added(&before, &after, KFS_ALLOC_entries) == 0);
+  assert(grown(&before, &after, KFS_ALLOC_names) == 0);
+  assert(grown(&before, &after, KFS_ALLOC_avl) == 0);
+  assert(grown(&before, &after, KFS_ALLOC_file_data) == 0);
+
+  // a scratch directory's contents are its region's blocks
+  assert(kfs_ops.mkdir("/s", 0755) == 0);
+  assert(kfs_ops.setxattr("/s", "user.kfs.scratch", "1", 1, 0) == 0);
+  make_files("/s");
+  snapshot(&during);
+  assert(added(&before, &during, KFS_ALLOC_entries) == 1);
+  assert(grown(&before, &during, KFS_ALLOC_file_data) == 0);
+  assert(grown(&before, &during, KFS_ALLOC_regions) >= FILES * FILE_BYTES);
+
+  remove_tree("s");
+  snapshot(&after);
+  assert(added(&before, &after, KFS_ALLOC_entries) == 0);
+  assert(grown(&before, &after, KFS_ALLOC_regions) == 0);
+});
+
+static int fill_nothing(void *buf, const char *name, const struct stat *st,
+                        off_t off) {
+  (void)buf;
+  (void)name;
+  (void)st;
+  (void)off;
+  return 0;
+}
+
+// everything a read-only client does, once per file
+static void read_round(void) {
+  struct stat st;
+  char buf[FILE_BYTES];
+  char value[64];
+
+  assert(kfs_ops.readdir("/", NULL, fill_nothing, 0, NULL) == 0);
+  assert(kfs_ops.readdir("/d", NULL, fill_nothing, 0, NULL) == 0);
+  assert(kfs_ops.getattr("/missing/f", &st) == -ENOENT);
+  for (int i = 0; i < FILES; i++) {
+    char path[64];
+    snprintf(path, sizeof(path), "/d/f%d", i);
+    struct fuse_file_info fi;
+    memset(&fi, 0, sizeof(fi));
+    fi.flags = O_RDONLY;
+
+    assert(kfs_ops.getattr(path, &st) == 0);
+    assert(kfs_ops.access(path, R_OK) == 0);
+    assert(kfs_ops.open(path, &fi) == 0);
+    assert(kfs_ops.read(path, buf, sizeof(buf), 0, &fi) == FILE_BYTES);
+    assert(kfs_ops.release(path, &fi) == 0);
+    assert(kfs_ops.getxattr(path, "user.kfs.cache", value, sizeof(value)) >
+           0);
+  }
+  sdsfree(read_virtual(KFS_STATS_FILE));
+  sdsfree(read_virtual(KFS_ALLOC_FILE));
+}
+
+// after a warm-up, reads must not grow the heap at all: neither what the
+// subsystems account for nor what malloc has handed out
+TEST_CASE(test_soak_read_only, {
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  assert(kfs_ops.mkdir("/d", 0755) == 0);
+  make_files("/d");
+
+  // per-thread shards and per-file locks are allocated on first use
+  read_round();
+  read_round();
+  Snapshot base;
+  Snapshot now;
+  snapshot(&base);
+
+  const char *seconds = getenv("KFS_SOAK_SECONDS");
+  uint64_t until =
+      seconds == NULL ? 0
+                      : kfs_stats_now() + strtoull(seconds, NULL, 10) *
+                                              1000000000ull;
+  size_t rounds = 0;
+  while (rounds < SOAK_ROUNDS || kfs_stats_now() < until) {
+    read_round();
+    snapshot(&now);
+    assert(unchanged(&base, &now));
+    rounds++;
+  }
+  printf("[alloc] %zu read-only rounds without %s growth\n", rounds,
+         exact_heap() ? "heap" : "accounted");
+});
+
+void alloc_test(void) {
+  test_alloc_accounting();
+  test_soak_read_only();
+}
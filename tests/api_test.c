@@ -0,0 +1,168 @@
+#include "kfs.h"
+#include "kfs_api.h"
+#include "tester.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#define THREADS 8
+#define ROUNDS 2000
+
+static int count_name(void *arg, const char *name) {
+  (void)name;
+  (*(int *)arg)++;
+  return 0;
+}
+
+TEST_CASE(test_api_paths, {
+  KFS_FS *a = kfs_fs_new();
+  KFS_FS *b = kfs_fs_new();
+  struct stat st;
+  char buf[16];
+
+  assert(kfs_fs_mkdir(a, "/d", 0755) == 0);
+  assert(kfs_fs_mkdir(a, "/d", 0755) == -EEXIST);
+  assert(kfs_fs_write(a, "/d/f", "hello", 5, 0) == 5);
+  assert(kfs_fs_stat(a, "/d/f", &st) == 0);
+  assert(S_ISREG(st.st_mode) && st.st_size == 5);
+  assert(kfs_fs_read(a, "/d/f", buf, sizeof(buf), 0) == 5);
+  assert(memcmp(buf, "hello", 5) == 0);
+  assert(kfs_fs_read(a, "/d", buf, sizeof(buf), 0) == -EISDIR);
+  assert(kfs_fs_read(a, "/d/f", buf, 4, -5) == -EINVAL);
+  assert(kfs_fs_write(a, "/d/f", "x", 1, -1) == -EINVAL);
+  assert(kfs_fs_write(a, "/d/f", "x", 1, INT64_MAX) == -EINVAL);
+
+  // instances do not share anything
+  assert(kfs_fs_stat(b, "/d", &st) == -ENOENT);
+  assert(kfs_fs_write(b, "/d/f", "x", 1, 0) == -ENOENT);
+
+  int names = 0;
+  assert(kfs_fs_readdir(a, "/d", count_name, &names) == 0);
+  assert(names == 3); // ".", ".." and f
+
+  // a trailing slash names a directory and nothing else
+  assert(kfs_fs_write(a, "/d/", "x", 1, 0) == -EISDIR);
+  assert(kfs_fs_write(a, "/d/x/", "x", 1, 0) == -EISDIR);
+  assert(kfs_fs_stat(a, "/d/", &st) == 0 && S_ISDIR(st.st_mode));
+  assert(kfs_fs_stat(a, "/d/f/", &st) == -ENOENT);
+  assert(kfs_fs_mkdir(a, "/e/", 0755) == 0);
+  assert(kfs_fs_stat(a, "/e", &st) == 0 && S_ISDIR(st.st_mode));
+  assert(kfs_fs_rename(a, "/d/f", "/h/") == -ENOTDIR);
+  assert(kfs_fs_rmdir(a, "/e/") == 0);
+  names = 0;
+  assert(kfs_fs_readdir(a, "/d", count_name, &names) == 0);
+  assert(names == 3);
+
+  assert(kfs_fs_rename(a, "/d/f", "/g") == 0);
+  assert(kfs_fs_stat(a, "/d/f", &st) == -ENOENT);
+  assert(kfs_fs_rmdir(a, "/d") == 0);
+  assert(kfs_fs_unlink(a, "/g") == 0);
+  assert(kfs_fs_unlink(a, "/g") == -ENOENT);
+
+  kfs_fs_free(a);
+  kfs_fs_free(b);
+});
+
+TEST_CASE(test_api_handles, {
+  KFS_FS *fs = kfs_fs_new();
+  KFS_Handle *h;
+  KFS_Handle *ro;
+  struct stat st;
+  char buf[16];
+
+  assert(kfs_fs_open(fs, "/f", O_RDWR, 0644, &h) == -ENOENT);
+  assert(kfs_fs_open(fs, "/f", O_RDWR | O_CREAT, 0644, &h) == 0);
+  assert(kfs_fs_open(fs, "/f", O_RDWR | O_CREAT | O_EXCL, 0644, &ro) ==
+         -EEXIST);
+  assert(kfs_fs_pwrite(h, "abcdef", 6, 0) == 6);
+  assert(kfs_fs_fstat(h, &st) == 0 && st.st_size == 6);
+
+  assert(kfs_fs_open(fs, "/f", O_RDONLY, 0, &ro) == 0);
+  assert(kfs_fs_pwrite(ro, "x", 1, 0) == -EBADF);
+  assert(kfs_fs_pread(ro, buf, sizeof(buf), -1) == -EINVAL);
+  assert(kfs_fs_pwrite(h, "x", 1, -1) == -EINVAL);
+  assert(kfs_fs_pwrite(h, buf, sizeof(buf), INT64_MAX - 1) == -EINVAL);
+  assert(kfs_fs_pread(ro, buf, sizeof(buf), 2) == 4);
+  assert(memcmp(buf, "cdef", 4) == 0);
+
+  // other entries coming and going do not lose the handle
+  assert(kfs_fs_mkdir(fs, "/d", 0755) == 0);
+  assert(kfs_fs_rmdir(fs, "/d") == 0);
+  assert(kfs_fs_pread(h, buf, sizeof(buf), 0) == 6);
+
+  // neither does its file being renamed back and forth
+  assert(kfs_fs_rename(fs, "/f", "/g") == 0);
+  assert(kfs_fs_rename(fs, "/g", "/f") == 0);
+  assert(kfs_fs_pread(h, buf, sizeof(buf), 0) == 6);
+
+  // but its path going away does
+  assert(kfs_fs_rename(fs, "/f", "/g") == 0);
+  assert(kfs_fs_pread(h, buf, sizeof(buf), 0) == -ENOENT);
+  assert(kfs_fs_fstat(ro, &st) == -ENOENT);
+  assert(kfs_fs_write(fs, "/f", "new", 3, 0) == 3);
+  assert(kfs_fs_pread(h, buf, sizeof(buf), 0) == 3);
+  assert(kfs_fs_close(ro) == 0);
+
+  assert(kfs_fs_open(fs, "/g", O_WRONLY | O_TRUNC, 0, &ro) == 0);
+  assert(kfs_fs_fstat(ro, &st) == 0 && st.st_size == 0);
+  assert(kfs_fs_close(ro) == 0);
+  assert(kfs_fs_unlink(fs, "/f") == 0);
+  assert(kfs_fs_pwrite(h, "x", 1, 0) == -ENOENT);
+  assert(kfs_fs_close(h) == 0);
+
+  kfs_fs_free(fs);
+});
+
+typedef struct {
+  KFS_FS *fs;
+  KFS_Handle *shared;
+  int id;
+} Worker;
+
+// each thread churns its own files while reading one shared handle
+static void *api_worker(void *arg) {
+  Worker *w = arg;
+  char path[32];
+  char buf[8];
+  snprintf(path, sizeof(path), "/t%d", w->id);
+
+  for (int i = 0; i < ROUNDS; i++) {
+    assert(kfs_fs_write(w->fs, path, "data", 4, 0) == 4);
+    assert(kfs_fs_pread(w->shared, buf, sizeof(buf), 0) == 6);
+    assert(kfs_fs_read(w->fs, path, buf, sizeof(buf), 0) == 4);
+    assert(kfs_fs_unlink(w->fs, path) == 0);
+  }
+  return NULL;
+}
+
+TEST_CASE(test_api_threads, {
+  KFS_FS *fs = kfs_fs_new();
+  KFS_Handle *shared;
+  assert(kfs_fs_open(fs, "/shared", O_RDWR | O_CREAT, 0644, &shared) == 0);
+  assert(kfs_fs_pwrite(shared, "shared", 6, 0) == 6);
+
+  pthread_t threads[THREADS];
+  Worker workers[THREADS];
+  for (int i = 0; i < THREADS; i++) {
+    workers[i].fs = fs;
+    workers[i].shared = shared;
+    workers[i].id = i;
+    pthread_create(&threads[i], NULL, api_worker, &workers[i]);
+  }
+  for (int i = 0; i < THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  int names = 0;
+  assert(kfs_fs_readdir(fs, "/", count_name, &names) == 0);
+  assert(names == 3);
+  assert(kfs_fs_close(shared) == 0);
+  kfs_fs_free(fs);
+});
+
+void api_test(void) {
+  test_api_paths();
+  test_api_handles();
+  test_api_threads();
+}
@@ -0,0 +1,169 @@
+#include "kfs.h"
+#include "tester.h"
+#include <assert.h>
+#include <stdlib.h>
+
+static int int_cmp(int lhs, int rhs) { return lhs < rhs ? -1 : lhs > rhs; }
+
+// few buckets so that hash ties and the cmp fallback get exercised
+static uint32_t int_hash(int key) { return ((uint32_t)key * 2654435761u) >> 28; }
+
+GenAVLTree(IntTree, int, int, int_hash, int_cmp);
+
+// returns height of t, asserting order and AVL balance on the way
+static int check_node(IntTree *tree, uint32_t t, IntTreeNode **prev) {
+  if (t == 0) {
+    return 0;
+  }
+
+  IntTreeNode *n = &tree->nodes[t];
+  assert(n->hash == int_hash(n->key));
+
+  int lh = check_node(tree, n->left, prev);
+  if (*prev != NULL) {
+    assert(IntTree_node_cmp(*prev, n) < 0);
+  }
+  *prev = n;
+  int rh = check_node(tree, n->right, prev);
+
+  assert(abs(lh - rh) <= 1);
+  assert(n->height == (uint32_t)(lh > rh ? lh : rh) + 1);
+  return n->height;
+}
+
+static void check_tree(IntTree *tree) {
+  IntTreeNode *prev = NULL;
+  check_node(tree, tree->root, &prev);
+}
+
+#define N 1000
+
+TEST_CASE(test_gen_insert_find, {
+  IntTree tree;
+  IntTree_init(&tree);
+
+  for (int i = 0; i < N; i++) {
+    IntTree_insert(&tree, (i * 7919) % N, i);
+  }
+  check_tree(&tree);
+  assert(tree.size == N);
+
+  for (int i = 0; i < N; i++) {
+    int *v = IntTree_find(&tree, (i * 7919) % N);
+    assert(v != NULL && *v == i);
+  }
+  assert(!IntTree_exists(&tree, N));
+
+  IntTree_insert(&tree, 0, -1);
+  assert(tree.size == N);
+  assert(*IntTree_find(&tree, 0) == -1);
+});
+
+TEST_CASE(test_gen_delete, {
+  IntTree tree;
+  IntTree_init(&tree);
+
+  for (int i = 0; i < N; i++) {
+    IntTree_insert(&tree, i, i);
+  }
+
+  for (int i = 0; i < N; i += 2) {
+    assert(IntTree_delete(&tree, i));
+    check_tree(&tree);
+  }
+  assert(!IntTree_delete(&tree, 0));
+  assert(tree.size == N / 2);
+
+  for (int i = 0; i < N; i++) {
+    assert(IntTree_exists(&tree, i) == (i % 2 == 1));
+  }
+
+  // freed slots are reused before the pool grows
+  uint32_t len = tree.len;
+  for (int i = 0; i < N; i += 2) {
+    IntTree_insert(&tree, i, i);
+  }
+  assert(tree.len == len);
+  check_tree(&tree);
+  IntTree_destroy(&tree);
+});
+
+TEST_CASE(test_generic_insert_find_delete, {
+  AVLTree *tree = new_AVLTree();
+  sds keys[N];
+
+  for (int i = 0; i < N; i++) {
+    keys[i] = sdscatprintf(sdsempty(), "%d", (i * 7919) % N);
+    avl_insert(tree, keys[i], INT_TO_VoPTR(i + 1), path_cmp);
+  }
+
+  for (int i = 0; i < N; i++) {
+    assert(VoPTR_TO_INT(avl_find(tree, keys[i], path_cmp)) == i + 1);
+  }
+
+  for (int i = 0; i < N; i += 2) {
+    avl_delete(tree, keys[i], path_cmp);
+  }
+
+  for (int i = 0; i < N; i++) {
+    assert(avl_exists(tree, keys[i], path_cmp) == (i % 2 == 1));
+  }
+});
+
+TEST_CASE(test_gen_build, {
+  static int keys[N];
+  static int values[N];
+  IntTree tree;
+  IntTree_init(&tree);
+
+  for (int i = 0; i < N; i++) {
+    keys[i] = ((i * 7919) % N) * 2;
+    values[i] = keys[i] / 2;
+  }
+  IntTree_build(&tree, keys, values, N);
+  check_tree(&tree);
+  assert(tree.size == N);
+
+  for (int i = 0; i < N; i++) {
+    assert(*IntTree_find(&tree, i * 2) == i);
+  }
+
+  // the built tree keeps working with the incremental operations
+  for (int i = 0; i < N; i++) {
+    IntTree_insert(&tree, i * 2 + 1, -i);
+  }
+  for (int i = 0; i < 2 * N; i += 3) {
+    assert(IntTree_delete(&tree, i));
+  }
+  check_tree(&tree);
+});
+
+TEST_CASE(test_generic_build_sorted, {
+  sds keys[N];
+  void *values[N];
+
+  for (int i = 0; i < N; i++) {
+    keys[i] = sdscatprintf(sdsempty(), "%08d", i);
+    values[i] = INT_TO_VoPTR(i + 1);
+  }
+
+  AVLTree *tree = avl_build_sorted((void **)keys, values, N);
+  assert(sz(tree->root) == N);
+  assert(ht(tree->root) <= 11);
+
+  for (int i = 0; i < N; i++) {
+    assert(VoPTR_TO_INT(avl_find(tree, keys[i], path_cmp)) == i + 1);
+  }
+
+  avl_delete(tree, keys[N / 2], path_cmp);
+  assert(sz(tree->root) == N - 1);
+  assert(!avl_exists(tree, keys[N / 2], path_cmp));
+});
+
+void avl_test(void) {
+  test_gen_insert_find();
+  test_gen_delete();
+  test_generic_insert_find_delete();
+  test_gen_build();
+  test_generic_build_sorted();
+}
@@ -0,0 +1,135 @@
+#include "kfs.h"
+#include "tester.h"
+#include <assert.h>
+#include <errno.h>
+
+TEST_CASE(test_import_children, {
+  KFS_Entry *root = new_KFS_Dir(sdsnew("/"));
+  KFS_Entry *childs[100];
+
+  for (int i = 0; i < 100; i++) {
+    sds name = sdscatprintf(sdsempty(), "f%d", (i * 37) % 100);
+    childs[i] = new_KFS_File(name);
+  }
+  kfs_import_children(root, childs, 100);
+  assert(GetAVLTree(root)->size == 100);
+
+  for (int i = 0; i < 100; i++) {
+    sds name = sdscatprintf(sdsempty(), "f%d", i);
+    KFS_Entry *entry = kfs_find_on(root, name);
+    assert(entry != NULL && strcmp(entry->name, name) == 0);
+    assert(entry->prev == root);
+  }
+
+  // importing into a populated directory merges
+  KFS_Entry *more[1] = {new_KFS_Dir(sdsnew("d"))};
+  kfs_import_children(root, more, 1);
+  assert(kfs_find(root, sdsnew("/d")) == more[0]);
+});
+
+TEST_CASE(test_rename, {
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  assert(itf_fuse_kfs_mkdir("/a", 0755) == 0);
+  assert(itf_fuse_kfs_mkdir("/a/sub", 0755) == 0);
+  assert(itf_fuse_kfs_mkdir("/b", 0755) == 0);
+  assert(itf_fuse_kfs_create("/a/f", 0644, NULL) == 0);
+  assert(itf_fuse_kfs_create("/b/g", 0644, NULL) == 0);
+
+  KFS_Entry *f = kfs_find(KFS_ROOT, sdsnew("/a/f"));
+  kfs_write(f, "hello", 5, 0);
+
+  // same directory, then across directories: the entry itself moves
+  assert(itf_fuse_kfs_rename("/a/f", "/a/f2") == 0);
+  assert(kfs_find(KFS_ROOT, sdsnew("/a/f")) == NULL);
+  assert(kfs_find(KFS_ROOT, sdsnew("/a/f2")) == f);
+  assert(itf_fuse_kfs_rename("/a/f2", "/b/f") == 0);
+  assert(kfs_find(KFS_ROOT, sdsnew("/b/f")) == f && f->prev->prev == KFS_ROOT);
+  assert(strcmp(f->name, "f") == 0);
+
+  // replacing an existing file
+  assert(itf_fuse_kfs_rename("/b/f", "/b/g") == 0);
+  assert(kfs_find(KFS_ROOT, sdsnew("/b/g")) == f);
+  assert(GetAVLTree(f->prev)->size == 1);
+
+  // whole subtrees
+  KFS_Entry *a = kfs_find(KFS_ROOT, sdsnew("/a"));
+  assert(itf_fuse_kfs_rename("/a", "/b/a") == 0);
+  assert(kfs_find(KFS_ROOT, sdsnew("/b/a/sub")) != NULL);
+  assert(kfs_find(KFS_ROOT, sdsnew("/b/a")) == a);
+
+  assert(itf_fuse_kfs_rename("/b", "/b/a/sub/x") == -EINVAL);
+  assert(itf_fuse_kfs_rename("/b/g", "/b/a") == -EISDIR);
+  assert(itf_fuse_kfs_rename("/b/a", "/b/g") == -ENOTDIR);
+  assert(itf_fuse_kfs_rename("/b", "/x/y") == -ENOENT);
+  assert(itf_fuse_kfs_mkdir("/c", 0755) == 0);
+  assert(itf_fuse_kfs_rename("/c", "/b") == -ENOTEMPTY);
+  assert(itf_fuse_kfs_rename("/c", "/b/a/sub") == 0);
+
+  kfs_usage_sync(KFS_ROOT);
+  assert(kfs_usage_get(KFS_ROOT).inodes == 4); // b, b/g, b/a, b/a/sub
+  assert(kfs_usage_get(KFS_ROOT).bytes == 5);
+  kfs_reclaim_drain();
+});
+
+static bool ts_le(struct timespec a, struct timespec b) {
+  return a.tv_sec < b.tv_sec ||
+         (a.tv_sec == b.tv_sec && a.tv_nsec <= b.tv_nsec);
+}
+
+TEST_CASE(test_times, {
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  assert(itf_fuse_kfs_mkdir("/d", 0755) == 0);
+  KFS_Entry *d = kfs_find(KFS_ROOT, sdsnew("/d"));
+  assert(d->ctime.tv_sec != 0);
+
+  // children coming and going modify the directory
+  uint64_t v = d->version;
+  struct timespec before = d->mtime;
+  assert(itf_fuse_kfs_create("/d/f", 0644, NULL) == 0);
+  assert(d->version > v && ts_le(before, d->mtime));
+  KFS_Entry *f = kfs_find(KFS_ROOT, sdsnew("/d/f"));
+
+  // data changes bump mtime and ctime; metadata only ctime
+  v = f->version;
+  kfs_write(f, "abc", 3, 0);
+  assert(f->version > v);
+  assert(f->mtime.tv_sec == f->ctime.tv_sec);
+  assert(f->mtime.tv_nsec == f->ctime.tv_nsec);
+
+  struct timespec mtime = f->mtime;
+  v = f->version;
+  assert(itf_fuse_kfs_chmod("/d/f", 0600) == 0);
+  assert(itf_fuse_kfs_chown("/d/f", (uid_t)-1, 42) == 0);
+  assert(f->version == v + 2 && f->gid == 42);
+  assert(f->mtime.tv_sec == mtime.tv_sec && f->mtime.tv_nsec == mtime.tv_nsec);
+
+  struct timespec tv[2];
+  tv[0].tv_sec = 100;
+  tv[0].tv_nsec = 0;
+  tv[1].tv_sec = 0;
+  tv[1].tv_nsec = UTIME_OMIT;
+  assert(itf_fuse_kfs_utimens("/d/f", tv) == 0);
+  assert(f->atime.tv_sec == 100 && f->mtime.tv_sec == mtime.tv_sec);
+
+  struct stat st;
+  assert(itf_fuse_kfs_getattr("/d/f", &st) == 0);
+  assert(st.st_atim.tv_sec == 100 && st.st_blocks == 1);
+  assert(st.st_ctim.tv_sec == f->ctime.tv_sec);
+
+  // a rename changes the entry and both parents
+  v = f->version;
+  uint64_t rv = KFS_ROOT->version;
+  assert(itf_fuse_kfs_rename("/d/f", "/f") == 0);
+  assert(f->version > v && KFS_ROOT->version > rv);
+
+  v = f->version;
+  kfs_truncate(f, 0);
+  assert(f->version > v);
+  kfs_reclaim_drain();
+});
+
+void dir_test(void) {
+  test_import_children();
+  test_rename();
+  test_times();
+}
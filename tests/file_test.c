@@ -0,0 +1,250 @@
+#include "kfs.h"
+#include "tester.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+static void fill(char *buf, size_t size, int seed) {
+  for (size_t i = 0; i < size; i++) {
+    buf[i] = (char)(i * 31 + seed);
+  }
+}
+
+static bool same_as(KFS_Entry *file, const char *expected, size_t size) {
+  char *buf = xmalloc(size + 1);
+  size_t n = kfs_read(file, buf, size + 1, 0);
+  bool ok = n == size && memcmp(buf, expected, size) == 0;
+  free(buf);
+  return ok;
+}
+
+TEST_CASE(test_chunked_write_read, {
+  KFS_Entry *file = new_KFS_File(sdsnew("f"));
+  size_t size = 3 * KFS_CHUNK_SIZE + 123;
+  char *expected = xmalloc(size);
+  fill(expected, size, 1);
+
+  // unaligned writes across chunk boundaries
+  for (size_t off = 0; off < size; off += 1000) {
+    size_t n = off + 1000 > size ? size - off : 1000;
+    kfs_write(file, expected + off, n, off);
+  }
+  assert(file->size == (off_t)size);
+  assert(same_as(file, expected, size));
+
+  char buf[10];
+  assert(kfs_read(file, buf, 10, size - 4) == 4);
+  assert(memcmp(buf, expected + size - 4, 4) == 0);
+  assert(kfs_read(file, buf, 10, size) == 0);
+
+  // holes and truncated tails read as zero
+  KFS_Entry *sparse = new_KFS_File(sdsnew("s"));
+  kfs_write(sparse, "x", 1, 2 * KFS_CHUNK_SIZE);
+  assert(kfs_read(sparse, buf, 2, KFS_CHUNK_SIZE) == 2);
+  assert(buf[0] == 0 && buf[1] == 0);
+
+  kfs_write(sparse, "abcdef", 6, 0);
+  kfs_truncate(sparse, 3);
+  kfs_truncate(sparse, 6);
+  assert(kfs_read(sparse, buf, 10, 0) == 6);
+  assert(memcmp(buf, "abc\0\0\0", 6) == 0);
+
+  free(expected);
+  free_KFS_Entry(file);
+  free_KFS_Entry(sparse);
+});
+
+TEST_CASE(test_clone_cow, {
+  KFS_Entry *dir = new_KFS_Dir(sdsnew("d"));
+  KFS_Entry *src = new_KFS_File(sdsnew("src"));
+  KFS_Entry *dst = new_KFS_File(sdsnew("dst"));
+  kfs_append_child(dir, src);
+  kfs_append_child(dir, dst);
+
+  size_t size = 4 * KFS_CHUNK_SIZE;
+  char *orig = xmalloc(size);
+  fill(orig, size, 7);
+  kfs_write(src, orig, size, 0);
+
+  kfs_clone(dst, src);
+  KFS_ChunkTable *shared = GetKFSFile(src)->chunks;
+  assert(GetKFSFile(dst)->chunks == shared);
+  assert(dst->size == src->size && same_as(dst, orig, size));
+
+  // writing one side copies only the chunk it touches
+  kfs_write(dst, "ZZ", 2, KFS_CHUNK_SIZE + 5);
+  KFS_ChunkTable *own = GetKFSFile(dst)->chunks;
+  assert(own != shared && GetKFSFile(src)->chunks == shared);
+  assert(own->chunks[0] == shared->chunks[0]);
+  assert(own->chunks[1] != shared->chunks[1]);
+  assert(own->chunks[2] == shared->chunks[2]);
+  assert(same_as(src, orig, size));
+
+  memcpy(orig + KFS_CHUNK_SIZE + 5, "ZZ", 2);
+  assert(same_as(dst, orig, size));
+
+  // truncating the clone leaves the source alone
+  kfs_truncate(dst, 10);
+  assert(src->size == (off_t)size && dst->size == 10);
+  kfs_usage_sync(dir);
+  assert(kfs_usage_get(dir).bytes == (int64_t)size + 10);
+
+  free(orig);
+  kfs_remove_tree(dir, sdsnew("src"));
+  kfs_remove_tree(dir, sdsnew("dst"));
+  kfs_reclaim_drain();
+});
+
+TEST_CASE(test_shell_cp, {
+  KFS_Entry *root = new_KFS_Dir(sdsnew("/"));
+  KFSShellContext *ctx = new_KFSShellContext(root);
+  assert(kfs_mkdir(ctx, sdsnew("dir")));
+  assert(kfs_touch(ctx, sdsnew("a")));
+
+  KFS_Entry *a = kfs_find_on(root, sdsnew("a"));
+  kfs_write(a, "hello", 5, 0);
+
+  assert(kfs_cp(ctx, sdsnew("a"), sdsnew("b")));
+  assert(kfs_cp(ctx, sdsnew("a"), sdsnew("dir")));
+  assert(!kfs_cp(ctx, sdsnew("dir"), sdsnew("c")));
+
+  KFS_Entry *b = kfs_find(root, sdsnew("/b"));
+  KFS_Entry *da = kfs_find(root, sdsnew("/dir/a"));
+  assert(b != NULL && da != NULL);
+  assert(same_as(b, "hello", 5) && same_as(da, "hello", 5));
+
+  kfs_write(a, "J", 1, 0);
+  assert(same_as(a, "Jello", 5) && same_as(b, "hello", 5));
+});
+
+TEST_CASE(test_range_lock, {
+  KFS_RangeLock rl;
+  KFS_RangeHold a;
+  KFS_RangeHold b;
+  KFS_RangeHold c;
+  KFS_RangeHold d;
+  kfs_range_init(&rl);
+
+  kfs_range_lock(&rl, &a, 0, 100, true);
+  assert(kfs_range_trylock(&rl, &b, 100, 200, true));
+  assert(!kfs_range_trylock(&rl, &c, 50, 150, false));
+  kfs_range_unlock(&rl, &a);
+  assert(kfs_range_trylock(&rl, &c, 0, 50, false));
+  assert(kfs_range_trylock(&rl, &d, 0, 50, false));
+  assert(!kfs_range_trylock(&rl, &a, 10, 20, true));
+
+  kfs_range_unlock(&rl, &b);
+  kfs_range_unlock(&rl, &c);
+  kfs_range_unlock(&rl, &d);
+  kfs_range_destroy(&rl);
+});
+
+#define WRITERS 8
+#define WRITES_PER_WRITER 64
+#define WRITE_SIZE 10000
+
+typedef struct {
+  KFS_Entry *file;
+  int id;
+} Writer;
+
+// writer i owns every WRITERS-th slot, so ranges interleave and some share
+// a chunk with a neighbour
+static void *write_slots(void *arg) {
+  Writer *w = arg;
+  char buf[WRITE_SIZE];
+  memset(buf, 'a' + w->id, sizeof(buf));
+
+  for (int i = 0; i < WRITES_PER_WRITER; i++) {
+    off_t slot = (off_t)i * WRITERS + w->id;
+    kfs_write(w->file, buf, sizeof(buf), slot * WRITE_SIZE);
+  }
+  return NULL;
+}
+
+TEST_CASE(test_parallel_writers, {
+  KFS_Entry *dir = new_KFS_Dir(sdsnew("d"));
+  KFS_Entry *file = new_KFS_File(sdsnew("f"));
+  kfs_append_child(dir, file);
+
+  pthread_t threads[WRITERS];
+  Writer writers[WRITERS];
+  for (int i = 0; i < WRITERS; i++) {
+    writers[i].file = file;
+    writers[i].id = i;
+    pthread_create(&threads[i], NULL, write_slots, &writers[i]);
+  }
+  for (int i = 0; i < WRITERS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  size_t size = (size_t)WRITERS * WRITES_PER_WRITER * WRITE_SIZE;
+  assert(file->size == (off_t)size);
+  char *buf = xmalloc(size);
+  assert(kfs_read(file, buf, size, 0) == size);
+  for (size_t i = 0; i < size; i++) {
+    assert(buf[i] == 'a' + (int)(i / WRITE_SIZE % WRITERS));
+  }
+  kfs_usage_sync(dir);
+  assert(kfs_usage_get(dir).bytes == (int64_t)size);
+
+  free(buf);
+});
+
+TEST_CASE(test_cache_policy, {
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  assert(itf_fuse_kfs_mkdir("/big", 0755) == 0);
+  assert(itf_fuse_kfs_create("/big/f", 0644, NULL) == 0);
+  assert(itf_fuse_kfs_create("/small", 0644, NULL) == 0);
+  KFS_Entry *f = kfs_find(KFS_ROOT, sdsnew("/big/f"));
+  KFS_Entry *small = kfs_find(KFS_ROOT, sdsnew("/small"));
+  kfs_write(small, "hot", 3, 0);
+
+  // auto: small files keep their pages while unchanged
+  struct fuse_file_info fi;
+  memset(&fi, 0, sizeof(fi));
+  fi.flags = O_RDONLY;
+  assert(itf_fuse_kfs_open("/small", &fi) == 0);
+  assert(!fi.direct_io && !fi.keep_cache);
+  assert(itf_fuse_kfs_open("/small", &fi) == 0);
+  assert(!fi.direct_io && fi.keep_cache);
+  kfs_write(small, "!", 1, 3);
+  assert(itf_fuse_kfs_open("/small", &fi) == 0);
+  assert(!fi.keep_cache);
+
+  // ... and large ones bypass the page cache
+  kfs_truncate(f, kfs_cache_opts.direct_min);
+  assert(itf_fuse_kfs_open("/big/f", &fi) == 0);
+  assert(fi.direct_io && !fi.keep_cache);
+
+  // a subtree policy applies below it, a file's own one wins
+  assert(itf_fuse_kfs_setxattr("/big", "user.kfs.cache", "keep_cache", 10,
+                               0) == 0);
+  assert(itf_fuse_kfs_open("/big/f", &fi) == 0);
+  assert(!fi.direct_io && fi.keep_cache);
+  assert(itf_fuse_kfs_setxattr("/big/f", "user.kfs.cache", "direct_io", 9,
+                               0) == 0);
+  assert(itf_fuse_kfs_open("/big/f", &fi) == 0);
+  assert(fi.direct_io);
+
+  char value[16];
+  assert(itf_fuse_kfs_getxattr("/big/f", "user.kfs.cache", value,
+                               sizeof(value)) == 9);
+  assert(itf_fuse_kfs_setxattr("/big/f", "user.kfs.cache", "inherit", 7,
+                               0) == 0);
+  assert(itf_fuse_kfs_getxattr("/big/f", "user.kfs.cache", value,
+                               sizeof(value)) == 10);
+  assert(memcmp(value, "keep_cache", 10) == 0);
+  assert(itf_fuse_kfs_setxattr("/big/f", "user.kfs.cache", "bogus", 5, 0) ==
+         -EINVAL);
+});
+
+void file_test(void) {
+  test_chunked_write_read();
+  test_clone_cow();
+  test_shell_cp();
+  test_range_lock();
+  test_parallel_writers();
+  test_cache_policy();
+}
@@ -0,0 +1,62 @@
+#include "kfs.h"
+#include "tester.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#define OPS 1000
+
+static void count_getattrs(void) {
+  struct stat st;
+  KFS_PerfStats stats;
+  for (int i = 0; i < OPS; i++) {
+    assert(kfs_ops.getattr("/f", &st) == 0);
+  }
+  assert(kfs_ops.setxattr("/", "user.kfs.perf", "0", 1, 0) == 0);
+  assert(kfs_ops.getattr("/f", &st) == 0);
+  kfs_perf_get(KFS_OP_getattr, &stats);
+  assert(stats.count == OPS);
+  assert(!stats.counted[KFS_PERF_instructions] ||
+         stats.sums[KFS_PERF_instructions] >= OPS);
+
+  // served next to the stats
+  struct fuse_file_info fi;
+  memset(&fi, 0, sizeof(fi));
+  fi.flags = O_RDONLY;
+  char buf[4096];
+  assert(kfs_ops.open(KFS_PERF_FILE, &fi) == 0);
+  int n = kfs_ops.read(KFS_PERF_FILE, buf, sizeof(buf) - 1, 0, &fi);
+  assert(n > 0);
+  buf[n] = '\0';
+  assert(strncmp(buf, "op count cycles instructions ipc", 32) == 0);
+  assert(strstr(buf, "\ngetattr 1000 ") != NULL);
+  kfs_ops.release(KFS_PERF_FILE, &fi);
+
+  kfs_perf_reset();
+  kfs_perf_get(KFS_OP_getattr, &stats);
+  assert(stats.count == 0);
+}
+
+TEST_CASE(test_perf_counts, {
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  assert(kfs_ops.create("/f", 0644, NULL) == 0);
+  struct stat st;
+  KFS_PerfStats stats;
+
+  // off by default: nothing is counted
+  kfs_perf_reset();
+  assert(kfs_ops.getattr("/f", &st) == 0);
+  kfs_perf_get(KFS_OP_getattr, &stats);
+  assert(stats.count == 0);
+
+  int res = kfs_ops.setxattr("/", "user.kfs.perf", "1", 1, 0);
+  assert(kfs_ops.setxattr("/f", "user.kfs.perf", "1", 1, 0) == -EINVAL);
+  // where perf_event_open is refused, the switch stays off
+  assert(res == 0 || (res == -ENOTSUP && !atomic_load(&kfs_perf_on)));
+  if (res == 0) {
+    assert(atomic_load(&kfs_perf_on));
+    count_getattrs();
+  }
+});
+
+void perf_test(void) { test_perf_counts(); }
@@ -0,0 +1,97 @@
+#include "kfs.h"
+#include "tester.h"
+#include <assert.h>
+#include <errno.h>
+
+static KFS_Entry *build_tree(KFS_Entry *parent, const char *name, int depth,
+                             int fanout) {
+  KFS_Entry *dir = new_KFS_Dir(sdsnew(name));
+  kfs_append_child(parent, dir);
+
+  for (int i = 0; i < fanout; i++) {
+    sds child = sdscatprintf(sdsempty(), "f%d", i);
+    KFS_Entry *file = new_KFS_File(child);
+    kfs_append_child(dir, file);
+    kfs_write(file, "data", 4, 0);
+    sdsfree(child);
+
+    if (depth > 0) {
+      child = sdscatprintf(sdsempty(), "d%d", i);
+      build_tree(dir, child, depth - 1, fanout);
+      sdsfree(child);
+    }
+  }
+
+  return dir;
+}
+
+TEST_CASE(test_remove_tree, {
+  KFS_Entry *root = new_KFS_Dir(sdsnew("/"));
+  build_tree(root, "big", 3, 6);
+  build_tree(root, "keep", 1, 2);
+  kfs_usage_sync(root);
+  int64_t keep_inodes = kfs_usage_get(kfs_find_on(root, sdsnew("keep"))).inodes;
+
+  assert(kfs_remove_tree(root, sdsnew("big")));
+  assert(kfs_find_on(root, sdsnew("big")) == NULL);
+  assert(!kfs_remove_tree(root, sdsnew("big")));
+  assert(kfs_usage_get(root).inodes == keep_inodes + 1);
+
+  // without the thread the caller frees the queue itself
+  assert(kfs_reclaim_pending() == 1);
+  kfs_reclaim_drain();
+  assert(kfs_reclaim_pending() == 0);
+  assert(kfs_find(root, sdsnew("/keep/d1/f1")) != NULL);
+});
+
+TEST_CASE(test_reclaim_thread, {
+  KFS_Entry *root = new_KFS_Dir(sdsnew("/"));
+  kfs_reclaim_start();
+
+  for (int i = 0; i < 8; i++) {
+    sds name = sdscatprintf(sdsempty(), "t%d", i);
+    build_tree(root, name, 2, 8);
+    assert(kfs_remove_tree(root, name));
+    sdsfree(name);
+  }
+
+  kfs_reclaim_drain();
+  assert(kfs_reclaim_pending() == 0);
+  assert(GetAVLTree(root)->size == 0);
+
+  // stop drains whatever is still queued
+  build_tree(root, "last", 2, 8);
+  kfs_remove_tree(root, sdsnew("last"));
+  kfs_reclaim_stop();
+  assert(kfs_reclaim_pending() == 0);
+});
+
+TEST_CASE(test_rmdir, {
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  KFS_ROOT->mode = S_IFDIR | 0777;
+  build_tree(KFS_ROOT, "full", 0, 1);
+  assert(itf_fuse_kfs_mkdir("/empty", 0755) == 0);
+
+  assert(itf_fuse_kfs_rmdir("/full") == -ENOTEMPTY);
+  assert(itf_fuse_kfs_rmdir("/full/f0") == -ENOTDIR);
+  assert(itf_fuse_kfs_unlink("/full") == -EISDIR);
+  assert(itf_fuse_kfs_rmdir("/nothing") == -ENOENT);
+
+  assert(itf_fuse_kfs_rmdir("/empty") == 0);
+  assert(itf_fuse_kfs_unlink("/full/f0") == 0);
+  assert(itf_fuse_kfs_rmdir("/full") == 0);
+  assert(GetAVLTree(KFS_ROOT)->size == 0);
+
+  build_tree(KFS_ROOT, "tree", 2, 3);
+  assert(itf_fuse_kfs_setxattr("/", "user.kfs.rmtree", "tree", 4, 0) == 0);
+  assert(itf_fuse_kfs_setxattr("/", "user.kfs.rmtree", "tree", 4, 0) ==
+         -ENOENT);
+  assert(GetAVLTree(KFS_ROOT)->size == 0);
+  kfs_reclaim_drain();
+});
+
+void reclaim_test(void) {
+  test_remove_tree();
+  test_reclaim_thread();
+  test_rmdir();
+}
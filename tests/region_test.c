@@ -0,0 +1,112 @@
+#include "kfs.h"
+#include "tester.h"
+#include <assert.h>
+#include <errno.h>
+
+TEST_CASE(test_region_alloc, {
+  KFS_Region *region = kfs_region_new(NULL);
+
+  char *a = kfs_region_alloc(region, 3, 1);
+  void *b = kfs_region_alloc(region, 100, KFS_CACHE_LINE);
+  assert(((uintptr_t)b & (KFS_CACHE_LINE - 1)) == 0);
+  assert((char *)b >= a + 3);
+
+  // a big allocation does not abandon the current block
+  void *big = kfs_region_alloc(region, KFS_REGION_MIN_BLOCK * 2, 8);
+  char *c = kfs_region_alloc(region, 8, 8);
+  assert(big != NULL && c > (char *)b && c < (char *)b + KFS_REGION_MIN_BLOCK);
+
+  memset(a, 'x', 3);
+  char *d = kfs_region_realloc(region, a, 3, 10);
+  assert(memcmp(d, "xxx", 3) == 0);
+
+  kfs_region_destroy(region);
+});
+
+TEST_CASE(test_scratch_dir, {
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  assert(itf_fuse_kfs_mkdir("/scratch", 0755) == 0);
+  assert(itf_fuse_kfs_mkdir("/keep", 0755) == 0);
+  assert(itf_fuse_kfs_create("/keep/k", 0644, NULL) == 0);
+  assert(itf_fuse_kfs_setxattr("/keep", "user.kfs.scratch", "1", 1, 0) ==
+         -ENOTEMPTY);
+  assert(itf_fuse_kfs_setxattr("/scratch", "user.kfs.scratch", "1", 1, 0) ==
+         0);
+  KFS_Entry *scratch = kfs_find(KFS_ROOT, sdsnew("/scratch"));
+  assert(kfs_is_scratch(scratch) && kfs_entry_home(scratch) == NULL);
+
+  assert(itf_fuse_kfs_mkdir("/scratch/d", 0755) == 0);
+  assert(itf_fuse_kfs_setxattr("/scratch/d", "user.kfs.scratch", "1", 1, 0) ==
+         -EINVAL);
+  char data[1000];
+  memset(data, 'z', sizeof(data));
+  for (int i = 0; i < 500; i++) {
+    char path[64];
+    snprintf(path, sizeof(path), "/scratch/d/f%d", i);
+    assert(itf_fuse_kfs_create(path, 0644, NULL) == 0);
+    assert(itf_fuse_kfs_write(path, data, sizeof(data), 0, NULL) ==
+           (int)sizeof(data));
+  }
+
+  KFS_Entry *f = kfs_find(KFS_ROOT, sdsnew("/scratch/d/f7"));
+  assert(kfs_entry_home(f) == scratch->region);
+  char buf[1000];
+  assert(kfs_read(f, buf, sizeof(buf), 0) == sizeof(buf));
+  assert(memcmp(buf, data, sizeof(buf)) == 0);
+
+  // renames inside the region are fine, crossing it is not
+  assert(itf_fuse_kfs_rename("/scratch/d/f7", "/scratch/f7") == 0);
+  assert(strcmp(f->name, "f7") == 0);
+  assert(itf_fuse_kfs_rename("/scratch/f7", "/keep/f7") == -EXDEV);
+  assert(itf_fuse_kfs_rename("/keep/k", "/scratch/k") == -EXDEV);
+  assert(itf_fuse_kfs_rename("/scratch", "/keep/s") == 0);
+  assert(itf_fuse_kfs_rename("/keep/s", "/scratch") == 0);
+
+  // clones into or out of the region copy instead of sharing
+  KFS_Entry *k = kfs_find(KFS_ROOT, sdsnew("/keep/k"));
+  kfs_clone(k, f);
+  assert(GetKFSFile(k)->chunks != GetKFSFile(f)->chunks);
+  assert(kfs_read(k, buf, sizeof(buf), 0) == sizeof(buf));
+  assert(memcmp(buf, data, sizeof(buf)) == 0);
+
+  kfs_usage_sync(KFS_ROOT);
+  assert(kfs_usage_get(scratch).inodes == 501); // d and its 500 files
+
+  assert(itf_fuse_kfs_setxattr("/", "user.kfs.rmtree", "scratch", 7, 0) == 0);
+  kfs_reclaim_drain();
+  assert(kfs_find(KFS_ROOT, sdsnew("/scratch")) == NULL);
+  assert(kfs_read(k, buf, sizeof(buf), 0) == sizeof(buf));
+  assert(memcmp(buf, data, sizeof(buf)) == 0);
+});
+
+// file chunks get blocks of their own, so the region holds about what the
+// files do rather than growing a block per chunk
+TEST_CASE(test_scratch_reserved, {
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  assert(itf_fuse_kfs_mkdir("/scratch", 0755) == 0);
+  assert(itf_fuse_kfs_setxattr("/scratch", "user.kfs.scratch", "1", 1, 0) ==
+         0);
+  assert(itf_fuse_kfs_create("/scratch/f", 0644, NULL) == 0);
+
+  size_t stored = 8 * 1024 * 1024;
+  char *data = xmalloc(KFS_CHUNK_SIZE);
+  memset(data, 'r', KFS_CHUNK_SIZE);
+  for (size_t off = 0; off < stored; off += KFS_CHUNK_SIZE) {
+    assert(itf_fuse_kfs_write("/scratch/f", data, KFS_CHUNK_SIZE, off, NULL) ==
+           KFS_CHUNK_SIZE);
+  }
+  xfree(&data);
+
+  KFS_Entry *scratch = kfs_find(KFS_ROOT, sdsnew("/scratch"));
+  assert(scratch->region->reserved >= stored);
+  assert(scratch->region->reserved <= stored + stored / 4);
+
+  assert(itf_fuse_kfs_setxattr("/", "user.kfs.rmtree", "scratch", 7, 0) == 0);
+  kfs_reclaim_drain();
+});
+
+void region_test(void) {
+  test_region_alloc();
+  test_scratch_dir();
+  test_scratch_reserved();
+}
@@ -0,0 +1,68 @@
+#include "kfs.h"
+#include "tester.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool contains(const char *buf, size_t len, const char *s) {
+  for (size_t i = 0; i + strlen(s) <= len; i++) {
+    if (memcmp(buf + i, s, strlen(s)) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+TEST_CASE(test_capture_replay, {
+  char file[] = "/tmp/kfs_capture_XXXXXX";
+  int fd = mkstemp(file);
+  assert(fd != -1);
+  close(fd);
+
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  assert(kfs_capture_start(file));
+  assert(kfs_ops.mkdir("/d", 0755) == 0);
+  assert(kfs_ops.create("/d/f", 0644, NULL) == 0);
+  assert(kfs_ops.write("/d/f", "abcd", 4, 100, NULL) == 4);
+  assert(kfs_ops.setxattr("/d", "user.kfs.cache", "direct_io", 9, 0) == 0);
+  assert(kfs_ops.setxattr("/d/f", "user.other", "secret", 6, 0) == -ENOTSUP);
+  assert(kfs_ops.rename("/d/f", "/d/g") == 0);
+  assert(kfs_ops.unlink("/d/f") == -ENOENT);
+  assert(kfs_ops.create("/d/f", 0644, NULL) == 0);
+  assert(kfs_ops.truncate("/d/f", 10) == 0);
+  struct stat st;
+  assert(kfs_ops.getattr("/.kfs/stats", &st) == 0); // not captured
+  kfs_capture_stop();
+
+  // names do not leak into the capture
+  FILE *in = fopen(file, "rb");
+  char buf[4096];
+  size_t len = fread(buf, 1, sizeof(buf), in);
+  assert(len > 8 && len < sizeof(buf));
+  assert(!contains(buf, len, "secret"));
+  assert(contains(buf, len, "direct_io"));
+
+  // replayed on an empty tree, every operation has its captured result
+  rewind(in);
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  KFS_ReplayResult result;
+  assert(kfs_replay(in, false, &result) == 0);
+  fclose(in);
+  assert(result.ops == 9 && result.diverged == 0);
+  assert(kfs_ops.getattr("/n0/n2", &st) == 0 && st.st_size == 104);
+  assert(kfs_ops.getattr("/n0/n1", &st) == 0 && st.st_size == 10);
+  assert(kfs_cache_effective(kfs_find(KFS_ROOT, sdsnew("/n0/n1"))) ==
+         KFS_CACHE_DIRECT);
+
+  // a truncated capture is reported
+  assert(truncate(file, len - 1) == 0);
+  in = fopen(file, "rb");
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  assert(kfs_replay(in, false, &result) == -1 && result.ops == 8);
+  fclose(in);
+  unlink(file);
+});
+
+void replay_test(void) { test_capture_replay(); }
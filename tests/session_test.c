@@ -0,0 +1,53 @@
+#include "kfs.h"
+#include "tester.h"
+#include <assert.h>
+
+TEST_CASE(test_init_conn, {
+  KFS_SessionOpts saved = kfs_session_opts;
+  struct fuse_conn_info conn;
+  memset(&conn, 0, sizeof(conn));
+  conn.capable = FUSE_CAP_ASYNC_READ | FUSE_CAP_BIG_WRITES;
+  conn.max_write = 128 * 1024;
+  conn.max_readahead = 128 * 1024;
+
+  // large I/O by default
+  kfs_session_init_conn(&conn);
+  assert(conn.want & FUSE_CAP_BIG_WRITES);
+  assert((conn.want & FUSE_CAP_ASYNC_READ) && conn.async_read);
+  assert(conn.max_write == 128 * 1024 && conn.max_readahead == 128 * 1024);
+
+  // caps only lower what was offered
+  kfs_session_opts.max_write = 1 << 30;
+  kfs_session_opts.max_readahead = 4096;
+  kfs_session_opts.sync_read = 1;
+  kfs_session_init_conn(&conn);
+  assert(conn.max_write == 128 * 1024 && conn.max_readahead == 4096);
+  assert(!(conn.want & FUSE_CAP_ASYNC_READ) && !conn.async_read);
+
+  memset(&conn, 0, sizeof(conn));
+  conn.capable = FUSE_CAP_BIG_WRITES;
+  kfs_session_opts.stock_conn = 1;
+  kfs_session_init_conn(&conn);
+  assert(conn.want == 0);
+  kfs_session_opts = saved;
+});
+
+TEST_CASE(test_init_destroy, {
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  struct fuse_conn_info conn;
+  memset(&conn, 0, sizeof(conn));
+  itf_fuse_kfs_init(&conn);
+
+  assert(itf_fuse_kfs_mkdir("/d", 0755) == 0);
+  assert(itf_fuse_kfs_create("/d/f", 0644, NULL) == 0);
+  assert(itf_fuse_kfs_setxattr("/", "user.kfs.rmtree", "d", 1, 0) == 0);
+
+  // unmounting drains what the services still have queued
+  itf_fuse_kfs_destroy(NULL);
+  assert(kfs_reclaim_pending() == 0 && kfs_notify_pending() == 0);
+});
+
+void session_test(void) {
+  test_init_conn();
+  test_init_destroy();
+}
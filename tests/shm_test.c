@@ -0,0 +1,161 @@
+#include "kfs.h"
+#include "kfs_shm.h"
+#include "tester.h"
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define BIG_BYTES (64 * 1024)
+#define ROUNDS 20000
+
+static char socket_path[64];
+
+static KFS_ShmClient *start(void) {
+  KFS_ROOT = new_KFS_Dir("/");
+  snprintf(socket_path, sizeof(socket_path), "/tmp/kfs_shm_test.%d",
+           (int)getpid());
+  assert(kfs_share_listen(socket_path));
+
+  KFS_ShmClient *client;
+  assert(kfs_shm_connect(socket_path, &client) == 0);
+  return client;
+}
+
+static int64_t shm_objects(void) {
+  KFS_AllocStats st;
+  kfs_alloc_get(KFS_ALLOC_shm, &st);
+  return st.objects;
+}
+
+TEST_CASE(test_shm_views, {
+  int64_t views = shm_objects();
+  KFS_ShmClient *client = start();
+  KFS_ShmFile *file;
+  char buf[BIG_BYTES];
+
+  assert(kfs_ops.create("/f", 0644, NULL) == 0);
+  assert(kfs_ops.write("/f", "hello", 5, 0, NULL) == 5);
+  assert(kfs_ops.mkdir("/d", 0755) == 0);
+  assert(kfs_shm_open(client, "/d", &file) == -EISDIR);
+  assert(kfs_shm_open(client, "/missing", &file) == -ENOENT);
+  assert(kfs_shm_open(client, "relative", &file) == -EINVAL);
+
+  assert(kfs_shm_open(client, "/f", &file) == 0);
+  assert(shm_objects() == views + 1);
+  assert(kfs_shm_pread(file, buf, sizeof(buf), 0) == 5);
+  assert(memcmp(buf, "hello", 5) == 0);
+
+  // changes show up without asking the daemon again
+  assert(kfs_ops.write("/f", "HE", 2, 0, NULL) == 2);
+  assert(kfs_shm_pread(file, buf, sizeof(buf), 1) == 4);
+  assert(memcmp(buf, "Ello", 4) == 0);
+  assert(kfs_ops.truncate("/f", 2) == 0);
+  assert(kfs_shm_size(file) == 2);
+  assert(kfs_ops.truncate("/f", 4) == 0);
+  assert(kfs_shm_pread(file, buf, sizeof(buf), 0) == 4);
+  assert(memcmp(buf, "HE\0\0", 4) == 0);
+
+  // outgrowing the view retires it, and the next read maps a new one
+  memset(buf, 'b', sizeof(buf));
+  assert(kfs_ops.write("/f", buf, sizeof(buf), 0, NULL) == BIG_BYTES);
+  memset(buf, 0, sizeof(buf));
+  assert(kfs_shm_pread(file, buf, sizeof(buf), 0) == BIG_BYTES);
+  assert(buf[0] == 'b' && buf[BIG_BYTES - 1] == 'b');
+  assert(shm_objects() == views + 1);
+
+  // so does a clone over the file
+  assert(kfs_ops.write("/g", "clone", 5, 0, NULL) == 5);
+  kfs_clone(kfs_path_lookup(KFS_ROOT, "/f"), kfs_path_lookup(KFS_ROOT, "/g"));
+  assert(kfs_shm_pread(file, buf, sizeof(buf), 0) == 5);
+  assert(memcmp(buf, "clone", 5) == 0);
+
+  // and a removed file is gone once it has been freed
+  assert(kfs_ops.unlink("/f") == 0);
+  kfs_reclaim_drain();
+  assert(kfs_shm_pread(file, buf, sizeof(buf), 0) == -ENOENT);
+  assert(shm_objects() == views);
+
+  kfs_shm_close(file);
+  kfs_shm_disconnect(client);
+  kfs_share_stop();
+  assert(access(socket_path, F_OK) == -1);
+});
+
+// files in a scratch directory live in its region, which is dropped
+// without visiting them; their views must still be retired and freed
+TEST_CASE(test_shm_scratch, {
+  int64_t views = shm_objects();
+  KFS_ShmClient *client = start();
+  KFS_ShmFile *unlinked;
+  KFS_ShmFile *dropped;
+  char buf[16];
+
+  assert(kfs_ops.mkdir("/s", 0755) == 0);
+  assert(kfs_ops.setxattr("/s", "user.kfs.scratch", "1", 1, 0) == 0);
+  assert(kfs_ops.write("/s/a", "aaa", 3, 0, NULL) == 3);
+  assert(kfs_ops.write("/s/b", "bbb", 3, 0, NULL) == 3);
+  assert(kfs_shm_open(client, "/s/a", &unlinked) == 0);
+  assert(kfs_shm_open(client, "/s/b", &dropped) == 0);
+  assert(shm_objects() == views + 2);
+
+  assert(kfs_ops.unlink("/s/a") == 0);
+  kfs_reclaim_drain();
+  assert(shm_objects() == views + 1);
+  assert(kfs_shm_pread(unlinked, buf, sizeof(buf), 0) == -ENOENT);
+  assert(kfs_shm_pread(dropped, buf, sizeof(buf), 0) == 3);
+
+  assert(kfs_ops.setxattr("/", "user.kfs.rmtree", "s", 1, 0) == 0);
+  kfs_reclaim_drain();
+  assert(shm_objects() == views);
+  assert(kfs_shm_pread(dropped, buf, sizeof(buf), 0) == -ENOENT);
+
+  kfs_shm_close(unlinked);
+  kfs_shm_close(dropped);
+  kfs_shm_disconnect(client);
+  kfs_share_stop();
+});
+
+static atomic_bool writing;
+
+// rewrites the whole file with one byte value after another
+static void *rewrite(void *arg) {
+  char *buf = arg;
+  for (int i = 0; atomic_load(&writing); i++) {
+    memset(buf, 'a' + i % 26, BIG_BYTES);
+    kfs_ops.write("/f", buf, BIG_BYTES, 0, NULL);
+  }
+  return NULL;
+}
+
+// a read never sees half of one write and half of another
+TEST_CASE(test_shm_consistency, {
+  KFS_ShmClient *client = start();
+  KFS_ShmFile *file;
+  static char wbuf[BIG_BYTES];
+  static char rbuf[BIG_BYTES];
+
+  memset(wbuf, 'a', sizeof(wbuf));
+  assert(kfs_ops.write("/f", wbuf, BIG_BYTES, 0, NULL) == BIG_BYTES);
+  assert(kfs_shm_open(client, "/f", &file) == 0);
+
+  pthread_t writer;
+  atomic_store(&writing, true);
+  pthread_create(&writer, NULL, rewrite, wbuf);
+  for (int i = 0; i < ROUNDS; i++) {
+    assert(kfs_shm_pread(file, rbuf, BIG_BYTES, 0) == BIG_BYTES);
+    assert(memcmp(rbuf, rbuf + 1, BIG_BYTES - 1) == 0);
+  }
+  atomic_store(&writing, false);
+  pthread_join(writer, NULL);
+
+  kfs_shm_close(file);
+  kfs_shm_disconnect(client);
+  kfs_share_stop();
+});
+
+void shm_test(void) {
+  test_shm_views();
+  test_shm_scratch();
+  test_shm_consistency();
+}
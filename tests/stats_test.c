@@ -0,0 +1,94 @@
+#include "kfs.h"
+#include "tester.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#define RECORDS_PER_THREAD 10000
+
+static void *record_many(void *arg) {
+  uint64_t latency = (uint64_t)(uintptr_t)arg;
+  for (int i = 0; i < RECORDS_PER_THREAD; i++) {
+    kfs_stats_record(KFS_OP_read, kfs_stats_now() - latency, i % 10 ? 0 : -1);
+  }
+  return NULL;
+}
+
+TEST_CASE(test_stats_shards, {
+  kfs_stats_reset();
+  pthread_t threads[4];
+  for (uintptr_t i = 0; i < 4; i++) {
+    // 1us, 2us, 3us, 1ms
+    uintptr_t latency = i < 3 ? (i + 1) * 1000 : 1000000;
+    pthread_create(&threads[i], NULL, record_many, (void *)latency);
+  }
+  for (int i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  KFS_OpStats *st = xmalloc(sizeof(KFS_OpStats));
+  kfs_stats_get(KFS_OP_read, st);
+  assert(st->count == 4 * RECORDS_PER_THREAD);
+  assert(st->errors == 4 * RECORDS_PER_THREAD / 10);
+
+  // buckets are at most 1/16 wide; allow for the clock reads themselves
+  uint64_t p50 = kfs_stats_percentile(st, 0.5);
+  uint64_t p99 = kfs_stats_percentile(st, 0.99);
+  assert(p50 >= 2000 && p50 < 2000 * 17 / 16 + 5000);
+  assert(p99 >= 1000000 && p99 < 1000000 * 17 / 16 + 50000);
+  assert(kfs_stats_percentile(st, 0.0) >= 1000);
+
+  kfs_stats_reset();
+  kfs_stats_get(KFS_OP_read, st);
+  assert(st->count == 0 && kfs_stats_percentile(st, 0.99) == 0);
+  xfree(&st);
+});
+
+static int fill_find(void *buf, const char *name, const struct stat *st,
+                     off_t off) {
+  (void)st;
+  (void)off;
+  if (strcmp(name, KFS_STATS_NAME) == 0) {
+    *(bool *)buf = true;
+  }
+  return 0;
+}
+
+TEST_CASE(test_stats_file, {
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  kfs_stats_reset();
+  struct stat st;
+  assert(kfs_ops.getattr("/nothing", &st) == -ENOENT);
+  assert(kfs_ops.mkdir("/d", 0755) == 0);
+
+  bool listed = false;
+  assert(kfs_ops.readdir("/", &listed, fill_find, 0, NULL) == 0);
+  assert(listed);
+  assert(kfs_ops.getattr(KFS_STATS_DIR, &st) == 0 && S_ISDIR(st.st_mode));
+  assert(kfs_ops.getattr(KFS_STATS_FILE, &st) == 0 && S_ISREG(st.st_mode));
+  assert(kfs_ops.mkdir(KFS_STATS_DIR, 0755) == -EROFS);
+  assert(kfs_ops.rename("/d", KFS_STATS_DIR "/d") == -EROFS);
+
+  struct fuse_file_info fi;
+  memset(&fi, 0, sizeof(fi));
+  fi.flags = O_WRONLY;
+  assert(kfs_ops.open(KFS_STATS_FILE, &fi) == -EROFS);
+  fi.flags = O_RDONLY;
+  assert(kfs_ops.open(KFS_STATS_FILE, &fi) == 0 && fi.direct_io);
+
+  char buf[4096];
+  int n = kfs_ops.read(KFS_STATS_FILE, buf, sizeof(buf) - 1, 0, &fi);
+  assert(n > 0);
+  buf[n] = '\0';
+  assert(strncmp(buf, "op count", 8) == 0);
+  // getattr: one miss plus two lookups in the virtual tree
+  assert(strstr(buf, "\ngetattr 3 1 ") != NULL);
+  assert(strstr(buf, "\nmkdir 2 1 ") != NULL);
+  assert(kfs_ops.release(KFS_STATS_FILE, &fi) == 0);
+});
+
+void stats_test(void) {
+  test_stats_shards();
+  test_stats_file();
+}
@@ -12,7 +12,13 @@ typedef struct {
 #define TESTER_ENTRY(TESTER_NAME)                                              \
   { .tester_name = #TESTER_NAME, .tester_func = TESTER_NAME##_test }
 
-TESTER testers[] = {};
+TESTER testers[] = {TESTER_ENTRY(avl), TESTER_ENTRY(dir), TESTER_ENTRY(walk),
+                     TESTER_ENTRY(usage), TESTER_ENTRY(reclaim),
+                     TESTER_ENTRY(file), TESTER_ENTRY(region),
+                     TESTER_ENTRY(session), TESTER_ENTRY(stats),
+                     TESTER_ENTRY(trace), TESTER_ENTRY(replay),
+                     TESTER_ENTRY(perf), TESTER_ENTRY(alloc),
+                     TESTER_ENTRY(api), TESTER_ENTRY(shm)};
 
 #define ARRAY_LEN(arr) (sizeof(arr) / sizeof(arr[0]))
 
@@ -8,4 +8,20 @@
     printf("[Test - OK] " #test_name "\n");                                    \
   }
 
+void avl_test(void);
+void dir_test(void);
+void walk_test(void);
+void usage_test(void);
+void reclaim_test(void);
+void file_test(void);
+void region_test(void);
+void session_test(void);
+void stats_test(void);
+void trace_test(void);
+void replay_test(void);
+void perf_test(void);
+void alloc_test(void);
+void api_test(void);
+void shm_test(void);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "kfs.h"
+#include "tester.h"
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+
+static uint64_t get_u64(const char *p) {
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--) {
+    v = v << 8 | (unsigned char)p[i];
+  }
+  return v;
+}
+
+// record count of a snapshot; *recs points at the first record
+static uint64_t parse_snapshot(sds snap, const char **recs) {
+  assert(memcmp(snap, KFS_TRACE_MAGIC, 8) == 0);
+  assert(get_u64(snap + 8) > 0);
+  uint64_t nops = get_u64(snap + 16);
+  assert(nops == KFS_OP_COUNT);
+
+  const char *p = snap + 24;
+  for (uint64_t i = 0; i < nops; i++) {
+    p += 1 + (unsigned char)*p;
+  }
+  uint64_t count = get_u64(p);
+  *recs = p + 8;
+  assert((size_t)(*recs - snap) + count * 48 == sdslen(snap));
+  return count;
+}
+
+static void *trace_many(void *arg) {
+  for (int i = 0; i < (intptr_t)arg; i++) {
+    KFS_TraceSpan span;
+    kfs_trace_begin(&span);
+    kfs_trace_end(&span, KFS_OP_read, "/x", i, 1, 0);
+  }
+  return NULL;
+}
+
+TEST_CASE(test_trace_records, {
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  const char *recs;
+  kfs_trace_enable(false);
+  kfs_trace_clear();
+  assert(kfs_ops.mkdir("/d", 0755) == 0);
+  sds snap = kfs_trace_snapshot();
+  assert(parse_snapshot(snap, &recs) == 0);
+  sdsfree(snap);
+
+  kfs_trace_enable(true);
+  assert(kfs_ops.create("/d/f", 0644, NULL) == 0);
+  assert(kfs_ops.write("/d/f", "abcd", 4, 100, NULL) == 4);
+  assert(kfs_ops.unlink("/nothing") == -ENOENT);
+  kfs_trace_enable(false);
+
+  snap = kfs_trace_snapshot();
+  assert(parse_snapshot(snap, &recs) == 3);
+  // a thread's records come out in the order they were taken
+  const char *write = recs + 48;
+  assert(get_u64(write + 8) <= get_u64(write + 16)); // start <= end
+  assert(get_u64(write + 32) == 100);                // offset
+  uint64_t packed = get_u64(write + 40);
+  assert(packed >> 32 == 4 && ((packed >> 16) & 0xffff) == KFS_OP_write);
+  assert((get_u64(recs + 2 * 48 + 40) & 1) == 1); // the failed unlink
+  sdsfree(snap);
+
+  kfs_trace_clear();
+  snap = kfs_trace_snapshot();
+  assert(parse_snapshot(snap, &recs) == 0);
+  sdsfree(snap);
+});
+
+TEST_CASE(test_trace_wraps, {
+  const char *recs;
+  kfs_trace_clear();
+  kfs_trace_enable(true);
+
+  // a lapped ring keeps its newest records
+  trace_many((void *)(intptr_t)(KFS_TRACE_RING * 2 + 5));
+  sds snap = kfs_trace_snapshot();
+  uint64_t n = parse_snapshot(snap, &recs);
+  assert(n >= KFS_TRACE_RING - 1 && n <= KFS_TRACE_RING);
+  assert(get_u64(recs + (n - 1) * 48 + 32) == KFS_TRACE_RING * 2 + 4);
+  sdsfree(snap);
+
+  // snapshots taken while writers run stay well-formed
+  pthread_t threads[3];
+  for (int i = 0; i < 3; i++) {
+    pthread_create(&threads[i], NULL, trace_many, (void *)(intptr_t)100000);
+  }
+  for (int i = 0; i < 20; i++) {
+    snap = kfs_trace_snapshot();
+    parse_snapshot(snap, &recs);
+    sdsfree(snap);
+  }
+  for (int i = 0; i < 3; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  kfs_trace_enable(false);
+  kfs_trace_clear();
+});
+
+void trace_test(void) {
+  test_trace_records();
+  test_trace_wraps();
+}
@@ -0,0 +1,118 @@
+#include "kfs.h"
+#include "tester.h"
+#include <assert.h>
+#include <errno.h>
+
+static KFS_Entry *add_file(KFS_Entry *dir, const char *name, size_t size) {
+  KFS_Entry *file = new_KFS_File(sdsnew(name));
+  kfs_append_child(dir, file);
+  if (size > 0) {
+    char *buf = calloc(size, 1);
+    kfs_write(file, buf, size, 0);
+    free(buf);
+  }
+  return file;
+}
+
+TEST_CASE(test_usage_rollup, {
+  KFS_Entry *root = new_KFS_Dir(sdsnew("/"));
+  KFS_Entry *a = new_KFS_Dir(sdsnew("a"));
+  KFS_Entry *b = new_KFS_Dir(sdsnew("b"));
+  kfs_append_child(root, a);
+  kfs_append_child(a, b);
+
+  add_file(b, "x", 100);
+  add_file(a, "y", 10);
+  kfs_usage_sync(root);
+
+  assert(kfs_usage_get(b).bytes == 100 && kfs_usage_get(b).inodes == 1);
+  assert(kfs_usage_get(a).bytes == 110 && kfs_usage_get(a).inodes == 3);
+  assert(kfs_usage_get(root).bytes == 110 && kfs_usage_get(root).inodes == 4);
+
+  // a batch worth of writes reaches the ancestors without a sync
+  KFS_Entry *big = add_file(b, "big", KFS_USAGE_BATCH_BYTES);
+  assert(kfs_usage_get(root).bytes >= KFS_USAGE_BATCH_BYTES);
+
+  // removing a subtree takes everything below it along
+  kfs_remove_child(root, sdsnew("a"));
+  assert(kfs_usage_get(root).bytes == 0 && kfs_usage_get(root).inodes == 0);
+  assert(kfs_usage_get(a).bytes == 110 + big->size);
+
+  // and moving it back in restores the totals
+  kfs_append_child(root, a);
+  assert(kfs_usage_get(root).inodes == 5);
+});
+
+TEST_CASE(test_usage_quota, {
+  KFS_Entry *root = new_KFS_Dir(sdsnew("/"));
+  KFS_Entry *q = new_KFS_Dir(sdsnew("q"));
+  KFS_Entry *sub = new_KFS_Dir(sdsnew("sub"));
+  kfs_append_child(root, q);
+  kfs_append_child(q, sub);
+  kfs_usage_set_quota(q, 1000, 3);
+
+  add_file(sub, "f", 900);
+  assert(kfs_usage_check(sub, 100, 0) == 0);
+  assert(kfs_usage_check(sub, 101, 0) == -EDQUOT);
+  assert(kfs_usage_check(root, 1 << 30, 0) == 0);
+
+  assert(kfs_usage_check(sub, 0, 1) == 0);
+  add_file(sub, "g", 0);
+  assert(kfs_usage_check(sub, 0, 1) == -EDQUOT);
+
+  kfs_usage_set_quota(q, 0, 0);
+  assert(kfs_usage_check(sub, 1 << 30, 100) == 0);
+});
+
+// freeing a directory drops its quota, including one in a scratch region
+TEST_CASE(test_usage_quota_freed, {
+  int quotas = kfs_usage_quota_dirs();
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  assert(itf_fuse_kfs_mkdir("/q", 0755) == 0);
+  assert(itf_fuse_kfs_mkdir("/s", 0755) == 0);
+  assert(itf_fuse_kfs_setxattr("/s", "user.kfs.scratch", "1", 1, 0) == 0);
+  assert(itf_fuse_kfs_mkdir("/s/q", 0755) == 0);
+  assert(itf_fuse_kfs_setxattr("/q", "user.kfs.quota.bytes", "100", 3, 0) ==
+         0);
+  assert(itf_fuse_kfs_setxattr("/s/q", "user.kfs.quota.inodes", "5", 1, 0) ==
+         0);
+  assert(kfs_usage_quota_dirs() == quotas + 2);
+
+  assert(itf_fuse_kfs_rmdir("/q") == 0);
+  kfs_reclaim_drain();
+  assert(kfs_usage_quota_dirs() == quotas + 1);
+  assert(itf_fuse_kfs_setxattr("/", "user.kfs.rmtree", "s", 1, 0) == 0);
+  kfs_reclaim_drain();
+  assert(kfs_usage_quota_dirs() == quotas);
+});
+
+TEST_CASE(test_usage_quota_xattr, {
+  int64_t limit;
+  assert(kfs_usage_parse_quota("4096", &limit) && limit == 4096);
+  assert(kfs_usage_parse_quota("0", &limit) && limit == 0);
+  assert(!kfs_usage_parse_quota("", &limit));
+  assert(!kfs_usage_parse_quota("abc", &limit));
+  assert(!kfs_usage_parse_quota("12k", &limit));
+  assert(!kfs_usage_parse_quota("-1", &limit));
+  assert(!kfs_usage_parse_quota("99999999999999999999", &limit));
+
+  // a bad value leaves the quota as it was
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  assert(itf_fuse_kfs_mkdir("/q", 0755) == 0);
+  assert(itf_fuse_kfs_setxattr("/q", "user.kfs.quota.bytes", "100", 3, 0) ==
+         0);
+  assert(itf_fuse_kfs_setxattr("/q", "user.kfs.quota.bytes", "abc", 3, 0) ==
+         -EINVAL);
+  assert(itf_fuse_kfs_setxattr("/q", "user.kfs.quota.bytes", "-5", 2, 0) ==
+         -EINVAL);
+  KFS_Entry *q = kfs_find(KFS_ROOT, sdsnew("/q"));
+  assert(q->usage.quota_bytes == 100);
+  assert(itf_fuse_kfs_setxattr("/q", "user.kfs.quota.bytes", "0", 1, 0) == 0);
+});
+
+void usage_test(void) {
+  test_usage_rollup();
+  test_usage_quota();
+  test_usage_quota_freed();
+  test_usage_quota_xattr();
+}
@@ -0,0 +1,70 @@
+#include "kfs.h"
+#include "tester.h"
+#include <assert.h>
+#include <stdatomic.h>
+
+// /d0 .. /d3, each with f0 .. f9 and a subdirectory s holding one file
+static KFS_Entry *make_tree(void) {
+  KFS_Entry *root = new_KFS_Dir(sdsnew("/"));
+
+  for (int i = 0; i < 4; i++) {
+    KFS_Entry *d = new_KFS_Dir(sdscatprintf(sdsempty(), "d%d", i));
+    kfs_append_child(root, d);
+    for (int j = 0; j < 10; j++) {
+      kfs_append_child(d, new_KFS_File(sdscatprintf(sdsempty(), "f%d", j)));
+    }
+    KFS_Entry *s = new_KFS_Dir(sdsnew("s"));
+    kfs_append_child(d, s);
+    kfs_append_child(s, new_KFS_File(sdsnew("x")));
+  }
+
+  return root;
+}
+
+typedef struct {
+  KFS_Entry *root;
+  atomic_size_t count;
+} CountCtx;
+
+static bool count_visit(KFS_WalkEntry *we, void *p) {
+  CountCtx *ctx = p;
+  atomic_fetch_add(&ctx->count, 1);
+
+  // the path handed out must lead back to the entry
+  sds path = sdsnew(we->path);
+  assert(kfs_find(ctx->root, path) == we->entry);
+  sdsfree(path);
+  return true;
+}
+
+TEST_CASE(test_walk_parallel, {
+  CountCtx ctx = {.root = make_tree()};
+  atomic_init(&ctx.count, 0);
+
+  kfs_walk(ctx.root, "/", 4, 0, count_visit, &ctx);
+  // root + 4 * (d + 10 files + s + x)
+  assert(atomic_load(&ctx.count) == 1 + 4 * 13);
+});
+
+static bool skip_s(KFS_WalkEntry *we, void *ctx) {
+  vec_push((Vector *)ctx, sdsnew(we->path));
+  return strcmp(we->entry->name, "s") != 0;
+}
+
+TEST_CASE(test_walk_sorted_prune, {
+  KFS_Entry *root = make_tree();
+  Vector *paths = new_vec();
+
+  kfs_walk(root, "/", 0, KFS_WALK_SORTED, skip_s, paths);
+  assert(paths->len == 1 + 4 * 12);
+  assert(strcmp(paths->data[0], "/") == 0);
+  assert(strcmp(paths->data[1], "/d0") == 0);
+  assert(strcmp(paths->data[2], "/d0/f0") == 0);
+  assert(strcmp(paths->data[12], "/d0/s") == 0);
+  assert(strcmp(paths->data[13], "/d1") == 0);
+});
+
+void walk_test(void) {
+  test_walk_parallel();
+  test_walk_sorted_prune();
+}
@@ -0,0 +1,40 @@
+#!/bin/sh
+# conn_bench.sh [SIZE_MB] [BLOCK]
+#
+# Sequential write/read throughput of a KFS mount with the negotiated
+# connection parameters against libfuse's defaults (-o kfs_stock_conn).
+# Expects generated/kfs (make all) and fusermount in PATH.
+
+set -eu
+
+SIZE_MB=${1:-256}
+BLOCK=${2:-1M}
+KFS=${KFS:-generated/kfs}
+MNT=$(mktemp -d)
+
+cleanup() {
+  fusermount -u "$MNT" 2>/dev/null || true
+  rmdir "$MNT"
+}
+trap cleanup EXIT
+
+# MB/s reported by dd's summary line
+rate() {
+  dd "$@" 2>&1 | awk '/copied/ { printf "%.1f", ($1 / 1048576) / $(NF - 3) }'
+}
+
+run() {
+  label=$1
+  shift
+  "$KFS" "$MNT" "$@"
+  count=$(($SIZE_MB * 1048576 / $(numfmt --from=iec "$BLOCK")))
+
+  w=$(rate if=/dev/zero of="$MNT/data" bs="$BLOCK" count="$count")
+  r=$(rate if="$MNT/data" of=/dev/null bs="$BLOCK")
+  printf '%-10s write %8s MB/s   read %8s MB/s\n' "$label" "$w" "$r"
+
+  fusermount -u "$MNT"
+}
+
+run stock -o kfs_stock_conn
+run kfs
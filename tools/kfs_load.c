@@ -0,0 +1,450 @@
+/*
+  kfs_load [-w WORKLOAD[,WORKLOAD...]] [-t THREADS] [-d SECONDS] [-p]
+           [-D DEPTH] [-F FANOUT] [-f FILES] [-s SIZES] [-e ENTRIES]
+
+  End-to-end load without a mount: THREADS threads (default: online CPUs)
+  drive kfs_ops, the same namespace-locked, timed callbacks libfuse calls,
+  against an in-process KFS for SECONDS (default 5) per workload:
+
+    meta       create / stat / chmod / rename / unlink storm spread over
+               the synthetic namespace, with lookups of existing files
+    smallfile  create, write, read back and unlink files of SIZES bytes
+               in a directory per thread
+    seqwrite   128 KiB sequential writes, a file per thread, restarting
+               at 64 MiB
+    randread   4 KiB reads at random offsets of random namespace files
+    readdir    full listings of a shared directory of ENTRIES entries
+
+  The default is all of them, in that order.  The synthetic namespace
+  under /ns is DEPTH levels of FANOUT directories (default 3 and 8) with
+  FILES files in each leaf directory (default 16), sized from SIZES:
+  N for a fixed size, MIN-MAX for uniform, exp:MEAN for exponential
+  (default 0-16384).
+
+  Each run prints the total ops/s, the per-operation counts and latency
+  percentiles kept by stats.c, and the peak RSS during the run.  -p adds
+  the per-operation hardware counter averages (see perf.h).
+*/
+#include "kfs.h"
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define MIB (1024L * 1024)
+#define SEQ_WRITE (128 * 1024)
+#define SEQ_LIMIT (64 * MIB)
+#define RAND_READ 4096
+#define SMALL_MAX (1 * MIB)
+
+typedef struct {
+  int depth;
+  int fanout;
+  int files;
+  int entries;
+  char size_kind; // 'f'ixed, 'u'niform or 'e'xponential
+  double size_a;
+  double size_b;
+} NamespaceOpts;
+
+static NamespaceOpts ns = {3, 8, 16, 100000, 'u', 0, 16384};
+static Vector *ns_dirs;  // sds paths of every generated directory
+static Vector *ns_files; // sds paths of every generated file
+static atomic_bool stop;
+
+typedef struct Worker {
+  pthread_t thread;
+  int id;
+  uint64_t rng;
+  void (*workload)(struct Worker *);
+  char *buf;
+} Worker;
+
+// xorshift64*, one per thread
+static uint64_t next_rand(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 2685821657736338717ULL;
+}
+
+static size_t pick(Worker *w, size_t n) { return next_rand(&w->rng) % n; }
+
+static size_t file_size(uint64_t *rng) {
+  double u = (next_rand(rng) >> 11) * (1.0 / (1ULL << 53));
+  switch (ns.size_kind) {
+  case 'u':
+    return ns.size_a + u * (ns.size_b - ns.size_a);
+  case 'e':
+    return -log(1 - u) * ns.size_a;
+  default:
+    return ns.size_a;
+  }
+}
+
+static int parse_sizes(const char *spec) {
+  char *end;
+  if (strncmp(spec, "exp:", 4) == 0) {
+    ns.size_kind = 'e';
+    ns.size_a = strtod(spec + 4, &end);
+  } else {
+    ns.size_a = strtod(spec, &end);
+    ns.size_kind = 'f';
+    if (*end == '-') {
+      ns.size_kind = 'u';
+      ns.size_b = strtod(end + 1, &end);
+    }
+  }
+  return *end == '\0' && ns.size_a >= 0 ? 0 : -1;
+}
+
+static void write_zeros(const char *path, size_t size, off_t offset) {
+  static char zeros[SEQ_WRITE];
+  while (size > 0) {
+    size_t n = size < sizeof(zeros) ? size : sizeof(zeros);
+    kfs_ops.write(path, zeros, n, offset, NULL);
+    size -= n;
+    offset += n;
+  }
+}
+
+static void generate(sds dir, int level, uint64_t *rng) {
+  vec_push(ns_dirs, dir);
+  if (level == ns.depth) {
+    for (int i = 0; i < ns.files; i++) {
+      sds path = sdscatprintf(sdsempty(), "%s/f%d", dir, i);
+      kfs_ops.create(path, 0644, NULL);
+      write_zeros(path, file_size(rng), 0);
+      vec_push(ns_files, path);
+    }
+    return;
+  }
+  for (int i = 0; i < ns.fanout; i++) {
+    sds sub = sdscatprintf(sdsempty(), "%s/d%d", dir, i);
+    kfs_ops.mkdir(sub, 0755);
+    generate(sub, level + 1, rng);
+  }
+}
+
+static void generate_namespace(void) {
+  uint64_t rng = 42;
+  ns_dirs = new_vec();
+  ns_files = new_vec();
+  kfs_ops.mkdir("/ns", 0755);
+  generate(sdsnew("/ns"), 0, &rng);
+
+  kfs_ops.mkdir("/load", 0755);
+  kfs_ops.mkdir("/load/huge", 0755);
+  char path[64];
+  for (int i = 0; i < ns.entries; i++) {
+    snprintf(path, sizeof(path), "/load/huge/e%08d", i);
+    kfs_ops.create(path, 0644, NULL);
+  }
+}
+
+static void meta(Worker *w) {
+  char path[4200], to[4300];
+  struct stat st;
+  for (unsigned long i = 0; !atomic_load(&stop); i++) {
+    sds dir = ns_dirs->data[pick(w, ns_dirs->len)];
+    snprintf(path, sizeof(path), "%s/m%d.%lu", dir, w->id, i % 64);
+    snprintf(to, sizeof(to), "%s.r", path);
+
+    kfs_ops.create(path, 0644, NULL);
+    kfs_ops.getattr(path, &st);
+    kfs_ops.chmod(path, 0600);
+    kfs_ops.rename(path, to);
+    kfs_ops.getattr(ns_files->data[pick(w, ns_files->len)], &st);
+    kfs_ops.unlink(to);
+  }
+}
+
+static void smallfile(Worker *w) {
+  char path[64];
+  struct fuse_file_info fi;
+  memset(&fi, 0, sizeof(fi));
+  for (unsigned long i = 0; !atomic_load(&stop); i++) {
+    snprintf(path, sizeof(path), "/load/t%d/f%lu", w->id, i % 256);
+    size_t size = file_size(&w->rng);
+    size = size < SMALL_MAX ? size : SMALL_MAX;
+
+    kfs_ops.create(path, 0644, &fi);
+    kfs_ops.write(path, w->buf, size, 0, &fi);
+    kfs_ops.release(path, &fi);
+    kfs_ops.open(path, &fi);
+    kfs_ops.read(path, w->buf, size, 0, &fi);
+    kfs_ops.release(path, &fi);
+    kfs_ops.unlink(path);
+  }
+}
+
+static void seqwrite(Worker *w) {
+  char path[64];
+  snprintf(path, sizeof(path), "/load/seq%d", w->id);
+  kfs_ops.create(path, 0644, NULL);
+  for (off_t off = 0; !atomic_load(&stop); off += SEQ_WRITE) {
+    if (off == SEQ_LIMIT) {
+      kfs_ops.truncate(path, 0);
+      off = 0;
+    }
+    kfs_ops.write(path, w->buf, SEQ_WRITE, off, NULL);
+  }
+  kfs_ops.unlink(path);
+}
+
+static void randread(Worker *w) {
+  struct stat st;
+  while (!atomic_load(&stop)) {
+    sds path = ns_files->data[pick(w, ns_files->len)];
+    kfs_ops.getattr(path, &st);
+    off_t blocks = st.st_size / RAND_READ;
+    off_t off = blocks > 0 ? (off_t)pick(w, blocks) * RAND_READ : 0;
+    kfs_ops.read(path, w->buf, RAND_READ, off, NULL);
+  }
+}
+
+static int count_entry(void *buf, const char *name, const struct stat *st,
+                       off_t off) {
+  (void)name;
+  (void)st;
+  (void)off;
+  (*(size_t *)buf)++;
+  return 0;
+}
+
+static void readdir_huge(Worker *w) {
+  (void)w;
+  struct fuse_file_info fi;
+  memset(&fi, 0, sizeof(fi));
+  while (!atomic_load(&stop)) {
+    size_t n = 0;
+    kfs_ops.readdir("/load/huge", &n, count_entry, 0, &fi);
+  }
+}
+
+static const struct {
+  const char *name;
+  void (*run)(Worker *);
+} workloads[] = {
+    {"meta", meta},         {"smallfile", smallfile}, {"seqwrite", seqwrite},
+    {"randread", randread}, {"readdir", readdir_huge},
+};
+
+#define WORKLOAD_COUNT (sizeof(workloads) / sizeof(workloads[0]))
+
+static void *worker_main(void *arg) {
+  Worker *w = arg;
+  w->workload(w);
+  return NULL;
+}
+
+// peak RSS in KiB since the last reset; the reset needs Linux 4.0
+static long peak_rss(void) {
+  FILE *fp = fopen("/proc/self/status", "r");
+  char line[256];
+  long kib = -1;
+  while (fp != NULL && fgets(line, sizeof(line), fp) != NULL) {
+    if (sscanf(line, "VmHWM: %ld kB", &kib) == 1) {
+      break;
+    }
+  }
+  if (fp != NULL) {
+    fclose(fp);
+  }
+  if (kib == -1) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    kib = ru.ru_maxrss;
+  }
+  return kib;
+}
+
+static void reset_peak_rss(void) {
+  FILE *fp = fopen("/proc/self/clear_refs", "w");
+  if (fp != NULL) {
+    fputs("5", fp);
+    fclose(fp);
+  }
+}
+
+// the lines of kfs_perf_render for operations that ran
+static void print_perf(void) {
+  sds text = kfs_perf_render();
+  int count = 0;
+  char *save;
+  for (char *line = strtok_r(text, "\n", &save); line != NULL;
+       line = strtok_r(NULL, "\n", &save)) {
+    if (sscanf(line, "%*s %d", &count) != 1 || count > 0) {
+      printf("%s\n", line);
+    }
+  }
+  sdsfree(text);
+}
+
+static void run(int workload, int nthreads, double seconds) {
+  Worker *workers = xmalloc(sizeof(Worker) * nthreads);
+  char dir[64];
+
+  for (int i = 0; i < nthreads; i++) {
+    snprintf(dir, sizeof(dir), "/load/t%d", i);
+    kfs_ops.mkdir(dir, 0755);
+  }
+  kfs_reclaim_drain();
+  reset_peak_rss();
+  kfs_stats_reset();
+  kfs_perf_reset();
+  atomic_store(&stop, false);
+
+  uint64_t start = kfs_stats_now();
+  for (int i = 0; i < nthreads; i++) {
+    workers[i].id = i;
+    workers[i].rng = 0x9e3779b97f4a7c15ULL * (i + 1);
+    workers[i].workload = workloads[workload].run;
+    workers[i].buf = xmalloc(SMALL_MAX);
+    memset(workers[i].buf, 0x5a, SMALL_MAX);
+    pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+  }
+  usleep(seconds * 1e6);
+  atomic_store(&stop, true);
+  for (int i = 0; i < nthreads; i++) {
+    pthread_join(workers[i].thread, NULL);
+    free(workers[i].buf);
+  }
+  double elapsed = (kfs_stats_now() - start) / 1e9;
+
+  KFS_OpStats *stats = xmalloc(sizeof(KFS_OpStats));
+  uint64_t total = 0;
+  for (int op = 0; op < KFS_OP_COUNT; op++) {
+    kfs_stats_get(op, stats);
+    total += stats->count;
+  }
+
+  printf("== %s: %d threads, %.1f s\n", workloads[workload].name, nthreads,
+         elapsed);
+  printf("%.0f ops/s, %llu ops, peak RSS %.1f MiB\n", total / elapsed,
+         (unsigned long long)total, peak_rss() / 1024.0);
+  printf("%-9s %10s %10s %7s %9s %9s %9s %9s\n", "op", "count", "ops/s",
+         "errors", "p50_us", "p99_us", "p999_us", "max_us");
+  for (int op = 0; op < KFS_OP_COUNT; op++) {
+    kfs_stats_get(op, stats);
+    if (stats->count == 0) {
+      continue;
+    }
+    printf("%-9s %10llu %10.0f %7llu %9.1f %9.1f %9.1f %9.1f\n",
+           kfs_stats_op_name(op), (unsigned long long)stats->count,
+           stats->count / elapsed, (unsigned long long)stats->errors,
+           kfs_stats_percentile(stats, 0.5) / 1e3,
+           kfs_stats_percentile(stats, 0.99) / 1e3,
+           kfs_stats_percentile(stats, 0.999) / 1e3,
+           kfs_stats_percentile(stats, 1.0) / 1e3);
+  }
+  if (atomic_load(&kfs_perf_on)) {
+    print_perf();
+  }
+  printf("\n");
+  fflush(stdout);
+  free(stats);
+  free(workers);
+}
+
+static int usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-w WORKLOAD[,WORKLOAD...]] [-t THREADS] [-d SECONDS] "
+          "[-p]\n"
+          "       [-D DEPTH] [-F FANOUT] [-f FILES] [-s SIZES] [-e ENTRIES]\n"
+          "workloads:",
+          prog);
+  for (size_t i = 0; i < WORKLOAD_COUNT; i++) {
+    fprintf(stderr, " %s", workloads[i].name);
+  }
+  fprintf(stderr, "\n");
+  return 2;
+}
+
+int main(int argc, char *argv[]) {
+  bool selected[WORKLOAD_COUNT] = {0};
+  bool any = false;
+  int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  double seconds = 5;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "w:t:d:pD:F:f:s:e:")) != -1) {
+    switch (opt) {
+    case 'w':
+      for (char *name = strtok(optarg, ","); name != NULL;
+           name = strtok(NULL, ",")) {
+        size_t i = 0;
+        while (i < WORKLOAD_COUNT && strcmp(workloads[i].name, name) != 0) {
+          i++;
+        }
+        if (i == WORKLOAD_COUNT) {
+          return usage(argv[0]);
+        }
+        selected[i] = any = true;
+      }
+      break;
+    case 't':
+      nthreads = atoi(optarg);
+      break;
+    case 'd':
+      seconds = atof(optarg);
+      break;
+    case 'p':
+      if (!kfs_perf_enable(true)) {
+        fprintf(stderr, "%s: hardware counters are not available\n",
+                argv[0]);
+        return 1;
+      }
+      break;
+    case 'D':
+      ns.depth = atoi(optarg);
+      break;
+    case 'F':
+      ns.fanout = atoi(optarg);
+      break;
+    case 'f':
+      ns.files = atoi(optarg);
+      break;
+    case 's':
+      if (parse_sizes(optarg) == -1) {
+        return usage(argv[0]);
+      }
+      break;
+    case 'e':
+      ns.entries = atoi(optarg);
+      break;
+    default:
+      return usage(argv[0]);
+    }
+  }
+  if (optind != argc || nthreads < 1 || seconds <= 0 || ns.depth < 0 ||
+      ns.fanout < 1 || ns.files < 1 || ns.entries < 0) {
+    return usage(argv[0]);
+  }
+
+  struct fuse_conn_info conn;
+  memset(&conn, 0, sizeof(conn));
+  KFS_ROOT = new_KFS_Dir(sdsnew("/"));
+  kfs_ops.init(&conn);
+
+  uint64_t start = kfs_stats_now();
+  generate_namespace();
+  printf("namespace: %zu directories, %zu files, %d-entry directory in "
+         "%.1f s, RSS %.1f MiB\n\n",
+         ns_dirs->len, ns_files->len, ns.entries,
+         (kfs_stats_now() - start) / 1e9, peak_rss() / 1024.0);
+
+  for (size_t i = 0; i < WORKLOAD_COUNT; i++) {
+    if (!any || selected[i]) {
+      run(i, nthreads, seconds);
+    }
+  }
+
+  kfs_ops.destroy(NULL);
+  return 0;
+}
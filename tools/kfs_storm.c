@@ -0,0 +1,142 @@
+/*
+  kfs_storm MOUNTPOINT [CLIENTS] [SECONDS]
+
+  Metadata storm against a mounted file system: CLIENTS threads (default 64)
+  each loop create / stat / unlink on files in their own directory for
+  SECONDS (default 10), then per-operation latency percentiles are printed.
+  Only depends on libc, so it can be pointed at tmpfs as well.
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+enum { OP_CREATE, OP_STAT, OP_UNLINK, OP_COUNT };
+static const char *op_names[OP_COUNT] = {"create", "stat", "unlink"};
+
+#define MAX_SAMPLES (1 << 20)
+
+typedef struct {
+  pthread_t thread;
+  int id;
+  const char *root;
+  double *samples[OP_COUNT]; // latencies in us
+  size_t count[OP_COUNT];
+  long errors;
+} Client;
+
+static volatile int stop;
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void record(Client *c, int op, double t) {
+  if (c->count[op] < MAX_SAMPLES) {
+    c->samples[op][c->count[op]++] = now_us() - t;
+  }
+}
+
+static void *client_main(void *arg) {
+  Client *c = arg;
+  char dir[4096], path[4200];
+  snprintf(dir, sizeof(dir), "%s/storm.%d", c->root, c->id);
+  if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+    perror(dir);
+    return NULL;
+  }
+
+  for (long i = 0; !stop; i++) {
+    snprintf(path, sizeof(path), "%s/f%ld", dir, i % 64);
+    struct stat st;
+
+    double t = now_us();
+    int fd = open(path, O_CREAT | O_WRONLY, 0644);
+    record(c, OP_CREATE, t);
+    if (fd == -1) {
+      c->errors++;
+      continue;
+    }
+    close(fd);
+
+    t = now_us();
+    c->errors += stat(path, &st) == -1;
+    record(c, OP_STAT, t);
+
+    t = now_us();
+    c->errors += unlink(path) == -1;
+    record(c, OP_UNLINK, t);
+  }
+
+  rmdir(dir);
+  return NULL;
+}
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s MOUNTPOINT [CLIENTS] [SECONDS]\n", argv[0]);
+    return 1;
+  }
+  int nclients = argc > 2 ? atoi(argv[2]) : 64;
+  int seconds = argc > 3 ? atoi(argv[3]) : 10;
+
+  Client *clients = calloc(nclients, sizeof(Client));
+  for (int i = 0; i < nclients; i++) {
+    clients[i].id = i;
+    clients[i].root = argv[1];
+    for (int op = 0; op < OP_COUNT; op++) {
+      clients[i].samples[op] = malloc(sizeof(double) * MAX_SAMPLES);
+    }
+    pthread_create(&clients[i].thread, NULL, client_main, &clients[i]);
+  }
+
+  sleep(seconds);
+  stop = 1;
+
+  long errors = 0;
+  for (int i = 0; i < nclients; i++) {
+    pthread_join(clients[i].thread, NULL);
+    errors += clients[i].errors;
+  }
+
+  printf("%-8s %10s %10s %9s %9s %9s %9s\n", "op", "ops", "ops/s", "p50us",
+         "p99us", "p999us", "maxus");
+  for (int op = 0; op < OP_COUNT; op++) {
+    size_t n = 0;
+    for (int i = 0; i < nclients; i++) {
+      n += clients[i].count[op];
+    }
+
+    double *all = malloc(sizeof(double) * (n ? n : 1));
+    size_t k = 0;
+    for (int i = 0; i < nclients; i++) {
+      memcpy(all + k, clients[i].samples[op],
+             sizeof(double) * clients[i].count[op]);
+      k += clients[i].count[op];
+    }
+    qsort(all, n, sizeof(double), cmp_double);
+
+#define PCT(p) (n ? all[(size_t)((n - 1) * (p))] : 0)
+    printf("%-8s %10zu %10.0f %9.1f %9.1f %9.1f %9.1f\n", op_names[op], n,
+           n / (double)seconds, PCT(0.5), PCT(0.99), PCT(0.999), PCT(1.0));
+#undef PCT
+    free(all);
+  }
+  if (errors > 0) {
+    printf("errors: %ld\n", errors);
+  }
+
+  return 0;
+}
@@ -0,0 +1,95 @@
+/*
+  kfs_trace2json [TRACE]
+
+  Converts a KFS trace snapshot (MOUNTPOINT/.kfs/trace, or the shell's
+  "trace dump FILE") read from TRACE or stdin into Chrome trace JSON on
+  stdout, for chrome://tracing or ui.perfetto.dev.  Each record becomes a
+  complete event on its thread's track; see trace.h for the layout.
+*/
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAGIC "KFSTRC01"
+#define RECORD_WORDS 6 // tid, start, end, ino, offset, size/op/failed
+
+static int get_u64(FILE *fp, uint64_t *v) {
+  unsigned char b[8];
+  if (fread(b, 1, sizeof(b), fp) != sizeof(b)) {
+    return -1;
+  }
+  *v = 0;
+  for (int i = 7; i >= 0; i--) {
+    *v = *v << 8 | b[i];
+  }
+  return 0;
+}
+
+static int fail(const char *what) {
+  fprintf(stderr, "kfs_trace2json: %s\n", what);
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  FILE *fp = argc > 1 ? fopen(argv[1], "rb") : stdin;
+  if (fp == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  char magic[8];
+  uint64_t hz, nops, count;
+  if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+      memcmp(magic, MAGIC, sizeof(magic)) != 0) {
+    return fail("not a KFS trace");
+  }
+  if (get_u64(fp, &hz) != 0 || hz == 0 || get_u64(fp, &nops) != 0) {
+    return fail("truncated header");
+  }
+
+  char **names = calloc(nops, sizeof(char *));
+  for (uint64_t i = 0; i < nops; i++) {
+    int len = fgetc(fp);
+    if (len == EOF || (names[i] = calloc(len + 1, 1)) == NULL ||
+        fread(names[i], 1, len, fp) != (size_t)len) {
+      return fail("truncated op names");
+    }
+  }
+  if (get_u64(fp, &count) != 0) {
+    return fail("truncated header");
+  }
+
+  // timestamps relative to the earliest record, in microseconds
+  uint64_t(*recs)[RECORD_WORDS] = malloc(sizeof(*recs) * (count + 1));
+  uint64_t base = UINT64_MAX;
+  for (uint64_t i = 0; i < count; i++) {
+    for (int j = 0; j < RECORD_WORDS; j++) {
+      if (get_u64(fp, &recs[i][j]) != 0) {
+        return fail("truncated records");
+      }
+    }
+    if (recs[i][1] < base) {
+      base = recs[i][1];
+    }
+  }
+
+  printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  for (uint64_t i = 0; i < count; i++) {
+    uint64_t *r = recs[i];
+    uint64_t op = (r[5] >> 16) & 0xffff;
+    double ts = (double)(r[1] - base) * 1e6 / hz;
+    double dur = (double)(r[2] - r[1]) * 1e6 / hz;
+
+    printf("%s\n{\"name\":\"%s\",\"cat\":\"kfs\",\"ph\":\"X\",\"pid\":1,"
+           "\"tid\":%" PRIu64 ",\"ts\":%.3f,\"dur\":%.3f,\"args\":{"
+           "\"ino\":\"%016" PRIx64 "\",\"offset\":%" PRId64
+           ",\"size\":%" PRIu64 ",\"failed\":%s}}",
+           i == 0 ? "" : ",", op < nops ? names[op] : "?", r[0], ts, dur,
+           r[3], (int64_t)r[4], r[5] >> 32, r[5] & 1 ? "true" : "false");
+  }
+  printf("\n]}\n");
+
+  return 0;
+}
@@ -0,0 +1,167 @@
+#!/bin/sh
+# tmpfs_bench.sh [SIZE_MB] [SECONDS]
+#
+# Runs the same workloads against a fresh KFS mount and a tmpfs directory
+# and prints them side by side:
+#   - sequential 1 MiB and random 4 KiB write/read of a SIZE_MB file (fio
+#     when installed, dd otherwise; random I/O needs fio)
+#   - kfs_storm create/stat/unlink for SECONDS
+#   - tar extraction of a source tree (SRC, default this repository)
+#   - parallel find over the extracted tree
+#   - memory per stored byte: the daemon's RSS for KFS, the growth of Shmem
+#     for tmpfs, over what du reports as stored
+#
+# Expects generated/kfs (make all), generated/kfs_storm (make tools) and
+# fusermount in PATH.  TMPFS selects the tmpfs directory (default
+# /dev/shm); KFS_DIR=DIR with KFS_PID=PID measures an existing mount
+# instead of starting one.
+
+set -eu
+
+SIZE_MB=${1:-256}
+SECONDS_=${2:-5}
+KFS=${KFS:-generated/kfs}
+STORM=${STORM:-generated/kfs_storm}
+SRC=${SRC:-.}
+CLIENTS=${CLIENTS:-16}
+FINDS=${FINDS:-8}
+TMPFS=${TMPFS:-/dev/shm}
+
+WORK=$(mktemp -d)
+TMPDIR_=$(mktemp -d "$TMPFS/kfs_bench.XXXXXX")
+MNT=
+KFS_PID=${KFS_PID:-}
+
+cleanup() {
+  if [ -n "$MNT" ]; then
+    fusermount -u "$MNT" 2>/dev/null || true
+    rmdir "$MNT"
+  fi
+  rm -rf "$WORK" "$TMPDIR_"
+}
+trap cleanup EXIT
+
+tar -cf "$WORK/src.tar" -C "$SRC" --exclude=.git --exclude=generated .
+
+now() { date +%s.%N; }
+elapsed() { echo "$(now) $1" | awk '{ printf "%.3f", $1 - $2 }'; }
+
+# MB/s reported by dd's summary line
+dd_rate() {
+  dd "$@" 2>&1 | awk '/copied/ { printf "%.1f", ($1 / 1048576) / $(NF - 3) }'
+}
+
+# fio job on file $1: prints "MB/s p99_us" of whichever direction ran; the
+# JSON lists read before write, each with its bw (KiB/s) and clat
+# percentiles (ns)
+fio_job() {
+  file=$1
+  shift
+  fio --name=job --filename="$file" --size="${SIZE_MB}M" --ioengine=psync \
+    --output-format=json "$@" 2>/dev/null |
+    awk -F'[:,]' '
+      /"bw" :/ { bw[++nbw] = $2 + 0 }
+      /"99.000000" :/ { p99[++np] = $2 + 0 }
+      END {
+        i = bw[1] > 0 ? 1 : 2
+        printf "%.1f %.1f", bw[i] / 1024, p99[i] / 1000
+      }'
+}
+
+# memory in KiB that the target currently spends
+memory() {
+  if [ "$1" = kfs ]; then
+    if [ -n "$KFS_PID" ]; then
+      awk '/^VmRSS:/ { print $2 }' "/proc/$KFS_PID/status"
+    else
+      echo 0
+    fi
+  else
+    awk '/^Shmem:/ { print $2 }' /proc/meminfo
+  fi
+}
+
+# runs every workload in $2, writing "key value" lines for target $1
+workloads() {
+  target=$1
+  dir=$2
+  out=$WORK/$target.txt
+  : >"$out"
+  base=$(memory "$target")
+
+  if command -v fio >/dev/null; then
+    set -- $(fio_job "$dir/seq" --rw=write --bs=1M)
+    echo "seq_write_MBps $1" >>"$out"
+    set -- $(fio_job "$dir/seq" --rw=read --bs=1M)
+    echo "seq_read_MBps $1" >>"$out"
+    set -- $(fio_job "$dir/seq" --rw=randwrite --bs=4k)
+    echo "rand_write_MBps $1" >>"$out"
+    echo "rand_write_p99_us $2" >>"$out"
+    set -- $(fio_job "$dir/seq" --rw=randread --bs=4k)
+    echo "rand_read_MBps $1" >>"$out"
+    echo "rand_read_p99_us $2" >>"$out"
+  else
+    echo "seq_write_MBps $(dd_rate if=/dev/zero of="$dir/seq" bs=1M \
+      count="$SIZE_MB")" >>"$out"
+    echo "seq_read_MBps $(dd_rate if="$dir/seq" of=/dev/null bs=1M)" >>"$out"
+  fi
+
+  "$STORM" "$dir" "$CLIENTS" "$SECONDS_" >"$WORK/storm.txt"
+  awk '$1 == "create" || $1 == "stat" || $1 == "unlink" {
+         printf "storm_%s_ops %s\nstorm_%s_p99_us %s\n", $1, $3, $1, $5
+       }' "$WORK/storm.txt" >>"$out"
+
+  mkdir "$dir/tree"
+  t=$(now)
+  tar -xf "$WORK/src.tar" -C "$dir/tree"
+  echo "tar_extract_s $(elapsed "$t")" >>"$out"
+
+  t=$(now)
+  i=0
+  while [ "$i" -lt "$FINDS" ]; do
+    find "$dir/tree" -type f >/dev/null &
+    i=$((i + 1))
+  done
+  wait
+  echo "parallel_find_s $(elapsed "$t")" >>"$out"
+
+  stored=$(du -sk "$dir" | awk '{ print $1 }')
+  used=$(($(memory "$target") - base))
+  if [ "$target" = kfs ] && [ -z "$KFS_PID" ]; then
+    echo "bytes_per_stored_byte -" >>"$out"
+  else
+    echo "$used $stored" |
+      awk '{ printf "bytes_per_stored_byte %.2f\n", $1 / $2 }' >>"$out"
+  fi
+}
+
+if [ -n "${KFS_DIR:-}" ]; then
+  kfs_dir=$KFS_DIR
+else
+  MNT=$(mktemp -d)
+  "$KFS" "$MNT" -f &
+  KFS_PID=$!
+  while ! mountpoint -q "$MNT"; do
+    kill -0 "$KFS_PID" # the daemon failed to mount
+    sleep 0.1
+  done
+  kfs_dir=$MNT
+fi
+
+workloads kfs "$kfs_dir"
+workloads tmpfs "$TMPDIR_"
+
+echo "$SIZE_MB MiB file, $CLIENTS storm clients for ${SECONDS_} s," \
+  "$FINDS finds, $(du -sh "$WORK/src.tar" | cut -f1) tree"
+awk '
+  NR == FNR { kfs[$1] = $2; order[++n] = $1; next }
+  { tmpfs[$1] = $2 }
+  END {
+    printf "%-24s %12s %12s %10s\n", "workload", "kfs", "tmpfs", "kfs/tmpfs"
+    for (i = 1; i <= n; i++) {
+      k = order[i]
+      ratio = (tmpfs[k] + 0 != 0 && kfs[k] != "-") ? kfs[k] / tmpfs[k] : 0
+      printf "%-24s %12s %12s %10s\n", k, kfs[k], tmpfs[k],
+             ratio ? sprintf("%.2f", ratio) : "-"
+    }
+  }' "$WORK/kfs.txt" "$WORK/tmpfs.txt"
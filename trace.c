@@ -0,0 +1,182 @@
+#include "kfs.h"
+#include <pthread.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+atomic_bool kfs_trace_on;
+
+typedef struct Ring {
+  _Atomic uint64_t head;  // records ever written; only the owner stores it
+  _Atomic uint64_t floor; // records before this were cleared
+  uint64_t tid;
+  struct Ring *next;
+  _Atomic uint64_t recs[KFS_TRACE_RING][KFS_TRACE_WORDS];
+} Ring;
+
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static Ring *rings;
+static _Thread_local Ring *my_ring;
+
+static struct {
+  int on;
+} trace_opts;
+
+static const struct fuse_opt trace_fuse_opts[] = {{"kfs_trace", 0, 1},
+                                                  FUSE_OPT_END};
+
+int kfs_trace_parse(struct fuse_args *args) {
+  if (fuse_opt_parse(args, &trace_opts, trace_fuse_opts, NULL) == -1) {
+    return -1;
+  }
+  kfs_trace_enable(trace_opts.on);
+  return 0;
+}
+
+static pthread_once_t hz_once = PTHREAD_ONCE_INIT;
+static uint64_t hz;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void calibrate(void) {
+  uint64_t ns = now_ns();
+  uint64_t ticks = kfs_trace_ticks();
+  struct timespec pause = {0, 10 * 1000 * 1000};
+  nanosleep(&pause, NULL);
+  hz = (kfs_trace_ticks() - ticks) * 1000000000 / (now_ns() - ns);
+}
+
+uint64_t kfs_trace_hz(void) {
+  pthread_once(&hz_once, calibrate);
+  return hz;
+}
+
+void kfs_trace_enable(bool on) {
+  if (on) {
+    kfs_trace_hz(); // calibrate before the first record, not in a dump
+  }
+  atomic_store(&kfs_trace_on, on);
+}
+
+static Ring *ring(void) {
+  if (my_ring == NULL) {
+    Ring *r = xmalloc(sizeof(Ring));
+    memset(r, 0, sizeof(Ring));
+    r->tid = (uint64_t)syscall(SYS_gettid);
+
+    pthread_mutex_lock(&rings_lock);
+    r->next = rings;
+    rings = r;
+    pthread_mutex_unlock(&rings_lock);
+    my_ring = r;
+  }
+  return my_ring;
+}
+
+// FNV-1a
+static uint64_t path_ino(const char *path) {
+  uint64_t h = 14695981039346656037ull;
+  for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+    h = (h ^ *p) * 1099511628211ull;
+  }
+  return h;
+}
+
+void kfs_trace_push(const KFS_TraceSpan *span, int op, const char *path,
+                    int64_t offset, uint64_t size, int res) {
+  uint64_t end = kfs_trace_ticks();
+  Ring *r = ring();
+  uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  _Atomic uint64_t *w = r->recs[head & (KFS_TRACE_RING - 1)];
+
+  uint64_t words[KFS_TRACE_WORDS] = {
+      span->start, end, path_ino(path), (uint64_t)offset,
+      (size & 0xffffffff) << 32 | (uint64_t)op << 16 | (res < 0)};
+  for (int i = 0; i < KFS_TRACE_WORDS; i++) {
+    atomic_store_explicit(&w[i], words[i], memory_order_relaxed);
+  }
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+static sds put_u64(sds out, uint64_t v) {
+  unsigned char b[8];
+  for (int i = 0; i < 8; i++) {
+    b[i] = (unsigned char)(v >> (8 * i));
+  }
+  return sdscatlen(out, b, sizeof(b));
+}
+
+// appends r's live records to out, returns how many
+static uint64_t copy_ring(Ring *r, sds *out) {
+  uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+  uint64_t floor = atomic_load_explicit(&r->floor, memory_order_relaxed);
+  uint64_t lo = head > KFS_TRACE_RING ? head - KFS_TRACE_RING : 0;
+  if (lo < floor) {
+    lo = floor;
+  }
+
+  size_t n = head - lo;
+  uint64_t(*copy)[KFS_TRACE_WORDS] = xmalloc(sizeof(*copy) * (n + 1));
+  for (uint64_t i = lo; i < head; i++) {
+    _Atomic uint64_t *w = r->recs[i & (KFS_TRACE_RING - 1)];
+    for (int j = 0; j < KFS_TRACE_WORDS; j++) {
+      copy[i - lo][j] = atomic_load_explicit(&w[j], memory_order_relaxed);
+    }
+  }
+
+  // the writer may have lapped us meanwhile; its next slot may be torn too
+  atomic_thread_fence(memory_order_acquire);
+  uint64_t now = atomic_load_explicit(&r->head, memory_order_relaxed);
+  uint64_t valid = now >= KFS_TRACE_RING ? now - KFS_TRACE_RING + 1 : 0;
+
+  uint64_t kept = 0;
+  for (uint64_t i = lo > valid ? lo : valid; i < head; i++) {
+    *out = put_u64(*out, r->tid);
+    for (int j = 0; j < KFS_TRACE_WORDS; j++) {
+      *out = put_u64(*out, copy[i - lo][j]);
+    }
+    kept++;
+  }
+
+  xfree(&copy);
+  return kept;
+}
+
+sds kfs_trace_snapshot(void) {
+  sds out = sdsnewlen(KFS_TRACE_MAGIC, strlen(KFS_TRACE_MAGIC));
+  out = put_u64(out, kfs_trace_hz());
+  out = put_u64(out, KFS_OP_COUNT);
+  for (int op = 0; op < KFS_OP_COUNT; op++) {
+    const char *name = kfs_stats_op_name(op);
+    unsigned char len = (unsigned char)strlen(name);
+    out = sdscatlen(out, &len, 1);
+    out = sdscatlen(out, name, len);
+  }
+
+  size_t count_at = sdslen(out);
+  out = put_u64(out, 0);
+  uint64_t count = 0;
+
+  pthread_mutex_lock(&rings_lock);
+  for (Ring *r = rings; r != NULL; r = r->next) {
+    count += copy_ring(r, &out);
+  }
+  pthread_mutex_unlock(&rings_lock);
+
+  for (int i = 0; i < 8; i++) {
+    out[count_at + i] = (char)(count >> (8 * i));
+  }
+  return out;
+}
+
+void kfs_trace_clear(void) {
+  pthread_mutex_lock(&rings_lock);
+  for (Ring *r = rings; r != NULL; r = r->next) {
+    atomic_store(&r->floor, atomic_load(&r->head));
+  }
+  pthread_mutex_unlock(&rings_lock);
+}
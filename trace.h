@@ -0,0 +1,96 @@
+#ifndef __TRACE_HEADER_INCLUDED__
+#define __TRACE_HEADER_INCLUDED__
+#include "kfs.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+  Operation tracing.  Always compiled in and off by default; while off, an
+  operation pays one relaxed load and a predictable branch.  While on,
+  every operation appends a record (op, inode, offset, size, start and end
+  in TSC ticks) to a ring of KFS_TRACE_RING records owned by its thread;
+  the oldest records are overwritten.  Nothing is locked on either side:
+  a snapshot drops records their writer lapped while they were copied.
+
+  KFS has no inode numbers, so the inode of a record is a hash of the
+  operation's path.
+
+  Turned on with -o kfs_trace, the user.kfs.trace xattr of the root ("1" or
+  "0") or the shell's trace command.  The snapshot is served at
+  /.kfs/trace; tools/kfs_trace2json turns it into Chrome trace JSON, which
+  Perfetto and chrome://tracing read.
+
+  With <sys/sdt.h> around, kfs:op__entry(op, path) and
+  kfs:op__return(op, path, res) are also static probe points for perf,
+  bpftrace and SystemTap, independent of the switch above.
+*/
+
+#define KFS_TRACE_RING 8192 // records per thread, a power of two
+
+// snapshot layout, little endian:
+//   "KFSTRC01", u64 ticks per second, u64 op count,
+//   per op: u8 length, name;  u64 record count,
+//   per record: u64 tid, u64 start, u64 end, u64 ino, i64 offset,
+//               u64 (size << 32 | op << 16 | failed)
+#define KFS_TRACE_MAGIC "KFSTRC01"
+#define KFS_TRACE_WORDS 5
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define KFS_PROBE2(name, a, b) DTRACE_PROBE2(kfs, name, a, b)
+#define KFS_PROBE3(name, a, b, c) DTRACE_PROBE3(kfs, name, a, b, c)
+#endif
+#endif
+#ifndef KFS_PROBE2
+#define KFS_PROBE2(name, a, b)
+#define KFS_PROBE3(name, a, b, c)
+#endif
+
+extern atomic_bool kfs_trace_on;
+
+typedef struct {
+  uint64_t start; // 0: not tracing
+} KFS_TraceSpan;
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t kfs_trace_ticks(void) { return __rdtsc(); }
+#else
+static inline uint64_t kfs_trace_ticks(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+static inline void kfs_trace_begin(KFS_TraceSpan *span) {
+  span->start = __builtin_expect(
+                    atomic_load_explicit(&kfs_trace_on, memory_order_relaxed),
+                    0)
+                    ? kfs_trace_ticks()
+                    : 0;
+}
+
+void kfs_trace_push(const KFS_TraceSpan *span, int op, const char *path,
+                    int64_t offset, uint64_t size, int res);
+
+static inline void kfs_trace_end(const KFS_TraceSpan *span, int op,
+                                 const char *path, int64_t offset,
+                                 uint64_t size, int res) {
+  if (__builtin_expect(span->start != 0, 0)) {
+    kfs_trace_push(span, op, path, offset, size, res);
+  }
+}
+
+// consumes the kfs_trace option from args
+int kfs_trace_parse(struct fuse_args *args);
+void kfs_trace_enable(bool on);
+// ticks per second of kfs_trace_ticks
+uint64_t kfs_trace_hz(void);
+// everything still in the rings, in the layout above
+sds kfs_trace_snapshot(void);
+// forget what was recorded so far
+void kfs_trace_clear(void);
+
+#endif
@@ -0,0 +1,156 @@
+#include "kfs.h"
+#include <errno.h>
+#include <stdlib.h>
+
+// number of directories with a quota; the ancestor walk in
+// kfs_usage_check is skipped entirely while this is zero
+static atomic_int quota_dirs;
+
+void kfs_usage_init(KFS_Usage *usage) {
+  atomic_init(&usage->bytes, 0);
+  atomic_init(&usage->inodes, 0);
+  atomic_init(&usage->pending_bytes, 0);
+  atomic_init(&usage->pending_inodes, 0);
+  usage->quota_bytes = 0;
+  usage->quota_inodes = 0;
+}
+
+static void fold(KFS_Entry *dir, int64_t bytes, int64_t inodes) {
+  for (KFS_Entry *e = dir; e != NULL; e = e->prev) {
+    if (bytes != 0) {
+      atomic_fetch_add(&e->usage.bytes, bytes);
+    }
+    if (inodes != 0) {
+      atomic_fetch_add(&e->usage.inodes, inodes);
+    }
+  }
+}
+
+void kfs_usage_flush(KFS_Entry *dir) {
+  assert_is_dir(dir);
+  int64_t bytes = atomic_exchange(&dir->usage.pending_bytes, 0);
+  int64_t inodes = atomic_exchange(&dir->usage.pending_inodes, 0);
+  fold(dir, bytes, inodes);
+}
+
+void kfs_usage_charge(KFS_Entry *dir, int64_t bytes, int64_t inodes) {
+  if (dir == NULL) {
+    return;
+  }
+  assert_is_dir(dir);
+
+  int64_t pb = atomic_fetch_add(&dir->usage.pending_bytes, bytes) + bytes;
+  int64_t pi = atomic_fetch_add(&dir->usage.pending_inodes, inodes) + inodes;
+
+  if (llabs(pb) >= KFS_USAGE_BATCH_BYTES ||
+      llabs(pi) >= KFS_USAGE_BATCH_INODES) {
+    kfs_usage_flush(dir);
+  }
+}
+
+static bool flush_visit(KFS_WalkEntry *we, void *ctx __attribute__((unused))) {
+  if (EntryIsDir(we->entry)) {
+    kfs_usage_flush(we->entry);
+  }
+  return true;
+}
+
+void kfs_usage_sync(KFS_Entry *dir) {
+  assert_is_dir(dir);
+  kfs_walk(dir, dir->name, 0, 0, flush_visit, NULL);
+}
+
+KFS_UsageStat kfs_usage_get(KFS_Entry *dir) {
+  assert_is_dir(dir);
+  KFS_UsageStat st = {
+      atomic_load(&dir->usage.bytes) + atomic_load(&dir->usage.pending_bytes),
+      atomic_load(&dir->usage.inodes) +
+          atomic_load(&dir->usage.pending_inodes)};
+  return st;
+}
+
+KFS_UsageStat kfs_usage_of(KFS_Entry *entry) {
+  if (EntryIsDir(entry)) {
+    KFS_UsageStat st = kfs_usage_get(entry);
+    st.inodes += 1;
+    return st;
+  }
+  return (KFS_UsageStat){entry->size, 1};
+}
+
+int kfs_usage_check(KFS_Entry *dir, int64_t bytes, int64_t inodes) {
+  if (atomic_load(&quota_dirs) == 0 || (bytes <= 0 && inodes <= 0)) {
+    return 0;
+  }
+
+  // pending deltas on the way up are not folded into the ancestors yet,
+  // so they are added in as the chain is walked
+  KFS_UsageStat pending = {0, 0};
+
+  for (KFS_Entry *e = dir; e != NULL; e = e->prev) {
+    pending.bytes += atomic_load(&e->usage.pending_bytes);
+    pending.inodes += atomic_load(&e->usage.pending_inodes);
+
+    if (e->usage.quota_bytes == 0 && e->usage.quota_inodes == 0) {
+      continue;
+    }
+
+    int64_t used_bytes = atomic_load(&e->usage.bytes) + pending.bytes;
+    int64_t used_inodes = atomic_load(&e->usage.inodes) + pending.inodes;
+    if (e->usage.quota_bytes != 0 && bytes > 0 &&
+        used_bytes + bytes > e->usage.quota_bytes) {
+      return -EDQUOT;
+    }
+    if (e->usage.quota_inodes != 0 && inodes > 0 &&
+        used_inodes + inodes > e->usage.quota_inodes) {
+      return -EDQUOT;
+    }
+  }
+
+  return 0;
+}
+
+static void count_quota(KFS_Entry *dir, int delta) {
+  atomic_fetch_add(&quota_dirs, delta);
+  KFS_Region *home = kfs_entry_home(dir);
+  if (home != NULL) {
+    pthread_mutex_lock(&home->lock);
+    home->quota_dirs += delta;
+    pthread_mutex_unlock(&home->lock);
+  }
+}
+
+void kfs_usage_set_quota(KFS_Entry *dir, int64_t bytes, int64_t inodes) {
+  assert_is_dir(dir);
+  bool had = dir->usage.quota_bytes != 0 || dir->usage.quota_inodes != 0;
+  bool has = bytes != 0 || inodes != 0;
+
+  dir->usage.quota_bytes = bytes;
+  dir->usage.quota_inodes = inodes;
+
+  if (has && !had) {
+    count_quota(dir, 1);
+  } else if (had && !has) {
+    count_quota(dir, -1);
+  }
+}
+
+void kfs_usage_release(KFS_Entry *dir) { kfs_usage_set_quota(dir, 0, 0); }
+
+void kfs_usage_release_region(KFS_Region *region) {
+  atomic_fetch_sub(&quota_dirs, region->quota_dirs);
+  region->quota_dirs = 0;
+}
+
+int kfs_usage_quota_dirs(void) { return atomic_load(&quota_dirs); }
+
+bool kfs_usage_parse_quota(const char *s, int64_t *limit) {
+  char *end;
+  errno = 0;
+  long long v = strtoll(s, &end, 10);
+  if (end == s || *end != '\0' || errno == ERANGE || v < 0) {
+    return false;
+  }
+  *limit = v;
+  return true;
+}
@@ -0,0 +1,62 @@
+#ifndef __USAGE_HEADER_INCLUDED__
+#define __USAGE_HEADER_INCLUDED__
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+  Per-directory rollups of the bytes and inodes below it.
+
+  A change is first charged to the `pending` counters of the directory that
+  directly holds the changed entry; only writers in the same directory touch
+  that line.  Once a directory's pending delta crosses KFS_USAGE_BATCH_* it
+  is folded into `bytes`/`inodes` of the directory and every ancestor.
+
+  Reading a directory's usage is therefore O(1), but may lag behind by up
+  to one batch per descendant directory; kfs_usage_sync() folds everything
+  below a directory for an exact figure.  Quota checks also count the
+  pending deltas on the path from the writer up to the quota directory, so
+  they are only soft by what is pending in other branches.
+*/
+
+#define KFS_USAGE_BATCH_BYTES (1 << 20)
+#define KFS_USAGE_BATCH_INODES 64
+
+typedef struct {
+  _Atomic int64_t bytes;  // folded totals of the subtree
+  _Atomic int64_t inodes; // entries below, not counting the directory itself
+  _Atomic int64_t pending_bytes;
+  _Atomic int64_t pending_inodes;
+  int64_t quota_bytes; // 0 is unlimited
+  int64_t quota_inodes;
+} KFS_Usage;
+
+typedef struct {
+  int64_t bytes;
+  int64_t inodes;
+} KFS_UsageStat;
+
+struct KFS_Entry;
+struct KFS_Region;
+
+void kfs_usage_init(KFS_Usage *usage);
+void kfs_usage_charge(struct KFS_Entry *dir, int64_t bytes, int64_t inodes);
+void kfs_usage_flush(struct KFS_Entry *dir);
+void kfs_usage_sync(struct KFS_Entry *dir);
+KFS_UsageStat kfs_usage_get(struct KFS_Entry *dir);
+// what `entry` contributes to its parent: its size, or its subtree, plus 1
+KFS_UsageStat kfs_usage_of(struct KFS_Entry *entry);
+// 0, or -EDQUOT if adding bytes/inodes under dir would exceed a quota
+int kfs_usage_check(struct KFS_Entry *dir, int64_t bytes, int64_t inodes);
+void kfs_usage_set_quota(struct KFS_Entry *dir, int64_t bytes, int64_t inodes);
+// drops the quota of a directory being freed
+void kfs_usage_release(struct KFS_Entry *dir);
+// drops the quotas of directories in a region being destroyed, which are
+// not freed one by one
+void kfs_usage_release_region(struct KFS_Region *region);
+// directories with a quota
+int kfs_usage_quota_dirs(void);
+// a quota limit in decimal, 0 for none; false for anything else
+bool kfs_usage_parse_quota(const char *s, int64_t *limit);
+
+#endif
@@ -17,6 +17,15 @@ void *xmalloc(size_t size) {
   return ptr;
 }
 
+void *xrealloc(void *ptr, size_t size) {
+  ptr = realloc(ptr, size);
+  if (ptr == NULL && size != 0) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
 void xfreeImpl(void **p_ptr) {
   if (p_ptr == NULL || *p_ptr == NULL) {
     fprintf(stderr, "Given pointer is NULL");
@@ -45,6 +54,8 @@ double parseDouble(sds str) {
   size_t cursor = 0;
 
   if (strlen(str) == 0) {
+    free_vec(d);
+    free_vec(f);
     return ret; // ret == 0
   }
 
@@ -82,6 +93,8 @@ double parseDouble(sds str) {
     ret *= -1;
   }
 
+  free_vec(d);
+  free_vec(f);
   return ret;
 }
 
@@ -222,8 +235,9 @@ static SizedData readFile(const sds file_path) {
 
 sds readText(const sds file_path) {
   SizedData sdata = readFile(file_path);
-  ((char *)sdata.data)[sdata.size] = '\0';
-  return sdsnew((char *)sdata.data);
+  sds text = sdsnewlen(sdata.data, sdata.size);
+  free(sdata.data);
+  return text;
 }
 
 Vector *sdssplitvec(sds str, char sep) {
@@ -255,8 +269,8 @@ Vector *sdssplitvec(sds str, char sep) {
     vec_push(ret, buf);
   }
 
-  if (ret->len == 0) { // there is no sep in str
-    vec_push(ret, str);
+  if (ret->len == 0) { // str is empty
+    vec_push(ret, sdsempty());
   }
 
   return ret;
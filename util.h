@@ -3,6 +3,7 @@
 #include "sds/sds.h"
 
 void *xmalloc(size_t);
+void *xrealloc(void *, size_t);
 #define xfree(ptr_p) (xfreeImpl((void **)ptr_p))
 void xfreeImpl(void **);
 double parseDouble(sds);
@@ -33,5 +34,6 @@ typedef struct {
 SizedData *new_SizedData(void);
 
 sds readText(const sds file_name);
+// every component is a new sds; the caller frees them and the vector
 Vector *sdssplitvec(sds str, char sep);
 #endif
@@ -11,23 +11,38 @@ Vector *new_vec_with(size_t capacity) {
   v->data = xmalloc(sizeof(void *) * capacity);
   v->capacity = capacity;
   v->len = 0;
+  kfs_alloc_count(KFS_ALLOC_vectors, 1,
+                  sizeof(Vector) + sizeof(void *) * capacity);
   return v;
 }
 
 Vector *new_vec() { return new_vec_with(VECTOR_DEFAULT_CAPACITY); }
 
+void free_vec(Vector *v) {
+  kfs_alloc_count(KFS_ALLOC_vectors, -1,
+                  -(int64_t)(sizeof(Vector) + sizeof(void *) * v->capacity));
+  xfree(&v->data);
+  xfree(&v);
+}
+
+static void vec_resize(Vector *v, size_t capacity) {
+  kfs_alloc_count(KFS_ALLOC_vectors, 0,
+                  ((int64_t)capacity - (int64_t)v->capacity) *
+                      (int64_t)sizeof(void *));
+  v->capacity = capacity;
+  v->data = xrealloc(v->data, sizeof(void *) * v->capacity);
+}
+
 void vec_expand(Vector *v, size_t size) {
   if(v->len < size) {
-    v->capacity = size;
+    vec_resize(v, size);
     v->len = size;
-    v->data = realloc(v->data, sizeof(void *) * v->capacity);
   }
 }
 
 void vec_push(Vector *v, void *elem) {
   if(v->len == v->capacity) {
-    v->capacity *= 2;
-    v->data = realloc(v->data, sizeof(void *) * v->capacity);
+    vec_resize(v, v->capacity * 2);
   }
   v->data[v->len++] = elem;
 }
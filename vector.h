@@ -24,6 +24,8 @@ typedef struct {
 
 Vector *new_vec_with(size_t capacity);
 Vector *new_vec(void);
+// frees the vector, not its elements
+void free_vec(Vector *v);
 void vec_push(Vector *v, void *elem);
 void vec_pushi(Vector *v, int val);
 void *vec_get(Vector *v, size_t idx);
@@ -0,0 +1,259 @@
+#include "kfs.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+  KFS_Entry *entry;
+  sds path;
+  size_t depth;
+} WalkItem;
+
+typedef struct {
+  pthread_mutex_t lock;
+  WalkItem *items;
+  size_t head; // thieves take from here
+  size_t tail; // the owner pushes and pops here
+  size_t cap;
+} WalkDeque;
+
+typedef struct WalkShared WalkShared;
+
+typedef struct {
+  WalkShared *shared;
+  int id;
+  WalkDeque deque;
+  sds scratch; // path buffer for entries visited inline
+  unsigned int seed;
+} WalkWorker;
+
+struct WalkShared {
+  WalkWorker *workers;
+  int nworkers;
+  int flags;
+  atomic_size_t pending; // items pushed but not yet fully processed
+  KFS_WALK_VISITOR visitor;
+  void *ctx;
+};
+
+static void deque_init(WalkDeque *dq) {
+  pthread_mutex_init(&dq->lock, NULL);
+  dq->items = NULL;
+  dq->head = 0;
+  dq->tail = 0;
+  dq->cap = 0;
+}
+
+static void deque_free(WalkDeque *dq) {
+  pthread_mutex_destroy(&dq->lock);
+  free(dq->items);
+}
+
+static void deque_push(WalkDeque *dq, WalkItem item) {
+  pthread_mutex_lock(&dq->lock);
+  if (dq->tail == dq->cap) {
+    if (dq->head > 0) {
+      memmove(dq->items, dq->items + dq->head,
+              sizeof(WalkItem) * (dq->tail - dq->head));
+      dq->tail -= dq->head;
+      dq->head = 0;
+    } else {
+      dq->cap = dq->cap ? dq->cap * 2 : 64;
+      dq->items = xrealloc(dq->items, sizeof(WalkItem) * dq->cap);
+    }
+  }
+  dq->items[dq->tail++] = item;
+  pthread_mutex_unlock(&dq->lock);
+}
+
+static bool deque_pop(WalkDeque *dq, WalkItem *out) {
+  bool found = false;
+  pthread_mutex_lock(&dq->lock);
+  if (dq->tail > dq->head) {
+    *out = dq->items[--dq->tail];
+    found = true;
+  }
+  if (dq->tail == dq->head) {
+    dq->head = dq->tail = 0;
+  }
+  pthread_mutex_unlock(&dq->lock);
+  return found;
+}
+
+static bool deque_steal(WalkDeque *dq, WalkItem *out) {
+  bool found = false;
+  pthread_mutex_lock(&dq->lock);
+  if (dq->tail > dq->head) {
+    *out = dq->items[dq->head++];
+    found = true;
+  }
+  pthread_mutex_unlock(&dq->lock);
+  return found;
+}
+
+static void push_item(WalkWorker *w, KFS_Entry *entry, sds path,
+                      size_t depth) {
+  atomic_fetch_add(&w->shared->pending, 1);
+  deque_push(&w->deque, (WalkItem){entry, path, depth});
+}
+
+static sds join_path(sds buf, const char *parent, const char *name) {
+  sdsclear(buf);
+  buf = sdscat(buf, parent);
+  if (strcmp(parent, "/") != 0) {
+    buf = sdscat(buf, "/");
+  }
+  return sdscat(buf, name);
+}
+
+typedef struct {
+  WalkWorker *w;
+  WalkItem *parent;
+} ExpandCtx;
+
+// unsorted: files are visited right here, directories become work items
+static void expand_child(sds name, KFS_Entry *child, void *p) {
+  ExpandCtx *ec = p;
+  WalkWorker *w = ec->w;
+  WalkShared *sh = w->shared;
+
+  w->scratch = join_path(w->scratch, ec->parent->path, name);
+  KFS_WalkEntry we = {child, w->scratch, ec->parent->depth + 1, w->id};
+
+  if (sh->visitor(&we, sh->ctx) && EntryIsDir(child)) {
+    push_item(w, child, sdsdup(w->scratch), we.depth);
+  }
+}
+
+static void collect_child(sds name __attribute__((unused)), KFS_Entry *child,
+                          void *childs) {
+  vec_push((Vector *)childs, child);
+}
+
+static int child_name_cmp(const void *lhs, const void *rhs) {
+  return strcmp((*(KFS_Entry *const *)lhs)->name,
+                (*(KFS_Entry *const *)rhs)->name);
+}
+
+// sorted: every child becomes a work item, pushed last-first so that the
+// first name is popped next
+static void expand_sorted(WalkWorker *w, WalkItem *item) {
+  Vector *childs = new_vec();
+  KFS_DirIndex_foreach(GetAVLTree(item->entry), collect_child, childs);
+  qsort(childs->data, childs->len, sizeof(void *), child_name_cmp);
+
+  for (size_t i = childs->len; i > 0; i--) {
+    KFS_Entry *child = childs->data[i - 1];
+    sds path = join_path(sdsempty(), item->path, child->name);
+    push_item(w, child, path, item->depth + 1);
+  }
+
+  free_vec(childs);
+}
+
+static void process(WalkWorker *w, WalkItem *item) {
+  WalkShared *sh = w->shared;
+
+  if (sh->flags & KFS_WALK_SORTED) {
+    KFS_WalkEntry we = {item->entry, item->path, item->depth, w->id};
+    if (sh->visitor(&we, sh->ctx) && EntryIsDir(item->entry)) {
+      expand_sorted(w, item);
+    }
+  } else {
+    ExpandCtx ec = {w, item};
+    KFS_DirIndex_foreach(GetAVLTree(item->entry), expand_child, &ec);
+  }
+
+  sdsfree(item->path);
+  atomic_fetch_sub(&sh->pending, 1);
+}
+
+static bool steal(WalkWorker *w, WalkItem *out) {
+  WalkShared *sh = w->shared;
+  int start = rand_r(&w->seed) % sh->nworkers;
+
+  for (int i = 0; i < sh->nworkers; i++) {
+    WalkWorker *victim = &sh->workers[(start + i) % sh->nworkers];
+    if (victim != w && deque_steal(&victim->deque, out)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void *worker_main(void *arg) {
+  WalkWorker *w = arg;
+  WalkItem item;
+
+  for (;;) {
+    if (deque_pop(&w->deque, &item) || steal(w, &item)) {
+      process(w, &item);
+    } else if (atomic_load(&w->shared->pending) == 0) {
+      break;
+    } else {
+      sched_yield();
+    }
+  }
+
+  return NULL;
+}
+
+int kfs_walk_default_threads(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
+void kfs_walk(KFS_Entry *start, const char *start_path, int threads, int flags,
+              KFS_WALK_VISITOR visitor, void *ctx) {
+  if (threads <= 0) {
+    threads = kfs_walk_default_threads();
+  }
+  if (flags & KFS_WALK_SORTED) {
+    threads = 1;
+  }
+
+  WalkShared sh = {.nworkers = threads,
+                   .flags = flags,
+                   .visitor = visitor,
+                   .ctx = ctx};
+  atomic_init(&sh.pending, 0);
+  sh.workers = xmalloc(sizeof(WalkWorker) * threads);
+
+  for (int i = 0; i < threads; i++) {
+    WalkWorker *w = &sh.workers[i];
+    w->shared = &sh;
+    w->id = i;
+    w->scratch = sdsempty();
+    w->seed = (unsigned int)i * 2654435761u + 1;
+    deque_init(&w->deque);
+  }
+
+  // in unsorted mode items are expanded without being visited, so the
+  // starting entry is visited here
+  if (flags & KFS_WALK_SORTED) {
+    push_item(&sh.workers[0], start, sdsnew(start_path), 0);
+  } else {
+    KFS_WalkEntry we = {start, start_path, 0, 0};
+    if (visitor(&we, ctx) && EntryIsDir(start)) {
+      push_item(&sh.workers[0], start, sdsnew(start_path), 0);
+    }
+  }
+
+  pthread_t *tids = xmalloc(sizeof(pthread_t) * threads);
+  for (int i = 1; i < threads; i++) {
+    pthread_create(&tids[i], NULL, worker_main, &sh.workers[i]);
+  }
+  worker_main(&sh.workers[0]);
+  for (int i = 1; i < threads; i++) {
+    pthread_join(tids[i], NULL);
+  }
+
+  for (int i = 0; i < threads; i++) {
+    sdsfree(sh.workers[i].scratch);
+    deque_free(&sh.workers[i].deque);
+  }
+  xfree(&tids);
+  xfree(&sh.workers);
+}
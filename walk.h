@@ -0,0 +1,39 @@
+#ifndef __WALK_HEADER_INCLUDED__
+#define __WALK_HEADER_INCLUDED__
+#include "kfs.h"
+
+/*
+  Parallel walk over an entry tree.  Every worker owns a deque of pending
+  directories; it pops its own work from the bottom and, when that runs dry,
+  steals from the top of another worker's deque.  Results are streamed to
+  the visitor instead of being collected, so memory only grows with the
+  number of directories waiting to be expanded.
+
+  The visitor is called concurrently from all workers and must be
+  thread-safe; `worker` can be used to index per-thread state.  Returning
+  false from the visitor skips the subtree below a directory.
+
+  The tree must not be modified while it is walked.
+*/
+
+typedef struct {
+  KFS_Entry *entry;
+  const char *path; // only valid during the visitor call
+  size_t depth;     // 0 for the starting entry
+  int worker;       // 0 .. threads-1
+} KFS_WalkEntry;
+
+typedef bool (*KFS_WALK_VISITOR)(KFS_WalkEntry *we, void *ctx);
+
+enum {
+  // visit children of a directory in name order, depth first; forces a
+  // single worker so that the whole walk comes out in `tree` order
+  KFS_WALK_SORTED = 1 << 0,
+};
+
+int kfs_walk_default_threads(void);
+// threads <= 0 means kfs_walk_default_threads()
+void kfs_walk(KFS_Entry *start, const char *start_path, int threads, int flags,
+              KFS_WALK_VISITOR visitor, void *ctx);
+
+#endif